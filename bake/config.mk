@@ -0,0 +1,28 @@
+PRJTYPE = Executable
+TARGETNAME = trad-bake
+SRC = src/main.c \
+	src/headless.c \
+	../src/opengl.c \
+	../src/shader_util.c \
+	../src/hemicube.c \
+	../src/radiosity.c \
+	../src/radiosity_cpu.c \
+	../src/threadpool.c \
+	../src/bvh.c \
+	../src/light_grid.c \
+	../src/bake_cache.c \
+	../src/baked_scene.c \
+	../src/gpu_timer.c \
+	../src/uvmap.c \
+	../src/file_map.c \
+	../src/mesh_import.c \
+	../src/scene.c
+ADDINCS = ../src
+LIBS = glad macu EGL
+ifneq ($(TARGET_OS), Windows)
+	LIBS += pthread dl
+endif
+EXTDEPS = gfxwnd::0.0.1dev macu::0.0.2dev
+ifneq ($(VARIANT), Debug)
+	DEFINES += OPENGL_NO_DEBUG
+endif
@@ -0,0 +1,98 @@
+#include "headless.h"
+#include <string.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+static EGLDisplay headless_display()
+{
+    /* Prefer a display that needs no window system at all (Mesa) */
+    const char* exts = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (exts && strstr(exts, "EGL_MESA_platform_surfaceless")) {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (get_platform_display) {
+            EGLDisplay dpy = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, 0);
+            if (dpy != EGL_NO_DISPLAY)
+                return dpy;
+        }
+    }
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+int headless_ctx_create(struct headless_ctx* hc, int major, int minor)
+{
+    memset(hc, 0, sizeof(*hc));
+
+    /* Display */
+    EGLDisplay dpy = headless_display();
+    if (dpy == EGL_NO_DISPLAY || !eglInitialize(dpy, 0, 0))
+        return 0;
+    if (!eglBindAPI(EGL_OPENGL_API))
+        goto fail;
+
+    /* Config */
+    const EGLint cfg_attribs[] = {
+        EGL_SURFACE_TYPE,    EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLConfig cfg;
+    EGLint num_cfgs = 0;
+    if (!eglChooseConfig(dpy, cfg_attribs, &cfg, 1, &num_cfgs) || num_cfgs == 0)
+        goto fail;
+
+    /* Context */
+    const EGLint ctx_attribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION_KHR,       major,
+        EGL_CONTEXT_MINOR_VERSION_KHR,       minor,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+        EGL_NONE
+    };
+    EGLContext ctx = eglCreateContext(dpy, cfg, EGL_NO_CONTEXT, ctx_attribs);
+    if (ctx == EGL_NO_CONTEXT)
+        goto fail;
+
+    /* All rendering happens in FBOs, a dummy surface is only needed without surfaceless support */
+    EGLSurface surf = EGL_NO_SURFACE;
+    const char* dpy_exts = eglQueryString(dpy, EGL_EXTENSIONS);
+    if (!dpy_exts || !strstr(dpy_exts, "EGL_KHR_surfaceless_context")) {
+        const EGLint pb_attribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+        surf = eglCreatePbufferSurface(dpy, cfg, pb_attribs);
+        if (surf == EGL_NO_SURFACE) {
+            eglDestroyContext(dpy, ctx);
+            goto fail;
+        }
+    }
+
+    if (!eglMakeCurrent(dpy, surf, surf, ctx)) {
+        if (surf != EGL_NO_SURFACE)
+            eglDestroySurface(dpy, surf);
+        eglDestroyContext(dpy, ctx);
+        goto fail;
+    }
+
+    hc->display = dpy;
+    hc->surface = surf;
+    hc->context = ctx;
+    return 1;
+
+fail:
+    eglTerminate(dpy);
+    return 0;
+}
+
+void headless_ctx_destroy(struct headless_ctx* hc)
+{
+    EGLDisplay dpy = hc->display;
+    eglMakeCurrent(dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (hc->surface != EGL_NO_SURFACE)
+        eglDestroySurface(dpy, hc->surface);
+    eglDestroyContext(dpy, hc->context);
+    eglTerminate(dpy);
+    memset(hc, 0, sizeof(*hc));
+}
+
+void* headless_ctx_proc_address(const char* name)
+{
+    return (void*) eglGetProcAddress(name);
+}
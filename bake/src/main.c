@@ -0,0 +1,507 @@
+/*********************************************************************************************************************/
+/*                                                  /===-_---~~~~~~~~~------____                                     */
+/*                                                 |===-~___                _,-'                                     */
+/*                  -==\\                         `//~\\   ~~~~`---.___.-~~                                          */
+/*              ______-==|                         | |  \\           _-~`                                            */
+/*        __--~~~  ,-/-==\\                        | |   `\        ,'                                                */
+/*     _-~       /'    |  \\                      / /      \      /                                                  */
+/*   .'        /       |   \\                   /' /        \   /'                                                   */
+/*  /  ____  /         |    \`\.__/-~~ ~ \ _ _/'  /          \/'                                                     */
+/* /-'~    ~~~~~---__  |     ~-/~         ( )   /'        _--~`                                                      */
+/*                   \_|      /        _)   ;  ),   __--~~                                                           */
+/*                     '~~--_/      _-~/-  / \   '-~ \                                                               */
+/*                    {\__--_/}    / \\_>- )<__\      \                                                              */
+/*                    /'   (_/  _-~  | |__>--<__|      |                                                             */
+/*                   |0  0 _/) )-~     | |__>--<__|     |                                                            */
+/*                   / /~ ,_/       / /__>---<__/      |                                                             */
+/*                  o o _//        /-~_>---<__-~      /                                                              */
+/*                  (^(~          /~_>---<__-      _-~                                                               */
+/*                 ,/|           /__>--<__/     _-~                                                                  */
+/*              ,//('(          |__>--<__|     /                  .----_                                             */
+/*             ( ( '))          |__>--<__|    |                 /' _---_~\                                           */
+/*          `-)) )) (           |__>--<__|    |               /'  /     ~\`\                                         */
+/*         ,/,'//( (             \__>--<__\    \            /'  //        ||                                         */
+/*       ,( ( ((, ))              ~-__>--<_~-_  ~--____---~' _/'/        /'                                          */
+/*     `~/  )` ) ,/|                 ~-_~>--<_/-__       __-~ _/                                                     */
+/*   ._-~//( )/ )) `                    ~~-'_/_/ /~~~~~~~__--~                                                       */
+/*    ;'( ')/ ,)(                              ~~~~~~~~~~                                                            */
+/*   ' ') '( (/                                                                                                      */
+/*     '   '  `                                                                                                      */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <prof.h>
+#include <glad/glad.h>
+#include "opengl.h"
+#include "shader_util.h"
+#include "scene.h"
+#include "hemicube.h"
+#include "radiosity.h"
+#include "radiosity_cpu.h"
+#include "headless.h"
+#include "bake_cache.h"
+#include "baked_scene.h"
+#include "gpu_timer.h"
+
+#define LIGHTMAP_SIZE 128
+
+struct bake_params {
+    /* Lightmap width and height */
+    int lm_res;
+    /* Hemicube face resolution */
+    int hemicube_res;
+    /* Maximum number of shooters to process */
+    long max_iterations;
+    /* Maximum wall clock time in seconds, zero for unlimited */
+    float max_seconds;
+    /* Residual energy fraction where the solution is considered converged */
+    float threshold;
+    /* Shooters selected and shot per gi pass */
+    int batch_size;
+    /* Single draw per shooter hemicube instead of one per face */
+    int layered;
+    /* Solve on the cpu reference backend instead of the gpu */
+    int cpu;
+    /* Worker threads of the cpu backend, zero for one per cpu */
+    int threads;
+    /* Shadow rays instead of hemicube ID buffers on the gpu backend */
+    int raycast;
+    /* Storage of the gpu backend radiosity and unshot textures */
+    int accum_format;
+    /* GL error reporting, sync to break on the failing call */
+    int gl_debug;
+    /* Linked program binaries are kept here across launches, none when empty */
+    const char* shader_cache_dir;
+    /* Shooters between progress reports, zero to disable */
+    long report_interval;
+    /* Bake cache to warm start from and update, none when null */
+    const char* cache_file;
+    /* Solver state to resume from and checkpoint to, none when null */
+    const char* state_file;
+    /* Shooters between checkpoints, zero to only write one on exit */
+    long checkpoint_interval;
+    /* Shooters between intermediate lightmaps streamed next to the output, zero to disable */
+    long stream_interval;
+    /* Per stage gpu timings output, CSV or JSON by extension, none when null */
+    const char* timings_file;
+    /* OBJ or binary PLY scene, the builtin cornell box when null */
+    const char* mesh_file;
+    /* Light list, the cornell box light when null */
+    const char* lights_file;
+    /* Baked scene container for the viewer, none when null */
+    const char* scene_out_file;
+    /* Output lightmap file */
+    const char* out_file;
+    /* Directory that contains the res folder */
+    const char* root_dir;
+};
+
+static void usage(const char* prog)
+{
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  -L <texels>      Lightmap resolution (default: %d)\n"
+        "  -H <texels>      Hemicube face resolution (default: %d)\n"
+        "  -n <iterations>  Shooter budget (default: 100000)\n"
+        "  -t <seconds>     Wall clock budget, 0 for unlimited (default: 0)\n"
+        "  -e <fraction>    Stop when unshot energy drops below fraction of emitted (default: %g)\n"
+        "  -k <shooters>    Shooters batched per gi pass, up to %d (default: 1)\n"
+        "  -l <0|1>         Render all hemicube faces in a single draw (default: 1)\n"
+        "  -b <gpu|cpu>     Solver backend (default: gpu)\n"
+        "  -v <hemicube|raycast>  Gpu backend visibility (default: hemicube)\n"
+        "  -g <off|async|sync|check>  GL error reporting, ignored in release builds (default: async)\n"
+        "  -a <rgba16f|r11g11b10f|rgba32f>  Gpu backend accumulation format (default: rgba16f)\n"
+        "  -j <threads>     Cpu backend threads, 0 for one per cpu (default: 0)\n"
+        "  -r <iterations>  Progress report interval, 0 to disable (default: 1000)\n"
+        "  -c <file>        Warm start from and update a bake cache (gpu backend)\n"
+        "  -s <file>        Resume from and checkpoint solver state to file (gpu backend)\n"
+        "  -p <iterations>  Checkpoint interval, 0 for exit only (default: 10000)\n"
+        "  -i <iterations>  Write intermediate lightmaps to <output>.<shooters>.pfm, 0 to disable (gpu backend)\n"
+        "  -P <dir>         Program binary cache, empty to disable (default: shadercache)\n"
+        "  -T <file>        Write per stage gpu timings, JSON for .json and CSV otherwise\n"
+        "  -m <file>        Scene mesh in OBJ or binary PLY format, after -C (default: cornell box)\n"
+        "  -q <file>        Light list, one point, spot or area light per line, after -C (default: cornell box light)\n"
+        "  -x <file>        Export mesh and lightmap as a baked scene for the viewer (gpu backend)\n"
+        "  -o <file>        Output lightmap in PFM format (default: lightmap.pfm)\n"
+        "  -C <dir>         Change to directory before loading resources\n",
+        prog, LIGHTMAP_SIZE, HEMICUBE_SRES, RADIOSITY_DEFAULT_THRESHOLD, RADIOSITY_MAX_BATCH);
+}
+
+/* Index of v among the two accepted values, -1 when it is neither */
+static int parse_choice(const char* v, const char* v0, const char* v1)
+{
+    return !strcmp(v, v0) ? 0 : (!strcmp(v, v1) ? 1 : -1);
+}
+
+static int parse_args(struct bake_params* bp, int argc, char* argv[])
+{
+    for (int i = 1; i < argc; ++i) {
+        const char* a = argv[i];
+        const char* v = i + 1 < argc ? argv[i + 1] : 0;
+        if (a[0] != '-' || a[1] == '\0' || a[2] != '\0' || !v)
+            return 0;
+        switch (a[1]) {
+            case 'L': bp->lm_res          = strtol(v, 0, 10); break;
+            case 'H': bp->hemicube_res    = strtol(v, 0, 10); break;
+            case 'n': bp->max_iterations  = strtol(v, 0, 10); break;
+            case 't': bp->max_seconds     = strtof(v, 0);     break;
+            case 'e': bp->threshold       = strtof(v, 0);     break;
+            case 'k': bp->batch_size      = strtol(v, 0, 10); break;
+            case 'l': bp->layered         = strtol(v, 0, 10); break;
+            case 'b': if ((bp->cpu = parse_choice(v, "gpu", "cpu")) < 0) return 0; break;
+            case 'v': if ((bp->raycast = parse_choice(v, "hemicube", "raycast")) < 0) return 0; break;
+            case 'g': if ((bp->gl_debug = opengl_debug_mode_from_name(v)) < 0) return 0; break;
+            case 'a': if ((bp->accum_format = radiosity_accum_format_from_name(v)) < 0) return 0; break;
+            case 'j': bp->threads         = strtol(v, 0, 10); break;
+            case 'r': bp->report_interval = strtol(v, 0, 10); break;
+            case 'c': bp->cache_file      = v;                break;
+            case 's': bp->state_file      = v;                break;
+            case 'p': bp->checkpoint_interval = strtol(v, 0, 10); break;
+            case 'i': bp->stream_interval = strtol(v, 0, 10); break;
+            case 'P': bp->shader_cache_dir = v;               break;
+            case 'T': bp->timings_file    = v;                break;
+            case 'm': bp->mesh_file       = v;                break;
+            case 'q': bp->lights_file     = v;                break;
+            case 'x': bp->scene_out_file  = v;                break;
+            case 'o': bp->out_file        = v;                break;
+            case 'C': bp->root_dir        = v;                break;
+            default: return 0;
+        }
+        ++i;
+    }
+    return 1;
+}
+
+static void opengl_err_cb(void* ud, const char* msg)
+{
+    (void) ud;
+    fprintf(stderr, "%s\n", msg);
+    exit(EXIT_FAILURE);
+}
+
+/* Writes given RGB float image as a little endian Portable Float Map */
+static int write_pfm(const char* fpath, const float* rgb, int width, int height)
+{
+    FILE* f = fopen(fpath, "wb");
+    if (!f)
+        return 0;
+    /* Rows are stored bottom to top, same as the OpenGL texture layout */
+    fprintf(f, "PF\n%d %d\n-1.0\n", width, height);
+    size_t num_floats = (size_t) width * height * 3;
+    size_t written = fwrite(rgb, sizeof(float), num_floats, f);
+    fclose(f);
+    return written == num_floats;
+}
+
+static int save_lightmap(const char* fpath, int width, int height, int cpu)
+{
+    float* rgb = malloc((size_t) width * height * 3 * sizeof(float));
+    if (cpu) {
+        radiosity_cpu_lightmap(rgb);
+    } else {
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glBindTexture(GL_TEXTURE_2D, radiosity_lightmap());
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_FLOAT, rgb);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+    int r = write_pfm(fpath, rgb, width, height);
+    free(rgb);
+    return r;
+}
+
+/* Writes every intermediate lightmap that has landed, or all queued ones when waiting */
+static void stream_lightmaps(struct bake_params* bp, int res, int wait)
+{
+    const float* rgb;
+    unsigned long shooters;
+    size_t stem = strlen(bp->out_file);
+    if (stem > 4 && strcmp(bp->out_file + stem - 4, ".pfm") == 0)
+        stem -= 4;
+    while ((rgb = radiosity_readback_poll(wait, &shooters))) {
+        char fpath[4096];
+        snprintf(fpath, sizeof(fpath), "%.*s.%lu.pfm", (int)stem, bp->out_file, shooters);
+        if (!write_pfm(fpath, rgb, res, res))
+            fprintf(stderr, "Could not write %s\n", fpath);
+        radiosity_readback_release();
+    }
+}
+
+static float solver_residual(struct bake_params* bp)
+{
+    return bp->cpu ? radiosity_cpu_residual() : radiosity_residual();
+}
+
+static int solver_converged(struct bake_params* bp)
+{
+    return bp->cpu ? radiosity_cpu_converged() : radiosity_converged();
+}
+
+/* Shooters actually selected, the budget counts full batches */
+static long solver_iterations(struct bake_params* bp)
+{
+    return bp->cpu ? (long)radiosity_cpu_iterations() : (long)radiosity_iterations();
+}
+
+int main(int argc, char* argv[])
+{
+    struct bake_params bp = {
+        .lm_res          = LIGHTMAP_SIZE,
+        .hemicube_res    = HEMICUBE_SRES,
+        .max_iterations  = 100000,
+        .max_seconds     = 0.0f,
+        .threshold       = RADIOSITY_DEFAULT_THRESHOLD,
+        .batch_size      = 1,
+        .layered         = 1,
+        .cpu             = 0,
+        .threads         = 0,
+        .raycast         = 0,
+        .accum_format    = RADIOSITY_ACCUM_RGBA16F,
+        .gl_debug        = OPENGL_DEBUG_ASYNC,
+        .shader_cache_dir = "shadercache",
+        .report_interval = 1000,
+        .cache_file      = 0,
+        .state_file      = 0,
+        .checkpoint_interval = 10000,
+        .stream_interval = 0,
+        .timings_file    = 0,
+        .mesh_file       = 0,
+        .lights_file     = 0,
+        .scene_out_file  = 0,
+        .out_file        = "lightmap.pfm",
+        .root_dir        = 0
+    };
+    if (!parse_args(&bp, argc, argv) || bp.lm_res <= 0 || bp.hemicube_res <= 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (bp.root_dir && chdir(bp.root_dir) != 0) {
+        fprintf(stderr, "Could not change directory to %s\n", bp.root_dir);
+        return EXIT_FAILURE;
+    }
+
+    /* Initialize offscreen context */
+    struct headless_ctx hc;
+    if (!headless_ctx_create(&hc, 4, 3)) {
+        fprintf(stderr, "Could not create headless OpenGL 4.3 context\n");
+        return EXIT_FAILURE;
+    }
+    gladLoadGLLoader((GLADloadproc) headless_ctx_proc_address);
+    opengl_register_error_handler(opengl_err_cb, 0);
+    opengl_set_debug_mode(bp.gl_debug);
+    printf("Renderer: %s\n", glGetString(GL_RENDERER));
+    shader_cache_init(bp.shader_cache_dir);
+
+    /* Lights, these take part in the bake cache key like the scene */
+    struct radiosity_light* lights;
+    unsigned int num_lights = 1;
+    if (bp.lights_file) {
+        if (!scene_lights_load(&lights, &num_lights, bp.lights_file)) {
+            headless_ctx_destroy(&hc);
+            return EXIT_FAILURE;
+        }
+        printf("Loaded %u lights from %s\n", num_lights, bp.lights_file);
+    } else {
+        lights = malloc(sizeof(*lights));
+        scene_cornell_box_light(lights);
+    }
+
+    /* Load scene and solver */
+    const int lightmap_res = bp.lm_res;
+    struct scene_mesh mesh;
+    struct bake_cache_params bcp = {
+        .lm_width   = lightmap_res,
+        .lm_height  = lightmap_res,
+        .lm_padding = SCENE_LM_PADDING,
+        .hemicube_res = bp.hemicube_res,
+        .batch_size = bp.batch_size,
+        .vis_mode   = bp.raycast ? RADIOSITY_VIS_RAYCAST : RADIOSITY_VIS_HEMICUBE,
+        .accum_format = bp.accum_format
+    };
+    unsigned long long scene_hash = bp.mesh_file
+        ? scene_file_hash(BAKE_CACHE_HASH_SEED, bp.mesh_file)
+        : scene_cornell_box_hash(BAKE_CACHE_HASH_SEED);
+    scene_hash = bake_cache_hash(scene_hash, lights, num_lights * sizeof(*lights));
+    unsigned long long bake_key = bake_cache_key(scene_hash, &bcp);
+    struct bake_cache warm_start;
+    int warm = !bp.cpu && bp.cache_file && bake_cache_load(&warm_start, bp.cache_file, bake_key);
+    if (bp.mesh_file) {
+        unsigned long t_load = millisecs();
+        if (!scene_mesh_load_file(&mesh, bp.mesh_file, lightmap_res, lightmap_res, warm ? warm_start.lm_uvs : 0)) {
+            if (warm)
+                bake_cache_free(&warm_start);
+            free(lights);
+            headless_ctx_destroy(&hc);
+            return EXIT_FAILURE;
+        }
+        printf("Loaded %s, %u vertices and %u triangles in %lums\n",
+               bp.mesh_file, mesh.num_vertices, mesh.num_indices / 3, millisecs() - t_load);
+    } else if (warm) {
+        scene_cornell_box_load_uvs(&mesh, warm_start.lm_uvs);
+    } else {
+        scene_cornell_box_load(&mesh, lightmap_res, lightmap_res);
+    }
+    unsigned long t_init = millisecs();
+    radiosity_init(lightmap_res, lightmap_res);
+    radiosity_set_threshold(bp.threshold);
+    radiosity_set_batch_size(bp.batch_size);
+    radiosity_set_layered(bp.layered);
+    radiosity_set_hemicube_resolution(bp.hemicube_res);
+    radiosity_set_accum_format(bp.accum_format);
+    radiosity_set_lightmap_area(mesh.lm_area);
+    radiosity_set_lights(lights, num_lights);
+    free(lights);
+    printf("Solver initialized in %lums\n", millisecs() - t_init);
+    if (bp.raycast) {
+        struct scene_geometry geom;
+        scene_mesh_read_geometry(&mesh, &geom);
+        radiosity_set_scene(geom.positions, geom.num_vertices, geom.indices, geom.num_indices);
+        radiosity_set_visibility_mode(RADIOSITY_VIS_RAYCAST);
+        scene_geometry_free(&geom);
+    }
+
+    /* Attribute buffer for radiosity */
+    radiosity_attrib_pass {
+        scene_mesh_draw(&mesh);
+    }
+    if (warm) {
+        bake_cache_restore(&warm_start);
+        bake_cache_free(&warm_start);
+        printf("Warm start from %s\n", bp.cache_file);
+    }
+    /* Solver settings may change between runs, only the scene and its lights must match to resume */
+    int checkpoint = !bp.cpu && bp.state_file;
+    radiosity_set_state_key(scene_hash);
+    if (checkpoint) {
+        FILE* f = fopen(bp.state_file, "rb");
+        int exists = f != 0;
+        if (f)
+            fclose(f);
+        if (radiosity_load_state(bp.state_file)) {
+            printf("Resuming from %s at %lu shooters\n", bp.state_file, radiosity_iterations());
+        } else if (exists) {
+            /* Never replace a state that could still be resumed with the matching scene */
+            fprintf(stderr, "Could not resume from %s, it was saved for another scene, light list, lightmap "
+                            "resolution, accumulation format or version. Remove it or pick another state file\n", bp.state_file);
+            gpu_timer_destroy();
+            radiosity_destroy();
+            scene_mesh_free(&mesh);
+            headless_ctx_destroy(&hc);
+            return EXIT_FAILURE;
+        }
+    }
+
+    /* The cpu backend shares the attribute pass results and ray casts against the same mesh */
+    if (bp.cpu) {
+        struct scene_geometry geom;
+        scene_mesh_read_geometry(&mesh, &geom);
+        radiosity_cpu_init(lightmap_res, lightmap_res, bp.threads);
+        radiosity_cpu_set_threshold(bp.threshold);
+        radiosity_cpu_set_batch_size(bp.batch_size);
+        radiosity_cpu_set_lightmap_area(mesh.lm_area);
+        radiosity_cpu_set_scene(geom.positions, geom.num_vertices, geom.indices, geom.num_indices);
+        radiosity_cpu_fetch_attributes();
+        scene_geometry_free(&geom);
+    }
+
+    /* Progress solution until convergence or until the budget is exhausted */
+    long batch = !bp.cpu ? radiosity_batch_size()
+        : bp.batch_size < 1 ? 1 : (bp.batch_size > RADIOSITY_MAX_BATCH ? RADIOSITY_MAX_BATCH : bp.batch_size);
+    unsigned long t_start = millisecs(), t_last = t_start;
+    int stream = !bp.cpu && bp.stream_interval > 0;
+    long i_start = checkpoint ? (long)radiosity_iterations() : 0;
+    long i = i_start, i_last = i;
+    long shot_start = solver_iterations(&bp), shot_last = shot_start;
+    while (i < bp.max_iterations && !solver_converged(&bp)) {
+        if (bp.cpu) {
+            radiosity_cpu_gi_pass();
+        } else {
+            radiosity_gi_pass {
+                scene_mesh_draw_visibility(&mesh);
+            }
+        }
+        i += batch;
+        unsigned long now = millisecs();
+        if (bp.report_interval && i / bp.report_interval != i_last / bp.report_interval) {
+            float secs = (now - t_last) / 1000.0f;
+            long shot = solver_iterations(&bp);
+            printf("[%ld] %.1f shooters/s, residual %.4f\n", i,
+                   secs > 0.0f ? (shot - shot_last) / secs : 0.0f, solver_residual(&bp));
+            t_last = now;
+            i_last = i;
+            shot_last = shot;
+        }
+        if (checkpoint) {
+            /* Snapshots are copied out asynchronously and written on a later iteration */
+            if (radiosity_checkpoint_poll(0) < 0)
+                fprintf(stderr, "Could not write %s\n", bp.state_file);
+            if (bp.checkpoint_interval && i / bp.checkpoint_interval != (i - batch) / bp.checkpoint_interval)
+                radiosity_checkpoint(bp.state_file);
+        }
+        if (stream) {
+            /* Copies land a few passes later, without draining the pipeline */
+            stream_lightmaps(&bp, lightmap_res, 0);
+            if (i / bp.stream_interval != (i - batch) / bp.stream_interval)
+                radiosity_readback_async();
+        }
+        if (bp.max_seconds > 0.0f && (now - t_start) / 1000.0f >= bp.max_seconds)
+            break;
+    }
+    if (stream)
+        stream_lightmaps(&bp, lightmap_res, 1);
+    glFinish();
+    float total_secs = (millisecs() - t_start) / 1000.0f;
+    long shot = solver_iterations(&bp) - shot_start;
+    printf("Baked %ld shooters in %.2fs (%.1f shooters/s), residual %.4f%s\n",
+           shot, total_secs, total_secs > 0.0f ? shot / total_secs : 0.0f,
+           solver_residual(&bp), solver_converged(&bp) ? " (converged)" : "");
+
+    /* Final checkpoint supersedes any periodic one still in flight */
+    if (checkpoint && (radiosity_checkpoint_poll(1) < 0 || !radiosity_save_state(bp.state_file)))
+        fprintf(stderr, "Could not write %s\n", bp.state_file);
+
+    /* Store result */
+    int ok = save_lightmap(bp.out_file, lightmap_res, lightmap_res, bp.cpu);
+    if (!ok)
+        fprintf(stderr, "Could not write %s\n", bp.out_file);
+    else
+        printf("Wrote %s\n", bp.out_file);
+
+    /* Update bake cache */
+    if (ok && !bp.cpu && bp.cache_file) {
+        struct bake_cache bc;
+        bake_cache_capture(&bc, bake_key, &mesh, lightmap_res, lightmap_res);
+        if (!bake_cache_save(&bc, bp.cache_file))
+            fprintf(stderr, "Could not write %s\n", bp.cache_file);
+        bake_cache_free(&bc);
+    }
+
+    /* Ship mesh and lightmap in one file */
+    if (ok && !bp.cpu && bp.scene_out_file) {
+        struct baked_scene bs;
+        baked_scene_capture(&bs, &mesh, lightmap_res, lightmap_res);
+        if (baked_scene_save(&bs, bp.scene_out_file))
+            printf("Wrote %s\n", bp.scene_out_file);
+        else
+            fprintf(stderr, "Could not write %s\n", bp.scene_out_file);
+        baked_scene_free(&bs);
+    }
+
+    /* Gpu stage timings */
+    if (bp.timings_file) {
+        if (gpu_timer_dump(bp.timings_file))
+            printf("Wrote %s\n", bp.timings_file);
+        else
+            fprintf(stderr, "Could not write %s\n", bp.timings_file);
+    }
+
+    /* De-initialize */
+    gpu_timer_destroy();
+    if (bp.cpu)
+        radiosity_cpu_destroy();
+    radiosity_destroy();
+    scene_mesh_free(&mesh);
+    headless_ctx_destroy(&hc);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
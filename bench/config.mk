@@ -0,0 +1,25 @@
+PRJTYPE = Executable
+TARGETNAME = trad-bench
+SRC = src/main.c \
+	../bake/src/headless.c \
+	../src/opengl.c \
+	../src/shader_util.c \
+	../src/hemicube.c \
+	../src/radiosity.c \
+	../src/bvh.c \
+	../src/light_grid.c \
+	../src/gpu_timer.c \
+	../src/bake_cache.c \
+	../src/uvmap.c \
+	../src/file_map.c \
+	../src/mesh_import.c \
+	../src/scene.c
+ADDINCS = ../src ../bake/src
+LIBS = glad macu EGL
+ifneq ($(TARGET_OS), Windows)
+	LIBS += pthread dl
+endif
+EXTDEPS = gfxwnd::0.0.1dev macu::0.0.2dev
+ifneq ($(VARIANT), Debug)
+	DEFINES += OPENGL_NO_DEBUG
+endif
@@ -0,0 +1,10 @@
+# Extra arguments for the benchmark run, e.g. BENCH_ARGS="-L 64,128,256 -n 2000"
+BENCH_ARGS ?=
+BENCH_OUT ?= bench/bench.json
+
+# Runs the benchmark matrix from the repository root so that resources resolve
+bench: build_bench
+	@echo Benchmarking into $(BENCH_OUT) ...
+	@$(call native_path, $(MASTEROUT_bench)) -o $(BENCH_OUT) $(BENCH_ARGS)
+
+.PHONY: bench
@@ -0,0 +1,483 @@
+/*********************************************************************************************************************/
+/*                                                  /===-_---~~~~~~~~~------____                                     */
+/*                                                 |===-~___                _,-'                                     */
+/*                  -==\\                         `//~\\   ~~~~`---.___.-~~                                          */
+/*              ______-==|                         | |  \\           _-~`                                            */
+/*        __--~~~  ,-/-==\\                        | |   `\        ,'                                                */
+/*     _-~       /'    |  \\                      / /      \      /                                                  */
+/*   .'        /       |   \\                   /' /        \   /'                                                   */
+/*  /  ____  /         |    \`\.__/-~~ ~ \ _ _/'  /          \/'                                                     */
+/* /-'~    ~~~~~---__  |     ~-/~         ( )   /'        _--~`                                                      */
+/*                   \_|      /        _)   ;  ),   __--~~                                                           */
+/*                     '~~--_/      _-~/-  / \   '-~ \                                                               */
+/*                    {\__--_/}    / \\_>- )<__\      \                                                              */
+/*                    /'   (_/  _-~  | |__>--<__|      |                                                             */
+/*                   |0  0 _/) )-~     | |__>--<__|     |                                                            */
+/*                   / /~ ,_/       / /__>---<__/      |                                                             */
+/*                  o o _//        /-~_>---<__-~      /                                                              */
+/*                  (^(~          /~_>---<__-      _-~                                                               */
+/*                 ,/|           /__>--<__/     _-~                                                                  */
+/*              ,//('(          |__>--<__|     /                  .----_                                             */
+/*             ( ( '))          |__>--<__|    |                 /' _---_~\                                           */
+/*          `-)) )) (           |__>--<__|    |               /'  /     ~\`\                                         */
+/*         ,/,'//( (             \__>--<__\    \            /'  //        ||                                         */
+/*       ,( ( ((, ))              ~-__>--<_~-_  ~--____---~' _/'/        /'                                          */
+/*     `~/  )` ) ,/|                 ~-_~>--<_/-__       __-~ _/                                                     */
+/*   ._-~//( )/ )) `                    ~~-'_/_/ /~~~~~~~__--~                                                       */
+/*    ;'( ')/ ,)(                              ~~~~~~~~~~                                                            */
+/*   ' ') '( (/                                                                                                      */
+/*     '   '  `                                                                                                      */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <prof.h>
+#include <glad/glad.h>
+#include "opengl.h"
+#include "shader_util.h"
+#include "scene.h"
+#include "hemicube.h"
+#include "radiosity.h"
+#include "gpu_timer.h"
+#include "headless.h"
+
+/* Maximum number of values per benchmark matrix axis */
+#define BENCH_MAX_AXIS 16
+/* Gi passes between driver memory samples */
+#define BENCH_MEM_SAMPLE_INTERVAL 16
+
+#ifndef GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX
+#define GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX 0x9049
+#endif
+#ifndef GL_TEXTURE_FREE_MEMORY_ATI
+#define GL_TEXTURE_FREE_MEMORY_ATI 0x87FC
+#endif
+
+struct bench_scene {
+    char name[256];
+    unsigned int subdiv_levels;
+    unsigned int instances;
+    /* OBJ or binary PLY scene instead of the cornell box, points into name */
+    const char* mesh_file;
+};
+
+struct bench_params {
+    /* Matrix axes */
+    unsigned int lm_res[BENCH_MAX_AXIS];
+    unsigned int num_lm_res;
+    unsigned int hc_res[BENCH_MAX_AXIS];
+    unsigned int num_hc_res;
+    struct bench_scene scenes[BENCH_MAX_AXIS];
+    unsigned int num_scenes;
+    /* Shooter budget of every run */
+    long max_iterations;
+    /* Wall clock budget of every run in seconds, zero for unlimited */
+    float max_seconds;
+    /* Residual where the solver stops */
+    float threshold;
+    /* Residual whose time to reach is reported */
+    float target_residual;
+    /* Solver configuration shared by all runs */
+    int batch_size;
+    int layered;
+    int raycast;
+    int accum_format;
+    /* GL error reporting, to weigh its cost against the solver */
+    int gl_debug;
+    /* Linked program binaries are kept here across runs, none when empty */
+    const char* shader_cache_dir;
+    /* Output results file */
+    const char* out_file;
+    /* Directory that contains the res folder */
+    const char* root_dir;
+};
+
+struct bench_result {
+    unsigned int num_triangles;
+    /* Shooters actually selected, the budget counts full batches */
+    long shooters;
+    /* Shooters per gi pass, fewer than requested when the hemicube atlas cannot fit them */
+    int batch_size;
+    /* Solver setup including shader builds */
+    float init_seconds;
+    float seconds;
+    float residual;
+    /* Seconds until the residual dropped below target, negative if never */
+    float time_to_target;
+    /* Driver reported peak, negative when the driver cannot tell */
+    long long peak_gpu_memory;
+    size_t solver_gpu_memory;
+};
+
+static void usage(const char* prog)
+{
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  -L <list>        Lightmap resolutions (default: 64,128,256)\n"
+        "  -H <list>        Hemicube resolutions (default: %d)\n"
+        "  -S <list>        Scenes, cornell, subdiv:<levels>, instanced:<count> or file:<obj|ply> (default: cornell,subdiv:1,instanced:4)\n"
+        "  -n <iterations>  Shooter budget per run (default: 1000)\n"
+        "  -t <seconds>     Wall clock budget per run, 0 for unlimited (default: 0)\n"
+        "  -e <fraction>    Residual where the solver stops (default: %g)\n"
+        "  -R <fraction>    Residual whose time to reach is reported (default: 0.5)\n"
+        "  -k <shooters>    Shooters batched per gi pass, up to %d (default: 1)\n"
+        "  -l <0|1>         Render all hemicube faces in a single draw (default: 1)\n"
+        "  -v <hemicube|raycast>  Visibility (default: hemicube)\n"
+        "  -g <off|async|sync|check>  GL error reporting, ignored in release builds (default: async)\n"
+        "  -a <rgba16f|r11g11b10f|rgba32f>  Accumulation format (default: rgba16f)\n"
+        "  -P <dir>         Program binary cache, empty to disable (default: shadercache)\n"
+        "  -o <file>        Results in JSON format (default: bench.json)\n"
+        "  -C <dir>         Change to directory before loading resources\n",
+        prog, HEMICUBE_SRES, RADIOSITY_DEFAULT_THRESHOLD, RADIOSITY_MAX_BATCH);
+}
+
+static int parse_uint_list(unsigned int* out, unsigned int* count, const char* v)
+{
+    *count = 0;
+    while (*v) {
+        char* end;
+        unsigned long x = strtoul(v, &end, 10);
+        if (end == v || x == 0 || *count == BENCH_MAX_AXIS)
+            return 0;
+        out[(*count)++] = x;
+        v = *end == ',' ? end + 1 : end;
+        if (*end && *end != ',')
+            return 0;
+    }
+    return *count > 0;
+}
+
+static int parse_scene(struct bench_scene* s, const char* v, size_t len)
+{
+    memset(s, 0, sizeof(*s));
+    if (len == 0 || len >= sizeof(s->name))
+        return 0;
+    memcpy(s->name, v, len);
+    s->instances = 1;
+    if (strcmp(s->name, "cornell") == 0)
+        return 1;
+    if (strncmp(s->name, "subdiv:", 7) == 0)
+        return (s->subdiv_levels = strtoul(s->name + 7, 0, 10)) > 0;
+    if (strncmp(s->name, "instanced:", 10) == 0)
+        return (s->instances = strtoul(s->name + 10, 0, 10)) > 0;
+    if (strncmp(s->name, "file:", 5) == 0)
+        return *(s->mesh_file = s->name + 5) != '\0';
+    return 0;
+}
+
+static int parse_scene_list(struct bench_params* bp, const char* v)
+{
+    bp->num_scenes = 0;
+    while (*v) {
+        const char* end = strchr(v, ',');
+        size_t len = end ? (size_t)(end - v) : strlen(v);
+        if (bp->num_scenes == BENCH_MAX_AXIS || !parse_scene(&bp->scenes[bp->num_scenes++], v, len))
+            return 0;
+        v += len + (end ? 1 : 0);
+    }
+    return bp->num_scenes > 0;
+}
+
+/* Index of v among the two accepted values, -1 when it is neither */
+static int parse_choice(const char* v, const char* v0, const char* v1)
+{
+    return !strcmp(v, v0) ? 0 : (!strcmp(v, v1) ? 1 : -1);
+}
+
+static int parse_args(struct bench_params* bp, int argc, char* argv[])
+{
+    for (int i = 1; i < argc; ++i) {
+        const char* a = argv[i];
+        const char* v = i + 1 < argc ? argv[i + 1] : 0;
+        if (a[0] != '-' || a[1] == '\0' || a[2] != '\0' || !v)
+            return 0;
+        switch (a[1]) {
+            case 'L': if (!parse_uint_list(bp->lm_res, &bp->num_lm_res, v)) return 0; break;
+            case 'H': if (!parse_uint_list(bp->hc_res, &bp->num_hc_res, v)) return 0; break;
+            case 'S': if (!parse_scene_list(bp, v)) return 0; break;
+            case 'n': bp->max_iterations  = strtol(v, 0, 10); break;
+            case 't': bp->max_seconds     = strtof(v, 0);     break;
+            case 'e': bp->threshold       = strtof(v, 0);     break;
+            case 'R': bp->target_residual = strtof(v, 0);     break;
+            case 'k': bp->batch_size      = strtol(v, 0, 10); break;
+            case 'l': bp->layered         = strtol(v, 0, 10); break;
+            case 'v': if ((bp->raycast = parse_choice(v, "hemicube", "raycast")) < 0) return 0; break;
+            case 'g': if ((bp->gl_debug = opengl_debug_mode_from_name(v)) < 0) return 0; break;
+            case 'a': if ((bp->accum_format = radiosity_accum_format_from_name(v)) < 0) return 0; break;
+            case 'P': bp->shader_cache_dir = v;               break;
+            case 'o': bp->out_file        = v;                break;
+            case 'C': bp->root_dir        = v;                break;
+            default: return 0;
+        }
+        ++i;
+    }
+    return 1;
+}
+
+static void opengl_err_cb(void* ud, const char* msg)
+{
+    (void) ud;
+    fprintf(stderr, "%s\n", msg);
+    exit(EXIT_FAILURE);
+}
+
+static int has_extension(const char* name)
+{
+    GLint num_exts = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &num_exts);
+    for (GLint i = 0; i < num_exts; ++i)
+        if (strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), name) == 0)
+            return 1;
+    return 0;
+}
+
+/* Free video memory in KiB as reported by the driver, negative when unsupported */
+static long long free_gpu_memory()
+{
+    static int query = -1;
+    if (query < 0)
+        query = has_extension("GL_NVX_gpu_memory_info") ? 1 : (has_extension("GL_ATI_meminfo") ? 2 : 0);
+    GLint v[4] = {0};
+    switch (query) {
+        case 1:
+            glGetIntegerv(GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX, v);
+            return v[0];
+        case 2:
+            glGetIntegerv(GL_TEXTURE_FREE_MEMORY_ATI, v);
+            return v[0];
+        default:
+            return -1;
+    }
+}
+
+static int bench_run(struct bench_params* bp, const struct bench_scene* sc, unsigned int lm_res, unsigned int hc_res, struct bench_result* r)
+{
+    memset(r, 0, sizeof(*r));
+    r->time_to_target = -1.0f;
+    glFinish();
+    long long free_start = free_gpu_memory(), free_min = free_start;
+
+    /* Scene and solver */
+    struct scene_mesh mesh;
+    if (sc->mesh_file) {
+        if (!scene_mesh_load_file(&mesh, sc->mesh_file, lm_res, lm_res, 0))
+            return 0;
+    } else {
+        scene_cornell_box_load_variant(&mesh, lm_res, lm_res, sc->subdiv_levels, sc->instances);
+    }
+    r->num_triangles = mesh.num_indices / 3;
+    unsigned long t_init = millisecs();
+    radiosity_init(lm_res, lm_res);
+    radiosity_set_threshold(bp->threshold);
+    radiosity_set_batch_size(bp->batch_size);
+    radiosity_set_layered(bp->layered);
+    if (!radiosity_set_hemicube_resolution(hc_res)) {
+        /* Would run at the previous resolution but be recorded under this one */
+        radiosity_destroy();
+        scene_mesh_free(&mesh);
+        return 0;
+    }
+    r->batch_size = radiosity_batch_size();
+    radiosity_set_accum_format(bp->accum_format);
+    radiosity_set_lightmap_area(mesh.lm_area);
+    struct radiosity_light light;
+    scene_cornell_box_light(&light);
+    radiosity_set_lights(&light, 1);
+    if (bp->raycast) {
+        struct scene_geometry geom;
+        scene_mesh_read_geometry(&mesh, &geom);
+        radiosity_set_scene(geom.positions, geom.num_vertices, geom.indices, geom.num_indices);
+        radiosity_set_visibility_mode(RADIOSITY_VIS_RAYCAST);
+        scene_geometry_free(&geom);
+    }
+
+    /* Everything from the attribute pass on counts towards the bake time */
+    glFinish();
+    r->init_seconds = (millisecs() - t_init) / 1000.0f;
+    long batch = radiosity_batch_size();
+    unsigned long t_start = millisecs();
+    radiosity_attrib_pass {
+        scene_mesh_draw(&mesh);
+    }
+    long i = 0;
+    while (i < bp->max_iterations && !radiosity_converged()) {
+        radiosity_gi_pass {
+            scene_mesh_draw_visibility(&mesh);
+        }
+        i += batch;
+        unsigned long now = millisecs();
+        if (r->time_to_target < 0.0f && radiosity_residual() <= bp->target_residual)
+            r->time_to_target = (now - t_start) / 1000.0f;
+        if (free_start >= 0 && (i / batch) % BENCH_MEM_SAMPLE_INTERVAL == 0) {
+            long long f = free_gpu_memory();
+            free_min = f < free_min ? f : free_min;
+        }
+        if (bp->max_seconds > 0.0f && (now - t_start) / 1000.0f >= bp->max_seconds)
+            break;
+    }
+    glFinish();
+    r->seconds = (millisecs() - t_start) / 1000.0f;
+    r->shooters = radiosity_iterations();
+    r->residual = radiosity_residual();
+    if (r->time_to_target < 0.0f && r->residual <= bp->target_residual)
+        r->time_to_target = r->seconds;
+    if (free_start >= 0) {
+        long long f = free_gpu_memory();
+        free_min = f < free_min ? f : free_min;
+        r->peak_gpu_memory = (free_start - free_min) * 1024;
+    } else {
+        r->peak_gpu_memory = -1;
+    }
+    r->solver_gpu_memory = radiosity_gpu_memory();
+
+    /* Gpu timer stages outlive the solver, until the run is written */
+    radiosity_destroy();
+    scene_mesh_free(&mesh);
+    return 1;
+}
+
+/* Quoted JSON string, scene names carry user given file paths */
+static void write_json_string(FILE* f, const char* s)
+{
+    fputc('"', f);
+    for (; *s; ++s) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\')
+            fprintf(f, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(f, "\\u%04x", c);
+        else
+            fputc(c, f);
+    }
+    fputc('"', f);
+}
+
+static void write_run(FILE* f, struct bench_params* bp, const struct bench_scene* sc, unsigned int lm_res, unsigned int hc_res, const struct bench_result* r)
+{
+    fprintf(f, "    {\n");
+    fprintf(f, "      \"scene\": ");
+    write_json_string(f, sc->name);
+    fprintf(f, ",\n");
+    fprintf(f, "      \"triangles\": %u,\n", r->num_triangles);
+    fprintf(f, "      \"lightmap_resolution\": %u,\n", lm_res);
+    fprintf(f, "      \"hemicube_resolution\": %u,\n", hc_res);
+    fprintf(f, "      \"batch_size\": %d,\n", r->batch_size);
+    fprintf(f, "      \"visibility\": \"%s\",\n", bp->raycast ? "raycast" : "hemicube");
+    fprintf(f, "      \"accumulation_format\": \"%s\",\n", radiosity_accum_format_name(bp->accum_format));
+    fprintf(f, "      \"init_seconds\": %.6f,\n", r->init_seconds);
+    fprintf(f, "      \"shooters\": %ld,\n", r->shooters);
+    fprintf(f, "      \"seconds\": %.6f,\n", r->seconds);
+    fprintf(f, "      \"shooters_per_second\": %.3f,\n", r->seconds > 0.0f ? r->shooters / r->seconds : 0.0f);
+    fprintf(f, "      \"residual\": %.6f,\n", r->residual);
+    if (r->time_to_target >= 0.0f)
+        fprintf(f, "      \"time_to_target\": %.6f,\n", r->time_to_target);
+    else
+        fprintf(f, "      \"time_to_target\": null,\n");
+    if (r->peak_gpu_memory >= 0)
+        fprintf(f, "      \"peak_gpu_memory\": %lld,\n", r->peak_gpu_memory);
+    else
+        fprintf(f, "      \"peak_gpu_memory\": null,\n");
+    fprintf(f, "      \"solver_gpu_memory\": %zu,\n", r->solver_gpu_memory);
+    fprintf(f, "      \"stages\": [");
+    for (int s = 0; s < gpu_timer_num_stages(); ++s) {
+        struct gpu_timer_stats ts;
+        gpu_timer_stats(s, &ts);
+        fprintf(f, "%s\n        { \"stage\": \"%s\", \"samples\": %lu, \"min_ms\": %.6f, \"avg_ms\": %.6f, \"max_ms\": %.6f, \"total_ms\": %.6f }",
+                s ? "," : "", ts.name, ts.samples, ts.min_ms, ts.avg_ms, ts.max_ms, ts.total_ms);
+    }
+    fprintf(f, "\n      ]\n    }");
+}
+
+int main(int argc, char* argv[])
+{
+    /* Default matrix is small enough to run on a software rasterizer */
+    struct bench_params bp = {
+        .lm_res          = { 64, 128, 256 },
+        .num_lm_res      = 3,
+        .hc_res          = { HEMICUBE_SRES },
+        .num_hc_res      = 1,
+        .max_iterations  = 1000,
+        .max_seconds     = 0.0f,
+        .threshold       = RADIOSITY_DEFAULT_THRESHOLD,
+        .target_residual = 0.5f,
+        .batch_size      = 1,
+        .layered         = 1,
+        .raycast         = 0,
+        .accum_format    = RADIOSITY_ACCUM_RGBA16F,
+        .gl_debug        = OPENGL_DEBUG_ASYNC,
+        .shader_cache_dir = "shadercache",
+        .out_file        = "bench.json",
+        .root_dir        = 0
+    };
+    parse_scene_list(&bp, "cornell,subdiv:1,instanced:4");
+    if (!parse_args(&bp, argc, argv)) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (bp.root_dir && chdir(bp.root_dir) != 0) {
+        fprintf(stderr, "Could not change directory to %s\n", bp.root_dir);
+        return EXIT_FAILURE;
+    }
+    FILE* f = fopen(bp.out_file, "w");
+    if (!f) {
+        fprintf(stderr, "Could not write %s\n", bp.out_file);
+        return EXIT_FAILURE;
+    }
+
+    /* Initialize offscreen context */
+    struct headless_ctx hc;
+    if (!headless_ctx_create(&hc, 4, 3)) {
+        fprintf(stderr, "Could not create headless OpenGL 4.3 context\n");
+        fclose(f);
+        return EXIT_FAILURE;
+    }
+    gladLoadGLLoader((GLADloadproc) headless_ctx_proc_address);
+    opengl_register_error_handler(opengl_err_cb, 0);
+    opengl_set_debug_mode(bp.gl_debug);
+    printf("Renderer: %s, GL errors: %s\n", glGetString(GL_RENDERER), opengl_debug_mode_name(opengl_debug_mode()));
+    shader_cache_init(bp.shader_cache_dir);
+
+    fprintf(f, "{\n");
+    fprintf(f, "  \"renderer\": ");
+    write_json_string(f, (const char*)glGetString(GL_RENDERER));
+    fprintf(f, ",\n  \"version\": ");
+    write_json_string(f, (const char*)glGetString(GL_VERSION));
+    fprintf(f, ",\n");
+    fprintf(f, "  \"gl_debug\": \"%s\",\n", opengl_debug_mode_name(opengl_debug_mode()));
+    fprintf(f, "  \"max_iterations\": %ld,\n", bp.max_iterations);
+    fprintf(f, "  \"max_seconds\": %.3f,\n", bp.max_seconds);
+    fprintf(f, "  \"target_residual\": %.6f,\n", bp.target_residual);
+    fprintf(f, "  \"runs\": [");
+
+    /* Every combination of the matrix axes, solver state and timers start fresh for each */
+    int first = 1;
+    for (unsigned int s = 0; s < bp.num_scenes; ++s) {
+        for (unsigned int l = 0; l < bp.num_lm_res; ++l) {
+            for (unsigned int h = 0; h < bp.num_hc_res; ++h) {
+                const struct bench_scene* sc = &bp.scenes[s];
+                struct bench_result r;
+                if (!bench_run(&bp, sc, bp.lm_res[l], bp.hc_res[h], &r)) {
+                    fprintf(stderr, "Skipping %s lm %u hc %u\n", sc->name, bp.lm_res[l], bp.hc_res[h]);
+                    gpu_timer_destroy();
+                    continue;
+                }
+                printf("%-14s lm %4u hc %4u: %6u tris, %ld shooters in %.2fs (%.1f shooters/s), residual %.4f\n",
+                       sc->name, bp.lm_res[l], bp.hc_res[h], r.num_triangles, r.shooters, r.seconds,
+                       r.seconds > 0.0f ? r.shooters / r.seconds : 0.0f, r.residual);
+                fprintf(f, "%s\n", first ? "" : ",");
+                write_run(f, &bp, sc, bp.lm_res[l], bp.hc_res[h], &r);
+                first = 0;
+                gpu_timer_destroy();
+            }
+        }
+    }
+    fprintf(f, "\n  ]\n}\n");
+    int ok = fclose(f) == 0;
+    if (ok)
+        printf("Wrote %s\n", bp.out_file);
+    else
+        fprintf(stderr, "Could not write %s\n", bp.out_file);
+
+    headless_ctx_destroy(&hc);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
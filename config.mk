@@ -6,3 +6,6 @@ else
 	LIBS += GL GLU X11 Xrandr Xinerama Xcursor pthread dl
 endif
 EXTDEPS = gfxwnd::0.0.1dev macu::0.0.2dev
+ifneq ($(VARIANT), Debug)
+	DEFINES += OPENGL_NO_DEBUG
+endif
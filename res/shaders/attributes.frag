@@ -1,4 +1,4 @@
-#version 330 core
+#version 430 core
 layout (location = 0) out vec4 position;
 layout (location = 1) out vec3 normal;
 layout (location = 2) out vec3 albedo;
@@ -11,25 +11,109 @@ in GS_OUT {
     vec3 nrm;
     vec3 col;
     vec2 luv;
+    vec3 ems;
     // Geometry shader outputs
     vec2 ndc_pos;
     vec4 ndc_aabb;
 };
 
-vec3 radiance(vec3 N, vec3 ws_pos, vec3 light_pos)
+// Must match enum radiosity_light_type in radiosity.h
+#define LIGHT_POINT 0
+#define LIGHT_SPOT 1
+#define LIGHT_AREA 2
+
+// Must match struct radiosity_light in radiosity.h
+struct light {
+    vec3 position;
+    int type;
+    vec3 direction;
+    float range;
+    vec3 color;
+    float intensity;
+    vec3 corner1;
+    float cos_inner;
+    vec3 corner2;
+    float cos_outer;
+};
+
+// Must match struct light_grid_header in light_grid.h, followed by the light list
+layout(std430, binding = 4) readonly buffer light_buf {
+    vec3 grid_min;
+    uint num_lights;
+    vec3 grid_inv_cell_size;
+    uint padding0;
+    ivec3 grid_dims;
+    uint padding1;
+    light lights[];
+};
+
+// First index and count per cell, followed by the light indices
+layout(std430, binding = 5) readonly buffer light_grid_buf {
+    uint light_grid[];
+};
+
+// Irradiance of a uniformly emitting triangle, see Lambert's formula for polygonal sources
+float area_irradiance(vec3 N, vec3 ws_pos, light l)
 {
-    vec3 light_dir = normalize(light_pos - ws_pos);
-    vec3 light_col = vec3(1.0, 1.0, 1.0);
+    vec3 e_nrm = cross(l.corner1 - l.position, l.corner2 - l.position);
+    if (dot(ws_pos - l.position, e_nrm) <= 0.0)
+        return 0.0;
+    vec3 v[3] = vec3[3](
+        normalize(l.position - ws_pos),
+        normalize(l.corner1 - ws_pos),
+        normalize(l.corner2 - ws_pos));
+    float sum = 0.0;
+    for (int i = 0; i < 3; ++i) {
+        vec3 a = v[i], b = v[(i + 1) % 3];
+        vec3 g = cross(b, a);
+        float len = length(g);
+        if (len > 0.0)
+            sum += acos(clamp(dot(a, b), -1.0, 1.0)) * dot(g / len, N);
+    }
+    // Parts below the receiver horizon are not clipped
+    return max(0.5 * sum, 0.0);
+}
 
-    float dist = length(light_pos - ws_pos);
-    float light_intensity = 30000;
+vec3 radiance(vec3 N, vec3 ws_pos, light l)
+{
+    if (l.type == LIGHT_AREA) {
+        vec3 center = (l.position + l.corner1 + l.corner2) / 3.0;
+        if (length(center - ws_pos) > l.range)
+            return vec3(0.0);
+        return area_irradiance(N, ws_pos, l) * l.color * l.intensity;
+    }
+
+    vec3 light_dir = normalize(l.position - ws_pos);
+    vec3 light_col = l.color;
+
+    float dist = length(l.position - ws_pos);
+    if (dist > l.range)
+        return vec3(0.0);
+    float light_intensity = l.intensity;
     float attenuation = 1.0 / (dist * dist);
+    if (l.type == LIGHT_SPOT)
+        attenuation *= smoothstep(l.cos_outer, l.cos_inner, dot(-light_dir, normalize(l.direction)));
 
     float kD = max(dot(N, light_dir), 0.0);
     vec3 Lo = kD * attenuation * light_col * light_intensity;
     return Lo;
 }
 
+// Sum over the lights whose influence reaches the grid cell of the receiver
+vec3 direct_light(vec3 N, vec3 ws_pos)
+{
+    if (num_lights == 0u)
+        return vec3(0.0);
+    // Receivers outside the grid are out of range of every light, the border cells test them anyway
+    ivec3 c = clamp(ivec3(floor((ws_pos - grid_min) * grid_inv_cell_size)), ivec3(0), grid_dims - 1);
+    uint cell = uint((c.z * grid_dims.y + c.y) * grid_dims.x + c.x);
+    uint first = light_grid[2u * cell], count = light_grid[2u * cell + 1u];
+    vec3 Lo = vec3(0.0);
+    for (uint i = 0u; i < count; ++i)
+        Lo += radiance(N, ws_pos, lights[light_grid[first + i]]);
+    return Lo;
+}
+
 void main()
 {
     // Discard pixels, which are not inside the AABB.
@@ -41,9 +125,8 @@ void main()
     normal = normalize(nrm);
     albedo = col;
 
-    // Add direct light into unshot values
-    vec3 light_pos = vec3(278, 450, 279.5);
-    vec3 Lo = radiance(normal, position.rgb, light_pos);
+    // Add direct light and emission into unshot values
+    vec3 Lo = direct_light(normal, position.rgb);
     radiosity = vec3(0.0);
-    unshot = Lo * albedo;
+    unshot = Lo * albedo + ems;
 }
@@ -3,12 +3,14 @@ layout (location = 0) in vec3 position;
 layout (location = 1) in vec3 normal;
 layout (location = 2) in vec3 color;
 layout (location = 3) in vec2 lm_uv;
+layout (location = 4) in vec3 emission;
 
 out VS_OUT {
     vec3 pos;
     vec3 nrm;
     vec3 col;
     vec2 luv;
+    vec3 ems;
 };
 
 uniform mat4 model;
@@ -19,5 +21,6 @@ void main()
     nrm = normal;
     col = color;
     luv = lm_uv;
+    ems = emission;
     gl_Position = vec4(luv * 2.0 - 1.0, 0.0, 1.0);
 }
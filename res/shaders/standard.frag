@@ -1,4 +1,4 @@
-#version 330 core
+#version 430 core
 out vec4 frag_color;
 
 in VS_OUT {
@@ -6,21 +6,93 @@ in VS_OUT {
     vec3 normal;
     vec3 color;
     vec2 lmuv;
+    vec3 emission;
 } fs_in;
 
-uniform vec3 view_pos;
-uniform vec3 light_pos;
+// Must match struct view_params in game.c, uploaded once per view
+layout(std140) uniform view_params {
+    mat4 proj;
+    mat4 view;
+    vec3 view_pos;
+};
+
 uniform int mode;
 uniform sampler2D lightmap;
 
-vec3 radiance(vec3 N, vec3 ws_pos, vec3 albedo)
+// Must match enum radiosity_light_type in radiosity.h
+#define LIGHT_POINT 0
+#define LIGHT_SPOT 1
+#define LIGHT_AREA 2
+
+// Must match struct radiosity_light in radiosity.h
+struct light {
+    vec3 position;
+    int type;
+    vec3 direction;
+    float range;
+    vec3 color;
+    float intensity;
+    vec3 corner1;
+    float cos_inner;
+    vec3 corner2;
+    float cos_outer;
+};
+
+// Must match light_buf in attributes.frag
+layout(std430, binding = 4) readonly buffer light_buf {
+    vec3 grid_min;
+    uint num_lights;
+    vec3 grid_inv_cell_size;
+    uint padding0;
+    ivec3 grid_dims;
+    uint padding1;
+    light lights[];
+};
+
+layout(std430, binding = 5) readonly buffer light_grid_buf {
+    uint light_grid[];
+};
+
+// Must match area_irradiance in attributes.frag
+float area_irradiance(vec3 N, vec3 ws_pos, light l)
+{
+    vec3 e_nrm = cross(l.corner1 - l.position, l.corner2 - l.position);
+    if (dot(ws_pos - l.position, e_nrm) <= 0.0)
+        return 0.0;
+    vec3 v[3] = vec3[3](
+        normalize(l.position - ws_pos),
+        normalize(l.corner1 - ws_pos),
+        normalize(l.corner2 - ws_pos));
+    float sum = 0.0;
+    for (int i = 0; i < 3; ++i) {
+        vec3 a = v[i], b = v[(i + 1) % 3];
+        vec3 g = cross(b, a);
+        float len = length(g);
+        if (len > 0.0)
+            sum += acos(clamp(dot(a, b), -1.0, 1.0)) * dot(g / len, N);
+    }
+    return max(0.5 * sum, 0.0);
+}
+
+vec3 radiance(vec3 N, vec3 ws_pos, vec3 albedo, light l)
 {
-    vec3 light_dir = normalize(light_pos - ws_pos);
-    vec3 light_col = vec3(1.0, 1.0, 1.0);
+    if (l.type == LIGHT_AREA) {
+        vec3 center = (l.position + l.corner1 + l.corner2) / 3.0;
+        if (length(center - ws_pos) > l.range)
+            return vec3(0.0);
+        return area_irradiance(N, ws_pos, l) * l.color * l.intensity * albedo;
+    }
+
+    vec3 light_dir = normalize(l.position - ws_pos);
+    vec3 light_col = l.color;
 
-    float dist = length(light_pos - ws_pos);
-    float light_intensity = 30000;
+    float dist = length(l.position - ws_pos);
+    if (dist > l.range)
+        return vec3(0.0);
+    float light_intensity = l.intensity;
     float attenuation = 1.0 / (dist * dist);
+    if (l.type == LIGHT_SPOT)
+        attenuation *= smoothstep(l.cos_outer, l.cos_inner, dot(-light_dir, normalize(l.direction)));
 
     vec3 V = normalize(view_pos - ws_pos);
     vec3 R = reflect(-light_dir, N);
@@ -32,6 +104,20 @@ vec3 radiance(vec3 N, vec3 ws_pos, vec3 albedo)
     return Lo;
 }
 
+// Same grid walk as direct_light in attributes.frag
+vec3 direct_light(vec3 N, vec3 ws_pos, vec3 albedo)
+{
+    if (num_lights == 0u)
+        return vec3(0.0);
+    ivec3 c = clamp(ivec3(floor((ws_pos - grid_min) * grid_inv_cell_size)), ivec3(0), grid_dims - 1);
+    uint cell = uint((c.z * grid_dims.y + c.y) * grid_dims.x + c.x);
+    uint first = light_grid[2u * cell], count = light_grid[2u * cell + 1u];
+    vec3 Lo = vec3(0.0);
+    for (uint i = 0u; i < count; ++i)
+        Lo += radiance(N, ws_pos, albedo, lights[light_grid[first + i]]);
+    return Lo;
+}
+
 vec3 postprocess(vec3 color)
 {
     // HDR tonemapping
@@ -48,7 +134,7 @@ float rand(vec2 co)
 
 vec3 lmuv_dbg(vec2 lmuv)
 {
-    vec2 sz = vec2(128.0); // Virtual texture size
+    vec2 sz = vec2(textureSize(lightmap, 0)); // Virtual texture size
     vec2 st = fs_in.lmuv;
     float r = rand(vec2(floor(st.x * sz.x), floor(st.y * sz.y)));
     return vec3(r);
@@ -57,7 +143,7 @@ vec3 lmuv_dbg(vec2 lmuv)
 void main()
 {
     vec3 N = normalize((fs_in.normal));
-    vec3 Lo = radiance(N, fs_in.ws_pos, fs_in.color);
+    vec3 Lo = direct_light(N, fs_in.ws_pos, fs_in.color) + fs_in.emission;
     // Final color
     vec3 color = Lo;
 #ifdef POSTPROCESSING
@@ -3,17 +3,24 @@ layout (location = 0) in vec3 position;
 layout (location = 1) in vec3 normal;
 layout (location = 2) in vec3 color;
 layout (location = 3) in vec2 lm_uv;
+layout (location = 4) in vec3 emission;
 
 out VS_OUT {
     vec3 ws_pos;
     vec3 normal;
     vec3 color;
     vec2 lmuv;
+    vec3 emission;
 } vs_out;
 
+// Must match struct view_params in game.c, uploaded once per view
+layout(std140) uniform view_params {
+    mat4 proj;
+    mat4 view;
+    vec3 view_pos;
+};
+
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 proj;
 uniform bool lm_mode;
 
 void main()
@@ -22,6 +29,7 @@ void main()
     vs_out.normal = normal;
     vs_out.color = color;
     vs_out.lmuv = lm_uv;
+    vs_out.emission = emission;
     if (!lm_mode)
         gl_Position = proj * view * model * vec4(position, 1.0);
     else
@@ -1,14 +1,20 @@
-#version 330 core
+#version 430 core
 layout (location = 0) in vec3 position;
 layout (location = 3) in vec2 lm_uv;
 out vec2 uv;
 
+// Must match RADIOSITY_MAX_BATCH
+#define MAX_SHOOTERS 8
+
+layout(std430, binding = 1) buffer view_proj_buf {
+    mat4 view_proj[5 * MAX_SHOOTERS];
+};
+
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 proj;
+uniform int face_index;
 
 void main()
 {
     uv = lm_uv;
-    gl_Position = proj * view * model * vec4(position, 1.0);
+    gl_Position = view_proj[face_index] * model * vec4(position, 1.0);
 }
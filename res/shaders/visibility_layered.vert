@@ -0,0 +1,12 @@
+#version 430 core
+layout (location = 0) in vec3 position;
+layout (location = 3) in vec2 lm_uv;
+out vec2 vs_uv;
+
+uniform mat4 model;
+
+void main()
+{
+    vs_uv = lm_uv;
+    gl_Position = model * vec4(position, 1.0);
+}
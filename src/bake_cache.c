@@ -0,0 +1,203 @@
+#include "bake_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+#include "radiosity.h"
+
+#define BAKE_CACHE_MAGIC "TRBC"
+#define BAKE_CACHE_VERSION 2
+#define BAKE_CACHE_FILE "trad.bakecache"
+
+/* Every shader that takes part in producing the baked textures */
+static const char* solver_sources[] = {
+    "res/shaders/attributes.vert",
+    "res/shaders/attributes.geom",
+    "res/shaders/attributes.frag",
+    "res/shaders/texel_list.comp",
+    "res/shaders/max.comp",
+    "res/shaders/view_proj.comp",
+    "res/shaders/visibility.vert",
+    "res/shaders/visibility_layered.vert",
+    "res/shaders/visibility.geom",
+    "res/shaders/visibility.frag",
+    "res/shaders/radiosity.comp"
+};
+
+struct bake_cache_header {
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint32_t width, height;
+    uint32_t num_uvs;
+    float initial_energy;
+    int32_t accum_format;
+    uint32_t padding0;
+};
+
+unsigned long long bake_cache_hash(unsigned long long h, const void* data, size_t sz)
+{
+    const unsigned char* p = data;
+    for (size_t i = 0; i < sz; ++i) {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+unsigned long long bake_cache_hash_file(unsigned long long h, const char* fpath)
+{
+    FILE* f = fopen(fpath, "rb");
+    if (!f)
+        return h;
+    unsigned char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        h = bake_cache_hash(h, buf, n);
+    fclose(f);
+    return h;
+}
+
+unsigned long long bake_cache_key(unsigned long long scene_hash, const struct bake_cache_params* p)
+{
+    unsigned long long h = scene_hash;
+    h = bake_cache_hash(h, &p->lm_width,   sizeof(p->lm_width));
+    h = bake_cache_hash(h, &p->lm_height,  sizeof(p->lm_height));
+    h = bake_cache_hash(h, &p->lm_padding, sizeof(p->lm_padding));
+    h = bake_cache_hash(h, &p->hemicube_res, sizeof(p->hemicube_res));
+    h = bake_cache_hash(h, &p->batch_size, sizeof(p->batch_size));
+    h = bake_cache_hash(h, &p->vis_mode,   sizeof(p->vis_mode));
+    h = bake_cache_hash(h, &p->accum_format, sizeof(p->accum_format));
+    for (size_t i = 0; i < sizeof(solver_sources) / sizeof(solver_sources[0]); ++i)
+        h = bake_cache_hash_file(h, solver_sources[i]);
+    return h;
+}
+
+void bake_cache_default_path(char* buf, size_t buf_sz)
+{
+    size_t len = 0;
+#ifdef _WIN32
+    len = GetModuleFileNameA(0, buf, buf_sz);
+#elif defined(__linux__)
+    ssize_t r = readlink("/proc/self/exe", buf, buf_sz - 1);
+    len = r > 0 ? (size_t)r : 0;
+#endif
+    /* Strip executable name, falling back to the working directory */
+    while (len > 0 && buf[len - 1] != '/' && buf[len - 1] != '\\')
+        --len;
+    if (len + sizeof(BAKE_CACHE_FILE) > buf_sz)
+        len = 0;
+    memcpy(buf + len, BAKE_CACHE_FILE, sizeof(BAKE_CACHE_FILE));
+}
+
+int bake_cache_load(struct bake_cache* bc, const char* fpath, unsigned long long key)
+{
+    memset(bc, 0, sizeof(*bc));
+    FILE* f = fopen(fpath, "rb");
+    if (!f)
+        return 0;
+
+    struct bake_cache_header hdr;
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1
+     || memcmp(hdr.magic, BAKE_CACHE_MAGIC, 4) != 0
+     || hdr.version != BAKE_CACHE_VERSION
+     || hdr.key != key
+     || radiosity_accum_texel_size(hdr.accum_format) == 0) {
+        fclose(f);
+        return 0;
+    }
+
+    size_t num_texels = (size_t)hdr.width * hdr.height;
+    size_t texel_sz = radiosity_accum_texel_size(hdr.accum_format);
+    bc->key = hdr.key;
+    bc->width = hdr.width;
+    bc->height = hdr.height;
+    bc->num_uvs = hdr.num_uvs;
+    bc->initial_energy = hdr.initial_energy;
+    bc->accum_format = hdr.accum_format;
+    bc->lm_uvs = malloc(bc->num_uvs * 2 * sizeof(float));
+    bc->radiosity = malloc(num_texels * texel_sz);
+    bc->unshot = malloc(num_texels * texel_sz);
+    int ok = fread(bc->lm_uvs, 2 * sizeof(float), bc->num_uvs, f) == bc->num_uvs
+          && fread(bc->radiosity, texel_sz, num_texels, f) == num_texels
+          && fread(bc->unshot, texel_sz, num_texels, f) == num_texels;
+    fclose(f);
+    if (!ok)
+        bake_cache_free(bc);
+    return ok;
+}
+
+int bake_cache_save(const struct bake_cache* bc, const char* fpath)
+{
+    /* Write aside and swap in, so that a crash never leaves a truncated cache behind */
+    char tmp_path[4096];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", fpath);
+    FILE* f = fopen(tmp_path, "wb");
+    if (!f)
+        return 0;
+
+    struct bake_cache_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, BAKE_CACHE_MAGIC, 4);
+    hdr.version = BAKE_CACHE_VERSION;
+    hdr.key = bc->key;
+    hdr.width = bc->width;
+    hdr.height = bc->height;
+    hdr.num_uvs = bc->num_uvs;
+    hdr.initial_energy = bc->initial_energy;
+    hdr.accum_format = bc->accum_format;
+
+    size_t num_texels = (size_t)bc->width * bc->height;
+    size_t texel_sz = radiosity_accum_texel_size(bc->accum_format);
+    int ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1
+          && fwrite(bc->lm_uvs, 2 * sizeof(float), bc->num_uvs, f) == bc->num_uvs
+          && fwrite(bc->radiosity, texel_sz, num_texels, f) == num_texels
+          && fwrite(bc->unshot, texel_sz, num_texels, f) == num_texels;
+    ok = (fclose(f) == 0) && ok;
+    if (ok) {
+#ifdef _WIN32
+        remove(fpath);
+#endif
+        ok = rename(tmp_path, fpath) == 0;
+    }
+    if (!ok)
+        remove(tmp_path);
+    return ok;
+}
+
+void bake_cache_free(struct bake_cache* bc)
+{
+    free(bc->unshot);
+    free(bc->radiosity);
+    free(bc->lm_uvs);
+    memset(bc, 0, sizeof(*bc));
+}
+
+void bake_cache_capture(struct bake_cache* bc, unsigned long long key, struct scene_mesh* m, unsigned int width, unsigned int height)
+{
+    size_t num_texels = (size_t)width * height;
+    memset(bc, 0, sizeof(*bc));
+    bc->key = key;
+    bc->width = width;
+    bc->height = height;
+    bc->num_uvs = m->num_vertices;
+    bc->accum_format = radiosity_accum_format();
+    size_t texel_sz = radiosity_accum_texel_size(bc->accum_format);
+    bc->lm_uvs = malloc(bc->num_uvs * 2 * sizeof(float));
+    bc->radiosity = malloc(num_texels * texel_sz);
+    bc->unshot = malloc(num_texels * texel_sz);
+    scene_mesh_read_lm_uvs(m, bc->lm_uvs);
+    radiosity_store_solution(bc->accum_format, bc->radiosity, bc->unshot);
+    bc->initial_energy = radiosity_initial_energy();
+}
+
+void bake_cache_restore(const struct bake_cache* bc)
+{
+    radiosity_restore_solution(bc->accum_format, bc->radiosity, bc->unshot, bc->initial_energy);
+}
@@ -0,0 +1,80 @@
+/*********************************************************************************************************************/
+/*                                                  /===-_---~~~~~~~~~------____                                     */
+/*                                                 |===-~___                _,-'                                     */
+/*                  -==\\                         `//~\\   ~~~~`---.___.-~~                                          */
+/*              ______-==|                         | |  \\           _-~`                                            */
+/*        __--~~~  ,-/-==\\                        | |   `\        ,'                                                */
+/*     _-~       /'    |  \\                      / /      \      /                                                  */
+/*   .'        /       |   \\                   /' /        \   /'                                                   */
+/*  /  ____  /         |    \`\.__/-~~ ~ \ _ _/'  /          \/'                                                     */
+/* /-'~    ~~~~~---__  |     ~-/~         ( )   /'        _--~`                                                      */
+/*                   \_|      /        _)   ;  ),   __--~~                                                           */
+/*                     '~~--_/      _-~/-  / \   '-~ \                                                               */
+/*                    {\__--_/}    / \\_>- )<__\      \                                                              */
+/*                    /'   (_/  _-~  | |__>--<__|      |                                                             */
+/*                   |0  0 _/) )-~     | |__>--<__|     |                                                            */
+/*                   / /~ ,_/       / /__>---<__/      |                                                             */
+/*                  o o _//        /-~_>---<__-~      /                                                              */
+/*                  (^(~          /~_>---<__-      _-~                                                               */
+/*                 ,/|           /__>--<__/     _-~                                                                  */
+/*              ,//('(          |__>--<__|     /                  .----_                                             */
+/*             ( ( '))          |__>--<__|    |                 /' _---_~\                                           */
+/*          `-)) )) (           |__>--<__|    |               /'  /     ~\`\                                         */
+/*         ,/,'//( (             \__>--<__\    \            /'  //        ||                                         */
+/*       ,( ( ((, ))              ~-__>--<_~-_  ~--____---~' _/'/        /'                                          */
+/*     `~/  )` ) ,/|                 ~-_~>--<_/-__       __-~ _/                                                     */
+/*   ._-~//( )/ )) `                    ~~-'_/_/ /~~~~~~~__--~                                                       */
+/*    ;'( ')/ ,)(                              ~~~~~~~~~~                                                            */
+/*   ' ') '( (/                                                                                                      */
+/*     '   '  `                                                                                                      */
+#ifndef _BAKE_CACHE_H_
+#define _BAKE_CACHE_H_
+
+#include <stddef.h>
+#include "scene.h"
+
+/* Starting value of all the hashes below (64bit FNV-1a) */
+#define BAKE_CACHE_HASH_SEED 14695981039346656037ULL
+
+/* Baked solution that can be restored instead of solving from scratch */
+struct bake_cache {
+    unsigned long long key;
+    unsigned int width, height;
+    /* Lightmap uvs of the mesh, 2 floats per vertex */
+    unsigned int num_uvs;
+    float* lm_uvs;
+    /* Radiosity and unshot textures in the pixel transfer format of the accumulation format they were baked in */
+    int accum_format;
+    void* radiosity;
+    void* unshot;
+    float initial_energy;
+};
+
+/* Solver parameters that change the baked result */
+struct bake_cache_params {
+    unsigned int lm_width, lm_height;
+    unsigned int lm_padding;
+    unsigned int hemicube_res;
+    int batch_size;
+    int vis_mode;
+    int accum_format;
+};
+
+unsigned long long bake_cache_hash(unsigned long long h, const void* data, size_t sz);
+unsigned long long bake_cache_hash_file(unsigned long long h, const char* fpath);
+/* Combines the scene hash, the solver parameters and the solver shader sources */
+unsigned long long bake_cache_key(unsigned long long scene_hash, const struct bake_cache_params* p);
+
+/* Default cache file location, next to the running executable */
+void bake_cache_default_path(char* buf, size_t buf_sz);
+/* Fails when the file is missing, corrupt or was baked with a different key */
+int bake_cache_load(struct bake_cache* bc, const char* fpath, unsigned long long key);
+int bake_cache_save(const struct bake_cache* bc, const char* fpath);
+void bake_cache_free(struct bake_cache* bc);
+
+/* Grabs the current solution and mesh uvs from the gpu */
+void bake_cache_capture(struct bake_cache* bc, unsigned long long key, struct scene_mesh* m, unsigned int width, unsigned int height);
+/* Uploads the cached solution, must follow the attribute pass that would otherwise overwrite it */
+void bake_cache_restore(const struct bake_cache* bc);
+
+#endif /* ! _BAKE_CACHE_H_ */
@@ -0,0 +1,285 @@
+#include "baked_scene.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <glad/glad.h>
+#include "radiosity.h"
+
+#define BAKED_SCENE_MAGIC "TRBS"
+#define BAKED_SCENE_VERSION 3
+/* Section offsets are aligned so that the mapped data can be used in place */
+#define BAKED_SCENE_ALIGN 64
+#define BAKED_SCENE_NUM_SECTIONS 5
+
+/* Type 3 held the float lightmap uvs up to version 1, the packed vertices carry them now */
+enum baked_section_type {
+    BAKED_SECTION_VERTICES = 1,
+    BAKED_SECTION_INDICES,
+    BAKED_SECTION_LIGHTMAP = 4,
+    BAKED_SECTION_VIS_VERTICES,
+    BAKED_SECTION_LIGHTS
+};
+
+struct baked_scene_header {
+    char magic[4];
+    uint32_t version;
+    uint32_t num_sections;
+    float initial_energy;
+    uint64_t file_size;
+    uint64_t padding0;
+};
+
+/* Section table entry, the table follows the header */
+struct baked_scene_entry {
+    uint32_t type;
+    uint32_t format;
+    uint32_t count;
+    uint32_t stride;
+    uint32_t width, height;
+    uint64_t offset;
+    uint64_t size;
+};
+
+static struct baked_scene_section* section_of_type(struct baked_scene* bs, uint32_t type)
+{
+    switch (type) {
+        case BAKED_SECTION_VERTICES:     return &bs->vertices;
+        case BAKED_SECTION_VIS_VERTICES: return &bs->vis_vertices;
+        case BAKED_SECTION_INDICES:      return &bs->indices;
+        case BAKED_SECTION_LIGHTMAP:     return &bs->lightmap;
+        case BAKED_SECTION_LIGHTS:       return &bs->lights;
+        default:                         return 0;
+    }
+}
+
+/* One pass over the mapped indices, the mesh upload reads the vertices through them unchecked */
+static int indices_in_range(const struct baked_scene_section* i, uint32_t num_vertices)
+{
+    const uint32_t* idx = i->data;
+    for (uint32_t k = 0; k < i->count; ++k)
+        if (idx[k] >= num_vertices)
+            return 0;
+    return 1;
+}
+
+/* The solver and the viewer create textures of these dimensions and upload the section into them */
+static int lightmap_size_valid(const struct baked_scene_section* l)
+{
+    GLint max_size = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+    return l->width > 0 && l->height > 0
+        && l->width <= (unsigned int)max_size && l->height <= (unsigned int)max_size
+        && l->count == (size_t)l->width * l->height;
+}
+
+static int sections_valid(const struct baked_scene* bs)
+{
+    const struct baked_scene_section* v = &bs->vertices;
+    const struct baked_scene_section* w = &bs->vis_vertices;
+    const struct baked_scene_section* i = &bs->indices;
+    const struct baked_scene_section* l = &bs->lightmap;
+    const struct baked_scene_section* s = &bs->lights;
+    return v->data && w->data && i->data && l->data
+        && v->format == BAKED_SCENE_VERTEX_PACKED && v->stride == sizeof(struct scene_vertex)
+        && v->size == (size_t)v->count * v->stride
+        && w->format == BAKED_SCENE_VIS_VERTEX_PACKED && w->stride == sizeof(struct scene_vis_vertex)
+        && w->size == (size_t)w->count * w->stride && w->count == v->count
+        && i->format == GL_UNSIGNED_INT && i->stride == sizeof(uint32_t)
+        && i->size == (size_t)i->count * i->stride && i->count % 3 == 0 && indices_in_range(i, v->count)
+        && l->format == GL_RGBA16F && lightmap_size_valid(l)
+        && l->size == (size_t)l->count * 4 * sizeof(uint16_t)
+        && (!s->data || (s->format == BAKED_SCENE_LIGHT && s->stride == sizeof(struct radiosity_light)
+                         && s->size == (size_t)s->count * s->stride));
+}
+
+int baked_scene_load(struct baked_scene* bs, const char* fpath)
+{
+    memset(bs, 0, sizeof(*bs));
+    if (!file_map_open(&bs->fm, fpath))
+        return 0;
+
+    const char* base = bs->fm.data;
+    size_t size = bs->fm.size;
+    struct baked_scene_header hdr;
+    if (size < sizeof(hdr)) {
+        baked_scene_free(bs);
+        return 0;
+    }
+    memcpy(&hdr, base, sizeof(hdr));
+    if (memcmp(hdr.magic, BAKED_SCENE_MAGIC, 4) != 0
+     || hdr.version != BAKED_SCENE_VERSION
+     || hdr.file_size != size
+     || hdr.num_sections > (size - sizeof(hdr)) / sizeof(struct baked_scene_entry)) {
+        baked_scene_free(bs);
+        return 0;
+    }
+    bs->initial_energy = hdr.initial_energy;
+
+    /* Sections of unknown types are skipped, so that additions do not need a version bump */
+    const struct baked_scene_entry* table = (const struct baked_scene_entry*)(base + sizeof(hdr));
+    for (uint32_t i = 0; i < hdr.num_sections; ++i) {
+        struct baked_scene_entry e;
+        memcpy(&e, &table[i], sizeof(e));
+        struct baked_scene_section* s = section_of_type(bs, e.type);
+        if (!s)
+            continue;
+        if (e.offset % BAKED_SCENE_ALIGN != 0 || e.offset > size || e.size > size - e.offset) {
+            baked_scene_free(bs);
+            return 0;
+        }
+        s->data   = base + e.offset;
+        s->size   = e.size;
+        s->format = e.format;
+        s->count  = e.count;
+        s->stride = e.stride;
+        s->width  = e.width;
+        s->height = e.height;
+    }
+    if (!sections_valid(bs)) {
+        baked_scene_free(bs);
+        return 0;
+    }
+    return 1;
+}
+
+static size_t align_up(size_t v)
+{
+    return (v + BAKED_SCENE_ALIGN - 1) & ~(size_t)(BAKED_SCENE_ALIGN - 1);
+}
+
+int baked_scene_save(const struct baked_scene* bs, const char* fpath)
+{
+    const struct baked_scene_section* sections[BAKED_SCENE_NUM_SECTIONS] = {
+        &bs->vertices, &bs->vis_vertices, &bs->indices, &bs->lightmap, &bs->lights
+    };
+    static const uint32_t types[BAKED_SCENE_NUM_SECTIONS] = {
+        BAKED_SECTION_VERTICES, BAKED_SECTION_VIS_VERTICES, BAKED_SECTION_INDICES, BAKED_SECTION_LIGHTMAP,
+        BAKED_SECTION_LIGHTS
+    };
+
+    /* Lay out the sections after the table, each one aligned */
+    struct baked_scene_entry table[BAKED_SCENE_NUM_SECTIONS];
+    memset(table, 0, sizeof(table));
+    size_t offset = align_up(sizeof(struct baked_scene_header) + sizeof(table));
+    for (int i = 0; i < BAKED_SCENE_NUM_SECTIONS; ++i) {
+        const struct baked_scene_section* s = sections[i];
+        table[i].type   = types[i];
+        table[i].format = s->format;
+        table[i].count  = s->count;
+        table[i].stride = s->stride;
+        table[i].width  = s->width;
+        table[i].height = s->height;
+        table[i].offset = offset;
+        table[i].size   = s->size;
+        offset = align_up(offset + s->size);
+    }
+
+    struct baked_scene_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, BAKED_SCENE_MAGIC, 4);
+    hdr.version = BAKED_SCENE_VERSION;
+    hdr.num_sections = BAKED_SCENE_NUM_SECTIONS;
+    hdr.initial_energy = bs->initial_energy;
+    hdr.file_size = offset;
+
+    /* Write aside and swap in, same as the bake cache */
+    char tmp_path[4096];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", fpath);
+    FILE* f = fopen(tmp_path, "wb");
+    if (!f)
+        return 0;
+    static const char zeros[BAKED_SCENE_ALIGN];
+    size_t pos = sizeof(hdr) + sizeof(table);
+    int ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1
+          && fwrite(table, sizeof(table), 1, f) == 1;
+    for (int i = 0; i < BAKED_SCENE_NUM_SECTIONS && ok; ++i) {
+        size_t pad = table[i].offset - pos;
+        ok = fwrite(zeros, 1, pad, f) == pad
+          && fwrite(sections[i]->data, 1, sections[i]->size, f) == sections[i]->size;
+        pos = table[i].offset + table[i].size;
+    }
+    ok = ok && fwrite(zeros, 1, offset - pos, f) == offset - pos;
+    ok = (fclose(f) == 0) && ok;
+    if (ok) {
+#ifdef _WIN32
+        remove(fpath);
+#endif
+        ok = rename(tmp_path, fpath) == 0;
+    }
+    if (!ok)
+        remove(tmp_path);
+    return ok;
+}
+
+void baked_scene_free(struct baked_scene* bs)
+{
+    if (bs->fm.data) {
+        file_map_close(&bs->fm);
+    } else {
+        free((void*)bs->lights.data);
+        free((void*)bs->lightmap.data);
+        free((void*)bs->indices.data);
+        free((void*)bs->vis_vertices.data);
+        free((void*)bs->vertices.data);
+    }
+    memset(bs, 0, sizeof(*bs));
+}
+
+void baked_scene_capture(struct baked_scene* bs, struct scene_mesh* m, unsigned int width, unsigned int height)
+{
+    memset(bs, 0, sizeof(*bs));
+    unsigned int num_vertices = m->num_vertices;
+
+    struct scene_vertex* vertices = malloc((size_t)num_vertices * sizeof(*vertices));
+    struct scene_vis_vertex* vis_vertices = malloc((size_t)num_vertices * sizeof(*vis_vertices));
+    scene_mesh_read_vertices(m, vertices, vis_vertices);
+    bs->vertices = (struct baked_scene_section){
+        .data = vertices, .size = (size_t)num_vertices * sizeof(*vertices),
+        .format = BAKED_SCENE_VERTEX_PACKED, .count = num_vertices, .stride = sizeof(*vertices)
+    };
+    bs->vis_vertices = (struct baked_scene_section){
+        .data = vis_vertices, .size = (size_t)num_vertices * sizeof(*vis_vertices),
+        .format = BAKED_SCENE_VIS_VERTEX_PACKED, .count = num_vertices, .stride = sizeof(*vis_vertices)
+    };
+
+    struct scene_geometry geom;
+    scene_mesh_read_geometry(m, &geom);
+    bs->indices = (struct baked_scene_section){
+        .data = geom.indices, .size = (size_t)geom.num_indices * sizeof(uint32_t),
+        .format = GL_UNSIGNED_INT, .count = geom.num_indices, .stride = sizeof(uint32_t)
+    };
+    free(geom.positions);
+
+    size_t num_texels = (size_t)width * height;
+    uint16_t* radiosity = malloc(num_texels * 4 * sizeof(uint16_t));
+    uint16_t* unshot = malloc(num_texels * 4 * sizeof(uint16_t));
+    radiosity_store_solution(RADIOSITY_ACCUM_RGBA16F, radiosity, unshot);
+    free(unshot);
+    bs->lightmap = (struct baked_scene_section){
+        .data = radiosity, .size = num_texels * 4 * sizeof(uint16_t),
+        .format = GL_RGBA16F, .count = num_texels, .stride = 4 * sizeof(uint16_t),
+        .width = width, .height = height
+    };
+    bs->initial_energy = radiosity_initial_energy();
+
+    unsigned int num_lights;
+    const struct radiosity_light* lights = radiosity_lights(&num_lights);
+    void* lights_copy = 0;
+    if (num_lights) {
+        lights_copy = malloc(num_lights * sizeof(*lights));
+        memcpy(lights_copy, lights, num_lights * sizeof(*lights));
+    }
+    bs->lights = (struct baked_scene_section){
+        .data = lights_copy, .size = num_lights * sizeof(*lights),
+        .format = BAKED_SCENE_LIGHT, .count = num_lights, .stride = sizeof(*lights)
+    };
+}
+
+void baked_scene_restore(const struct baked_scene* bs)
+{
+    /* Nothing left to shoot, the solver reports convergence after its next pass */
+    void* unshot = calloc(bs->lightmap.count, 4 * sizeof(uint16_t));
+    radiosity_restore_solution(RADIOSITY_ACCUM_RGBA16F, bs->lightmap.data, unshot, bs->initial_energy);
+    free(unshot);
+}
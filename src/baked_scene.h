@@ -0,0 +1,76 @@
+/*********************************************************************************************************************/
+/*                                                  /===-_---~~~~~~~~~------____                                     */
+/*                                                 |===-~___                _,-'                                     */
+/*                  -==\\                         `//~\\   ~~~~`---.___.-~~                                          */
+/*              ______-==|                         | |  \\           _-~`                                            */
+/*        __--~~~  ,-/-==\\                        | |   `\        ,'                                                */
+/*     _-~       /'    |  \\                      / /      \      /                                                  */
+/*   .'        /       |   \\                   /' /        \   /'                                                   */
+/*  /  ____  /         |    \`\.__/-~~ ~ \ _ _/'  /          \/'                                                     */
+/* /-'~    ~~~~~---__  |     ~-/~         ( )   /'        _--~`                                                      */
+/*                   \_|      /        _)   ;  ),   __--~~                                                           */
+/*                     '~~--_/      _-~/-  / \   '-~ \                                                               */
+/*                    {\__--_/}    / \\_>- )<__\      \                                                              */
+/*                    /'   (_/  _-~  | |__>--<__|      |                                                             */
+/*                   |0  0 _/) )-~     | |__>--<__|     |                                                            */
+/*                   / /~ ,_/       / /__>---<__/      |                                                             */
+/*                  o o _//        /-~_>---<__-~      /                                                              */
+/*                  (^(~          /~_>---<__-      _-~                                                               */
+/*                 ,/|           /__>--<__/     _-~                                                                  */
+/*              ,//('(          |__>--<__|     /                  .----_                                             */
+/*             ( ( '))          |__>--<__|    |                 /' _---_~\                                           */
+/*          `-)) )) (           |__>--<__|    |               /'  /     ~\`\                                         */
+/*         ,/,'//( (             \__>--<__\    \            /'  //        ||                                         */
+/*       ,( ( ((, ))              ~-__>--<_~-_  ~--____---~' _/'/        /'                                          */
+/*     `~/  )` ) ,/|                 ~-_~>--<_/-__       __-~ _/                                                     */
+/*   ._-~//( )/ )) `                    ~~-'_/_/ /~~~~~~~__--~                                                       */
+/*    ;'( ')/ ,)(                              ~~~~~~~~~~                                                            */
+/*   ' ') '( (/                                                                                                      */
+/*     '   '  `                                                                                                      */
+#ifndef _BAKED_SCENE_H_
+#define _BAKED_SCENE_H_
+
+#include <stddef.h>
+#include "scene.h"
+#include "file_map.h"
+
+/* Vertex layouts of the vertex section */
+#define BAKED_SCENE_VERTEX_PACKED 2     /* struct scene_vertex */
+#define BAKED_SCENE_VIS_VERTEX_PACKED 3 /* struct scene_vis_vertex */
+#define BAKED_SCENE_LIGHT 4             /* struct radiosity_light */
+
+/* One block of the container, sized and laid out for a direct upload */
+struct baked_scene_section {
+    const void* data;
+    size_t size;
+    /* Vertex layout, GL index type or GL internal format, depending on the section */
+    unsigned int format;
+    /* Elements and bytes per element, texels for the lightmap */
+    unsigned int count;
+    unsigned int stride;
+    unsigned int width, height;
+};
+
+/* Baked mesh and lightmap, everything the viewer needs to show a finished bake */
+struct baked_scene {
+    struct baked_scene_section vertices;        /* Interleaved vertex buffer */
+    struct baked_scene_section vis_vertices;    /* Position and uv stream of the gi pass */
+    struct baked_scene_section indices;         /* 32bit triangle list */
+    struct baked_scene_section lightmap;        /* Radiosity texture, RGBA half floats */
+    struct baked_scene_section lights;          /* Light list of the bake, data is null when absent */
+    float initial_energy;
+    /* Sections of a loaded scene point into the mapped file, captured ones own their data */
+    struct file_map fm;
+};
+
+/* Maps the file and validates its section table, fails on missing, corrupt or version mismatched files */
+int baked_scene_load(struct baked_scene* bs, const char* fpath);
+int baked_scene_save(const struct baked_scene* bs, const char* fpath);
+void baked_scene_free(struct baked_scene* bs);
+
+/* Grabs the mesh and the current solution from the gpu */
+void baked_scene_capture(struct baked_scene* bs, struct scene_mesh* m, unsigned int width, unsigned int height);
+/* Uploads the baked lightmap as a converged solution, must follow the attribute pass */
+void baked_scene_restore(const struct baked_scene* bs);
+
+#endif /* ! _BAKED_SCENE_H_ */
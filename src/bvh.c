@@ -0,0 +1,295 @@
+#include "bvh.h"
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include <assert.h>
+
+/* Number of SAH candidate bins per axis */
+#define BVH_BINS 16
+/* Triangle count below which nodes are not split any further */
+#define BVH_LEAF_SIZE 2
+/* Cost of visiting a node relative to a triangle test */
+#define BVH_TRAVERSAL_COST 1.0f
+
+struct aabb {
+    float bmin[3];
+    float bmax[3];
+};
+
+struct build_ctx {
+    struct bvh* b;
+    const float* positions;
+    const unsigned int* indices;
+    /* Triangle order, permuted in place while splitting */
+    unsigned int* order;
+    struct aabb* tri_bounds;
+    float (*centroids)[3];
+};
+
+static void aabb_empty(struct aabb* a)
+{
+    for (int k = 0; k < 3; ++k) {
+        a->bmin[k] = FLT_MAX;
+        a->bmax[k] = -FLT_MAX;
+    }
+}
+
+static void aabb_grow(struct aabb* a, const struct aabb* o)
+{
+    for (int k = 0; k < 3; ++k) {
+        a->bmin[k] = fminf(a->bmin[k], o->bmin[k]);
+        a->bmax[k] = fmaxf(a->bmax[k], o->bmax[k]);
+    }
+}
+
+static float aabb_area(const struct aabb* a)
+{
+    float e[3];
+    for (int k = 0; k < 3; ++k)
+        e[k] = a->bmax[k] - a->bmin[k];
+    if (e[0] < 0.0f)
+        return 0.0f;
+    return 2.0f * (e[0] * e[1] + e[1] * e[2] + e[2] * e[0]);
+}
+
+static void make_leaf(struct bvh_node* n, unsigned int first, unsigned int count)
+{
+    n->first = first;
+    n->count = count;
+}
+
+static void build_node(struct build_ctx* ctx, unsigned int node_idx, unsigned int first, unsigned int count, unsigned int depth)
+{
+    assert(depth <= BVH_MAX_DEPTH);
+    struct bvh_node* n = &ctx->b->nodes[node_idx];
+
+    /* Node and centroid bounds */
+    struct aabb bounds, cbounds;
+    aabb_empty(&bounds);
+    aabb_empty(&cbounds);
+    for (unsigned int i = first; i < first + count; ++i) {
+        unsigned int t = ctx->order[i];
+        aabb_grow(&bounds, &ctx->tri_bounds[t]);
+        struct aabb c;
+        memcpy(c.bmin, ctx->centroids[t], sizeof(c.bmin));
+        memcpy(c.bmax, ctx->centroids[t], sizeof(c.bmax));
+        aabb_grow(&cbounds, &c);
+    }
+    memcpy(n->bmin, bounds.bmin, sizeof(n->bmin));
+    memcpy(n->bmax, bounds.bmax, sizeof(n->bmax));
+
+    if (count <= BVH_LEAF_SIZE || depth == BVH_MAX_DEPTH) {
+        make_leaf(n, first, count);
+        return;
+    }
+
+    /* Find the cheapest binned split over all axes */
+    float best_cost = FLT_MAX;
+    int best_axis = -1, best_split = 0;
+    for (int axis = 0; axis < 3; ++axis) {
+        float cmin = cbounds.bmin[axis], cext = cbounds.bmax[axis] - cmin;
+        if (cext <= 0.0f)
+            continue;
+        struct aabb bin_bounds[BVH_BINS];
+        unsigned int bin_count[BVH_BINS] = { 0 };
+        for (int k = 0; k < BVH_BINS; ++k)
+            aabb_empty(&bin_bounds[k]);
+        for (unsigned int i = first; i < first + count; ++i) {
+            unsigned int t = ctx->order[i];
+            int k = (int)((ctx->centroids[t][axis] - cmin) / cext * BVH_BINS);
+            k = k < BVH_BINS ? k : BVH_BINS - 1;
+            ++bin_count[k];
+            aabb_grow(&bin_bounds[k], &ctx->tri_bounds[t]);
+        }
+        /* Sweep from the right to get the right side costs, then from the left */
+        float right_area[BVH_BINS];
+        unsigned int right_count[BVH_BINS];
+        struct aabb acc;
+        aabb_empty(&acc);
+        unsigned int cnt = 0;
+        for (int k = BVH_BINS - 1; k > 0; --k) {
+            aabb_grow(&acc, &bin_bounds[k]);
+            cnt += bin_count[k];
+            right_area[k] = aabb_area(&acc);
+            right_count[k] = cnt;
+        }
+        aabb_empty(&acc);
+        cnt = 0;
+        for (int k = 0; k < BVH_BINS - 1; ++k) {
+            aabb_grow(&acc, &bin_bounds[k]);
+            cnt += bin_count[k];
+            if (cnt == 0 || right_count[k + 1] == 0)
+                continue;
+            float cost = aabb_area(&acc) * cnt + right_area[k + 1] * right_count[k + 1];
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_axis = axis;
+                best_split = k + 1;
+            }
+        }
+    }
+
+    /* Splitting must beat intersecting every triangle of the node */
+    float area = aabb_area(&bounds);
+    if (best_axis < 0 || area <= 0.0f || BVH_TRAVERSAL_COST + best_cost / area >= count) {
+        make_leaf(n, first, count);
+        return;
+    }
+
+    /* Partition triangles around the chosen bin boundary */
+    float cmin = cbounds.bmin[best_axis], cext = cbounds.bmax[best_axis] - cmin;
+    unsigned int i = first, j = first + count;
+    while (i < j) {
+        unsigned int t = ctx->order[i];
+        int k = (int)((ctx->centroids[t][best_axis] - cmin) / cext * BVH_BINS);
+        k = k < BVH_BINS ? k : BVH_BINS - 1;
+        if (k < best_split) {
+            ++i;
+        } else {
+            ctx->order[i] = ctx->order[--j];
+            ctx->order[j] = t;
+        }
+    }
+    unsigned int left_count = i - first;
+
+    /* Children are allocated next to each other */
+    unsigned int left = ctx->b->num_nodes;
+    ctx->b->num_nodes += 2;
+    n->first = left;
+    n->count = 0;
+    build_node(ctx, left, first, left_count, depth + 1);
+    build_node(ctx, left + 1, i, count - left_count, depth + 1);
+}
+
+void bvh_build(struct bvh* b, const float* positions, const unsigned int* indices, unsigned int num_indices)
+{
+    memset(b, 0, sizeof(*b));
+    unsigned int num_tris = num_indices / 3;
+    if (num_tris == 0)
+        return;
+
+    struct build_ctx ctx;
+    ctx.b = b;
+    ctx.positions = positions;
+    ctx.indices = indices;
+    ctx.order = malloc(num_tris * sizeof(unsigned int));
+    ctx.tri_bounds = malloc(num_tris * sizeof(struct aabb));
+    ctx.centroids = malloc(num_tris * sizeof(*ctx.centroids));
+    for (unsigned int t = 0; t < num_tris; ++t) {
+        ctx.order[t] = t;
+        aabb_empty(&ctx.tri_bounds[t]);
+        for (int v = 0; v < 3; ++v) {
+            const float* p = positions + 3 * indices[3 * t + v];
+            struct aabb pa;
+            memcpy(pa.bmin, p, sizeof(pa.bmin));
+            memcpy(pa.bmax, p, sizeof(pa.bmax));
+            aabb_grow(&ctx.tri_bounds[t], &pa);
+        }
+        for (int k = 0; k < 3; ++k)
+            ctx.centroids[t][k] = 0.5f * (ctx.tri_bounds[t].bmin[k] + ctx.tri_bounds[t].bmax[k]);
+    }
+
+    /* A binary tree with one triangle per leaf at most has 2n - 1 nodes */
+    b->nodes = malloc((2 * num_tris - 1) * sizeof(struct bvh_node));
+    b->num_nodes = 1;
+    build_node(&ctx, 0, 0, num_tris, 0);
+
+    /* Store triangles in leaf order */
+    b->num_tris = num_tris;
+    b->tris = malloc(num_tris * sizeof(struct bvh_tri));
+    for (unsigned int i = 0; i < num_tris; ++i) {
+        unsigned int t = ctx.order[i];
+        const float* p0 = positions + 3 * indices[3 * t + 0];
+        const float* p1 = positions + 3 * indices[3 * t + 1];
+        const float* p2 = positions + 3 * indices[3 * t + 2];
+        struct bvh_tri* bt = &b->tris[i];
+        for (int k = 0; k < 3; ++k) {
+            bt->v0[k] = p0[k];
+            bt->e1[k] = p1[k] - p0[k];
+            bt->e2[k] = p2[k] - p0[k];
+        }
+        bt->v0[3] = bt->e1[3] = bt->e2[3] = 0.0f;
+    }
+
+    free(ctx.centroids);
+    free(ctx.tri_bounds);
+    free(ctx.order);
+}
+
+void bvh_free(struct bvh* b)
+{
+    free(b->tris);
+    free(b->nodes);
+    memset(b, 0, sizeof(*b));
+}
+
+/* Segment against triangle (Moller-Trumbore), hits only strictly between the end points */
+static int segment_hits_triangle(const float o[3], const float d[3], const struct bvh_tri* t)
+{
+    const float eps = 1e-7f;
+    float p[3] = {
+        d[1] * t->e2[2] - d[2] * t->e2[1],
+        d[2] * t->e2[0] - d[0] * t->e2[2],
+        d[0] * t->e2[1] - d[1] * t->e2[0]
+    };
+    float det = t->e1[0] * p[0] + t->e1[1] * p[1] + t->e1[2] * p[2];
+    if (fabsf(det) < eps)
+        return 0;
+    float inv_det = 1.0f / det;
+    float s[3] = { o[0] - t->v0[0], o[1] - t->v0[1], o[2] - t->v0[2] };
+    float u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inv_det;
+    if (u < 0.0f || u > 1.0f)
+        return 0;
+    float q[3] = {
+        s[1] * t->e1[2] - s[2] * t->e1[1],
+        s[2] * t->e1[0] - s[0] * t->e1[2],
+        s[0] * t->e1[1] - s[1] * t->e1[0]
+    };
+    float v = (d[0] * q[0] + d[1] * q[1] + d[2] * q[2]) * inv_det;
+    if (v < 0.0f || u + v > 1.0f)
+        return 0;
+    float tt = (t->e2[0] * q[0] + t->e2[1] * q[1] + t->e2[2] * q[2]) * inv_det;
+    return tt > 0.0f && tt < 1.0f;
+}
+
+/* Slab test of the segment o + t * d, t in [0, 1] */
+static int segment_hits_box(const float o[3], const float inv_d[3], const struct bvh_node* n)
+{
+    float tmin = 0.0f, tmax = 1.0f;
+    for (int k = 0; k < 3; ++k) {
+        float t0 = (n->bmin[k] - o[k]) * inv_d[k];
+        float t1 = (n->bmax[k] - o[k]) * inv_d[k];
+        tmin = fmaxf(tmin, fminf(t0, t1));
+        tmax = fminf(tmax, fmaxf(t0, t1));
+    }
+    return tmin <= tmax;
+}
+
+int bvh_segment_occluded(const struct bvh* b, const float o[3], const float d[3])
+{
+    if (b->num_nodes == 0)
+        return 0;
+    float inv_d[3];
+    for (int k = 0; k < 3; ++k)
+        inv_d[k] = 1.0f / d[k];
+
+    unsigned int stack[BVH_STACK_SIZE];
+    int sp = 0;
+    stack[sp++] = 0;
+    while (sp > 0) {
+        const struct bvh_node* n = &b->nodes[stack[--sp]];
+        if (!segment_hits_box(o, inv_d, n))
+            continue;
+        if (n->count > 0) {
+            for (unsigned int i = n->first; i < n->first + n->count; ++i)
+                if (segment_hits_triangle(o, d, &b->tris[i]))
+                    return 1;
+        } else {
+            /* Bounded by BVH_MAX_DEPTH, the builder does not go deeper */
+            stack[sp++] = n->first + 1;
+            stack[sp++] = n->first;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,66 @@
+/*********************************************************************************************************************/
+/*                                                  /===-_---~~~~~~~~~------____                                     */
+/*                                                 |===-~___                _,-'                                     */
+/*                  -==\\                         `//~\\   ~~~~`---.___.-~~                                          */
+/*              ______-==|                         | |  \\           _-~`                                            */
+/*        __--~~~  ,-/-==\\                        | |   `\        ,'                                                */
+/*     _-~       /'    |  \\                      / /      \      /                                                  */
+/*   .'        /       |   \\                   /' /        \   /'                                                   */
+/*  /  ____  /         |    \`\.__/-~~ ~ \ _ _/'  /          \/'                                                     */
+/* /-'~    ~~~~~---__  |     ~-/~         ( )   /'        _--~`                                                      */
+/*                   \_|      /        _)   ;  ),   __--~~                                                           */
+/*                     '~~--_/      _-~/-  / \   '-~ \                                                               */
+/*                    {\__--_/}    / \\_>- )<__\      \                                                              */
+/*                    /'   (_/  _-~  | |__>--<__|      |                                                             */
+/*                   |0  0 _/) )-~     | |__>--<__|     |                                                            */
+/*                   / /~ ,_/       / /__>---<__/      |                                                             */
+/*                  o o _//        /-~_>---<__-~      /                                                              */
+/*                  (^(~          /~_>---<__-      _-~                                                               */
+/*                 ,/|           /__>--<__/     _-~                                                                  */
+/*              ,//('(          |__>--<__|     /                  .----_                                             */
+/*             ( ( '))          |__>--<__|    |                 /' _---_~\                                           */
+/*          `-)) )) (           |__>--<__|    |               /'  /     ~\`\                                         */
+/*         ,/,'//( (             \__>--<__\    \            /'  //        ||                                         */
+/*       ,( ( ((, ))              ~-__>--<_~-_  ~--____---~' _/'/        /'                                          */
+/*     `~/  )` ) ,/|                 ~-_~>--<_/-__       __-~ _/                                                     */
+/*   ._-~//( )/ )) `                    ~~-'_/_/ /~~~~~~~__--~                                                       */
+/*    ;'( ')/ ,)(                              ~~~~~~~~~~                                                            */
+/*   ' ') '( (/                                                                                                      */
+/*     '   '  `                                                                                                      */
+#ifndef _BVH_H_
+#define _BVH_H_
+
+/* Traversal stack entries, a depth first walk that pushes both children needs one more than the tree depth */
+#define BVH_STACK_SIZE 32
+/* Nodes this deep become leaves whatever their triangle count, so that no traversal overflows its stack */
+#define BVH_MAX_DEPTH (BVH_STACK_SIZE - 1)
+
+/* Leaf when count > 0 with triangles [first, first + count), else children at first and first + 1 */
+struct bvh_node {
+    float bmin[3];
+    unsigned int first;
+    float bmax[3];
+    unsigned int count;
+};
+
+/* Triangle as vertex and edges, padded to match std430 vec4 arrays */
+struct bvh_tri {
+    float v0[4];
+    float e1[4];
+    float e2[4];
+};
+
+struct bvh {
+    struct bvh_node* nodes;
+    unsigned int num_nodes;
+    struct bvh_tri* tris;
+    unsigned int num_tris;
+};
+
+/* Builds with binned SAH over the given indexed triangles, 3 floats per vertex */
+void bvh_build(struct bvh* b, const float* positions, const unsigned int* indices, unsigned int num_indices);
+void bvh_free(struct bvh* b);
+/* Checks for any hit strictly between o and o + d */
+int bvh_segment_occluded(const struct bvh* b, const float o[3], const float d[3]);
+
+#endif /* ! _BVH_H_ */
@@ -246,4 +246,11 @@ static const float cornell_box_cam_pos[3] = {278, 273, -800};
 static const float cornell_box_cam_to[3] = {278, 273, 0};
 static const float cornell_box_cam_up[3] = {0, 1, 0};
 
+/*
+ * -= Light parameters =-
+ *  Point light below the ceiling light, intensity 30000
+ */
+static const float cornell_box_light_pos[3] = {278, 450, 279.5};
+static const float cornell_box_light_intensity = 30000;
+
 #endif /* ! _CORNELL_BOX_H_ */
@@ -0,0 +1,71 @@
+#include "file_map.h"
+#include <string.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+int file_map_open(struct file_map* fm, const char* fpath)
+{
+    memset(fm, 0, sizeof(*fm));
+#ifdef _WIN32
+    HANDLE file = CreateFileA(fpath, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+    if (file == INVALID_HANDLE_VALUE)
+        return 0;
+    LARGE_INTEGER sz;
+    if (!GetFileSizeEx(file, &sz) || sz.QuadPart == 0) {
+        CloseHandle(file);
+        return 0;
+    }
+    HANDLE mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+    const void* data = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : 0;
+    if (!data) {
+        if (mapping)
+            CloseHandle(mapping);
+        CloseHandle(file);
+        return 0;
+    }
+    fm->file = file;
+    fm->mapping = mapping;
+    fm->data = data;
+    fm->size = (size_t)sz.QuadPart;
+#else
+    int fd = open(fpath, O_RDONLY);
+    if (fd < 0)
+        return 0;
+    struct stat sb;
+    if (fstat(fd, &sb) != 0 || sb.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+    size_t size = (size_t)sb.st_size;
+    void* p = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return 0;
+    /* Readers go through the file front to back once */
+    madvise(p, size, MADV_SEQUENTIAL);
+    fm->data = p;
+    fm->size = size;
+#endif
+    return 1;
+}
+
+void file_map_close(struct file_map* fm)
+{
+    if (!fm->data)
+        return;
+#ifdef _WIN32
+    UnmapViewOfFile(fm->data);
+    CloseHandle(fm->mapping);
+    CloseHandle(fm->file);
+#else
+    munmap((void*)fm->data, fm->size);
+#endif
+    memset(fm, 0, sizeof(*fm));
+}
@@ -11,126 +11,35 @@
 #include "opengl.h"
 #include "shader_util.h"
 #include "cornell_box.h"
-#include "uvmap.h"
+#include "scene.h"
 #include "glutil.h"
 #include "hemicube.h"
 #include "radiosity.h"
+#include "bake_cache.h"
+#include "baked_scene.h"
+#include "gpu_timer.h"
 
 #define WND_TITLE "TRad"
 #define WND_WIDTH 1280
 #define WND_HEIGHT 720
 #define LIGHTMAP_SIZE 128
-
-struct cornell_box {
-    float* vertices;
-    size_t num_vertices;
-    float* colors;
-    size_t num_colors;
-    float* normals;
-    size_t num_normals;
-    float* lmuvs;
-    size_t num_lmuvs;
-    unsigned int* indices;
-    size_t num_indices;
+#define GPU_TIMINGS_FILE "gpu_timings.csv"
+#define SHADER_CACHE_DIR "shadercache"
+/* Baked scene loaded at startup when present, written by trad-bake -x */
+#define BAKED_SCENE_FILE "scene.trbs"
+/* Gpu frame time the preview is kept at, the rest of the frame goes to the solver */
+#define FRAME_BUDGET_MS (1000.0f / 60.0f)
+/* Uniform buffer binding of the view constants, clear of the solver's */
+#define VIEW_PARAMS_BINDING 1
+
+/* Uniform block of the standard shader, std140 */
+struct view_params {
+    mat4 proj;
+    mat4 view;
+    float view_pos[3];
+    float padding0;
 };
 
-static void load_cornell_box(GLuint* cb_vao, GLuint* cb_vbo, GLuint* cb_ebo, GLuint* cb_nrm, GLuint* cb_col, GLuint* cb_lm_uvs, GLuint* cb_num_indices, struct cornell_box* cbox)
-{
-    GLuint vao, vbo, nrm, col, lm_uvs, ebo;
-    glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
-
-    glGenBuffers(1, &vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * cbox->num_vertices, cbox->vertices, GL_STATIC_DRAW);
-    GLuint pos_attrib = 0;
-    glEnableVertexAttribArray(pos_attrib);
-    glVertexAttribPointer(pos_attrib, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), 0);
-
-    glGenBuffers(1, &nrm);
-    glBindBuffer(GL_ARRAY_BUFFER, nrm);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * cbox->num_normals, cbox->normals, GL_STATIC_DRAW);
-    GLuint nrm_attrib = 1;
-    glEnableVertexAttribArray(nrm_attrib);
-    glVertexAttribPointer(nrm_attrib, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), 0);
-
-    glGenBuffers(1, &col);
-    glBindBuffer(GL_ARRAY_BUFFER, col);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * cbox->num_colors, cbox->colors, GL_STATIC_DRAW);
-    GLuint col_attrib = 2;
-    glEnableVertexAttribArray(col_attrib);
-    glVertexAttribPointer(col_attrib, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), 0);
-
-    glGenBuffers(1, &lm_uvs);
-    glBindBuffer(GL_ARRAY_BUFFER, lm_uvs);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * cbox->num_lmuvs, cbox->lmuvs, GL_STATIC_DRAW);
-    GLuint lm_uvs_attrib = 3;
-    glEnableVertexAttribArray(lm_uvs_attrib);
-    glVertexAttribPointer(lm_uvs_attrib, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), 0);
-
-    glGenBuffers(1, &ebo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLfloat) * cbox->num_indices, cbox->indices, GL_STATIC_DRAW);
-
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-
-    *cb_vao = vao;
-    *cb_vbo = vbo;
-    *cb_ebo = ebo;
-    *cb_nrm = nrm;
-    *cb_col = col;
-    *cb_lm_uvs = lm_uvs;
-    *cb_num_indices = cbox->num_indices;
-}
-
-static void free_cornell_box(GLuint* cb_vao, GLuint* cb_vbo, GLuint* cb_ebo, GLuint* cb_nrm, GLuint* cb_col, GLuint* cb_lm_uvs)
-{
-    glDeleteBuffers(1, cb_lm_uvs);
-    glDeleteBuffers(1, cb_col);
-    glDeleteBuffers(1, cb_nrm);
-    glDeleteBuffers(1, cb_ebo);
-    glDeleteBuffers(1, cb_vbo);
-    glDeleteVertexArrays(1, cb_vao);
-}
-
-static void unpack_attrib(float* attrib_out, float* attrib_in, size_t attrib_sz, unsigned int* indices, size_t num_indices)
-{
-    for (size_t i = 0; i < num_indices; ++i) {
-        unsigned int ind = indices[i];
-        float* from = (float*)(((unsigned char*)attrib_in) + attrib_sz * ind);
-        float* to = (float*)(((unsigned char*)attrib_out) + attrib_sz * i);
-        memcpy(to, from, attrib_sz);
-    }
-}
-
-/* Must free output cornell box's data */
-static void unpack_cornell_box(struct cornell_box* cbout, struct cornell_box* cbin)
-{
-    cbout->num_indices  = cbin->num_indices;
-    cbout->num_vertices = cbin->num_indices * 3;
-    cbout->num_colors   = cbin->num_indices * 3;
-    cbout->num_normals  = cbin->num_indices * 3;
-    cbout->vertices     = malloc(cbout->num_vertices * sizeof(float) * 3);
-    cbout->colors       = malloc(cbout->num_colors   * sizeof(float) * 3);
-    cbout->normals      = malloc(cbout->num_normals  * sizeof(float) * 3);
-    cbout->indices      = malloc(cbout->num_indices  * sizeof(unsigned int));
-    unpack_attrib(cbout->vertices, cbin->vertices, sizeof(float) * 3, cbin->indices, cbin->num_indices);
-    unpack_attrib(cbout->colors,   cbin->colors,   sizeof(float) * 3, cbin->indices, cbin->num_indices);
-    unpack_attrib(cbout->normals,  cbin->normals,  sizeof(float) * 3, cbin->indices, cbin->num_indices);
-    for (size_t i = 0; i < cbin->num_indices; ++i)
-        cbout->indices[i] = i;
-}
-
-static void free_upacked_cornell_box(struct cornell_box* cbox)
-{
-    free(cbox->vertices);
-    free(cbox->colors);
-    free(cbox->normals);
-    free(cbox->indices);
-}
-
 static void opengl_err_cb(void* ud, const char* msg)
 {
     struct game_context* ctx = ud;
@@ -147,6 +56,8 @@ static void on_key(struct window* wnd, int key, int scancode, int action, int mo
         *(ctx->should_terminate) = 1;
     if (action == KEY_ACTION_RELEASE && key == KEY_SPACE)
         ctx->rndr_mode = ctx->rndr_mode < 2 ? ctx->rndr_mode + 1 : 0;
+    if (action == KEY_ACTION_RELEASE && key == KEY_B)
+        ctx->background = !ctx->background;
 }
 
 void game_init(struct game_context* ctx)
@@ -167,53 +78,67 @@ void game_init(struct game_context* ctx)
 
     /* Setup OpenGL debug handler */
     opengl_register_error_handler(opengl_err_cb, ctx);
+    shader_cache_init(SHADER_CACHE_DIR);
+
+    /* Load a finished bake when there is one, the mesh and lightmap are uploaded from the mapped file */
+    unsigned int lm_width = LIGHTMAP_SIZE, lm_height = LIGHTMAP_SIZE;
+    ctx->baked = calloc(1, sizeof(struct baked_scene));
+    if (baked_scene_load(ctx->baked, ctx->scene_file ? ctx->scene_file : BAKED_SCENE_FILE)) {
+        ctx->from_baked = 1;
+        scene_mesh_load_baked(&ctx->mesh, ctx->baked);
+        lm_width = ctx->baked->lightmap.width;
+        lm_height = ctx->baked->lightmap.height;
+    } else {
+        if (ctx->scene_file)
+            fprintf(stderr, "Could not load baked scene %s\n", ctx->scene_file);
+        free(ctx->baked);
+        ctx->baked = 0;
+    }
 
-    /* Bundle cornell box data */
-    struct cornell_box cbox_packed;
-    cbox_packed.vertices     = (float*) cornell_box_vertices;
-    cbox_packed.num_vertices = (sizeof(cornell_box_vertices) / sizeof(cornell_box_vertices[0])) / 3;
-    cbox_packed.colors       = (float*) cornell_box_colors;
-    cbox_packed.num_colors   = (sizeof(cornell_box_colors) / sizeof(cornell_box_colors[0])) / 3;
-    cbox_packed.normals      = (float*) cornell_box_normals;
-    cbox_packed.num_normals  = (sizeof(cornell_box_normals) / sizeof(cornell_box_normals[0])) / 3;
-    cbox_packed.indices      = (unsigned int*) cornell_box_indices;
-    cbox_packed.num_indices  = sizeof(cornell_box_indices) / sizeof(cornell_box_indices[0]);
-
-    /* Unpack cbox */
-    struct cornell_box cbox_unpacked;
-    unpack_cornell_box(&cbox_unpacked, &cbox_packed);
-    struct cornell_box cbox = cbox_unpacked;
-
-    /* Generate lightmap uvs */
-    cbox.num_lmuvs = cbox.num_vertices;
-    cbox.lmuvs = calloc(cbox.num_lmuvs, sizeof(vec2));
-    uvmap_planar_project(
-        (vec2*) cbox.lmuvs,
-        (vec3*) cbox.vertices,
-        (vec3*) cbox.normals,
-        cbox.num_vertices,
-        cbox.indices,
-        cbox.num_indices,
-        LIGHTMAP_SIZE, LIGHTMAP_SIZE, 2);
-
-    /* Load model */
-    load_cornell_box(
-        &ctx->mesh.vao,
-        &ctx->mesh.vbo,
-        &ctx->mesh.ebo,
-        &ctx->mesh.nrm,
-        &ctx->mesh.col,
-        &ctx->mesh.lm_uvs,
-        &ctx->mesh.num_indices,
-        &cbox
-    );
-    free(cbox.lmuvs);
-    free_upacked_cornell_box(&cbox_unpacked);
+    /* Otherwise load model, reusing the lightmap uvs of a matching bake cache */
+    if (!ctx->from_baked) {
+        struct bake_cache_params bcp = {
+            .lm_width   = LIGHTMAP_SIZE,
+            .lm_height  = LIGHTMAP_SIZE,
+            .lm_padding = SCENE_LM_PADDING,
+            .hemicube_res = HEMICUBE_SRES,
+            .batch_size = 1,
+            .vis_mode   = RADIOSITY_VIS_HEMICUBE,
+            .accum_format = RADIOSITY_ACCUM_RGBA16F
+        };
+        /* Same key as a bake of the cornell box with its default light */
+        struct radiosity_light light;
+        scene_cornell_box_light(&light);
+        unsigned long long scene_hash = scene_cornell_box_hash(BAKE_CACHE_HASH_SEED);
+        scene_hash = bake_cache_hash(scene_hash, &light, sizeof(light));
+        ctx->bake_key = bake_cache_key(scene_hash, &bcp);
+        bake_cache_default_path(ctx->bake_cache_path, sizeof(ctx->bake_cache_path));
+        ctx->warm_start = calloc(1, sizeof(struct bake_cache));
+        if (bake_cache_load(ctx->warm_start, ctx->bake_cache_path, ctx->bake_key)) {
+            scene_cornell_box_load_uvs(&ctx->mesh, ctx->warm_start->lm_uvs);
+        } else {
+            free(ctx->warm_start);
+            ctx->warm_start = 0;
+            scene_cornell_box_load(&ctx->mesh, LIGHTMAP_SIZE, LIGHTMAP_SIZE);
+        }
+    }
 
     /* Load shader */
     ctx->shdr = shader_load(&(struct shader_files){
         .vs_loc = "res/shaders/standard.vert",
         .fs_loc = "res/shaders/standard.frag"});
+    shader_reflect(ctx->shdr, (struct shader_uniform_ref[]){
+        {"model",   &ctx->shdr_u.model},
+        {"mode",    &ctx->shdr_u.mode},
+        {"lm_mode", &ctx->shdr_u.lm_mode}}, 3,
+        (struct shader_block[]){{"view_params", VIEW_PARAMS_BINDING, 0}}, 1);
+    glUseProgram(ctx->shdr);
+    glUniform1i(glGetUniformLocation(ctx->shdr, "lightmap"), 0);
+    glUseProgram(0);
+    glGenBuffers(1, &ctx->view_ubo);
+    glBindBuffer(GL_UNIFORM_BUFFER, ctx->view_ubo);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(struct view_params), 0, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
 
     /* GLutils */
     glutil_init();
@@ -222,9 +147,28 @@ void game_init(struct game_context* ctx)
     ctx->hc_rndr = calloc(1, sizeof(struct hemicube_rndr));
     hemicube_rndr_init(ctx->hc_rndr);
 
-    /* Radiosity renderer */
-    const int lightmap_res = LIGHTMAP_SIZE;
-    radiosity_init(lightmap_res, lightmap_res);
+    /* Radiosity renderer, lit by the lights of the bake when the container has them */
+    radiosity_init(lm_width, lm_height);
+    radiosity_set_lightmap_area(ctx->mesh.lm_area);
+    if (ctx->baked && ctx->baked->lights.data) {
+        radiosity_set_lights(ctx->baked->lights.data, ctx->baked->lights.count);
+    } else {
+        struct radiosity_light light;
+        scene_cornell_box_light(&light);
+        radiosity_set_lights(&light, 1);
+    }
+
+    /* Gpu timings of the renders around the solver */
+    static const char* preview_names[] = {
+        "preview_lightmap",
+        "preview_hemicube",
+        "preview_radiosity",
+        "preview_unshot"
+    };
+    ctx->scene_timer = gpu_timer_stage("scene");
+    for (size_t i = 0; i < 4; ++i)
+        ctx->preview_timers[i] = gpu_timer_stage(preview_names[i]);
+    gi_sched_init(&ctx->gi_sched, FRAME_BUDGET_MS);
 }
 
 void game_update(void* userdata, float dt)
@@ -240,27 +184,28 @@ static void render_scene(struct game_context* ctx, mat4* view, mat4* proj)
     glEnable(GL_DEPTH_TEST);
     mat4 model = mat4_id();
 
-    GLuint shdr = ctx->shdr;
-    glUseProgram(shdr);
-    glUniformMatrix4fv(glGetUniformLocation(shdr, "proj"), 1, GL_FALSE, proj->m);
-    glUniformMatrix4fv(glGetUniformLocation(shdr, "view"), 1, GL_FALSE, view->m);
-    glUniformMatrix4fv(glGetUniformLocation(shdr, "model"), 1, GL_FALSE, model.m);
-    glUniform3fv(glGetUniformLocation(shdr, "view_pos"), 1, cornell_box_cam_pos);
-    vec3 light_pos = {{ .x = 278, .y = 450, .z = 279.5}};
-    glUniform3fv(glGetUniformLocation(shdr, "light_pos"), 1, light_pos.xyz);
-    glUniform1i(glGetUniformLocation(ctx->shdr, "mode"), ctx->rndr_mode);
-    glUniform1i(glGetUniformLocation(ctx->shdr, "lm_mode"), 0);
-    glUniform1i(glGetUniformLocation(ctx->shdr, "lightmap"), 0);
+    /* Everything that stays the same for the whole view goes up in one upload */
+    struct view_params vp = {
+        .proj = *proj,
+        .view = *view
+    };
+    memcpy(vp.view_pos, cornell_box_cam_pos, sizeof(vp.view_pos));
+    glBindBuffer(GL_UNIFORM_BUFFER, ctx->view_ubo);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(vp), &vp);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, VIEW_PARAMS_BINDING, ctx->view_ubo);
+
+    glUseProgram(ctx->shdr);
+    glUniformMatrix4fv(ctx->shdr_u.model.loc, 1, GL_FALSE, model.m);
+    glUniform1i(ctx->shdr_u.mode.loc, ctx->rndr_mode);
+    glUniform1i(ctx->shdr_u.lm_mode.loc, 0);
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, radiosity_lightmap());
+    radiosity_bind_lights();
 
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glBindVertexArray(ctx->mesh.vao);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ctx->mesh.ebo);
-    glDrawElements(GL_TRIANGLES, ctx->mesh.num_indices, GL_UNSIGNED_INT, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    scene_mesh_draw(&ctx->mesh);
 }
 
 static inline void render_lightmap_preview(struct game_context* ctx)
@@ -268,12 +213,8 @@ static inline void render_lightmap_preview(struct game_context* ctx)
     glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glUseProgram(ctx->shdr);
-    glUniform1i(glGetUniformLocation(ctx->shdr, "lm_mode"), 1);
-    glBindVertexArray(ctx->mesh.vao);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ctx->mesh.ebo);
-    glDrawElements(GL_TRIANGLES, ctx->mesh.num_indices, GL_UNSIGNED_INT, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    glUniform1i(ctx->shdr_u.lm_mode.loc, 1);
+    scene_mesh_draw(&ctx->mesh);
     glUseProgram(0);
 }
 
@@ -298,26 +239,50 @@ void game_render(void* userdata, float interpolation)
 {
     (void) interpolation;
     struct game_context* ctx = userdata;
+    int visible = !ctx->background;
+    int passes = gi_sched_frame_begin(&ctx->gi_sched, visible, radiosity_converged());
 
     /* Scene render */
-    mat4 proj = mat4_perspective(radians(40.0), 0.1, 3000.0, (float)WND_WIDTH / WND_HEIGHT);
-    mat4 view = mat4_view_look_at(*(vec3*)cornell_box_cam_pos, *(vec3*)cornell_box_cam_to, *(vec3*)cornell_box_cam_up);
-    render_scene(ctx, &view, &proj);
+    if (visible) {
+        mat4 proj = mat4_perspective(radians(40.0), 0.1, 3000.0, (float)WND_WIDTH / WND_HEIGHT);
+        mat4 view = mat4_view_look_at(*(vec3*)cornell_box_cam_pos, *(vec3*)cornell_box_cam_to, *(vec3*)cornell_box_cam_up);
+        gpu_timer_begin(ctx->scene_timer);
+        render_scene(ctx, &view, &proj);
+        gpu_timer_end(ctx->scene_timer);
+    }
 
     /* Attribute buffer for radiosity */
     radiosity_attrib_pass {
-        glBindVertexArray(ctx->mesh.vao);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ctx->mesh.ebo);
-        glDrawElements(GL_TRIANGLES, ctx->mesh.num_indices, GL_UNSIGNED_INT, 0);
+        scene_mesh_draw(&ctx->mesh);
     }
 
-    /* Progress solution */
-    for (int i = 0; i < 100; ++i)
-    radiosity_gi_pass {
-        glBindVertexArray(ctx->mesh.vao);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ctx->mesh.ebo);
-        glDrawElements(GL_TRIANGLES, ctx->mesh.num_indices, GL_UNSIGNED_INT, 0);
-    };
+    /* Continue from the cached solution instead of the fresh attribute pass output */
+    if (ctx->baked) {
+        baked_scene_restore(ctx->baked);
+        baked_scene_free(ctx->baked);
+        free(ctx->baked);
+        ctx->baked = 0;
+    }
+    if (ctx->warm_start) {
+        bake_cache_restore(ctx->warm_start);
+        bake_cache_free(ctx->warm_start);
+        free(ctx->warm_start);
+        ctx->warm_start = 0;
+    }
+
+    /* Progress solution, as far as the frame budget allows */
+    gi_sched_solve_begin(&ctx->gi_sched);
+    for (int i = 0; i < passes; ++i) {
+        radiosity_gi_pass {
+            scene_mesh_draw_visibility(&ctx->mesh);
+        }
+    }
+    gi_sched_solve_end(&ctx->gi_sched);
+    if (!visible) {
+        gi_sched_frame_end(&ctx->gi_sched);
+        window_swap_buffers(ctx->wnd);
+        return;
+    }
 
     /* Start rendering mini-previews */
     GLint default_vp[4] = {0};
@@ -332,6 +297,7 @@ void game_render(void* userdata, float interpolation)
         glViewport(new_vp[0], new_vp[1], new_vp[2], new_vp[3]);
         glScissor(new_vp[0], new_vp[1], new_vp[2], new_vp[3]);
         /* Preview render */
+        gpu_timer_begin(ctx->preview_timers[preview_idx]);
         switch(preview_idx) {
             case 0:
                 render_lightmap_preview(ctx);
@@ -347,12 +313,14 @@ void game_render(void* userdata, float interpolation)
                 //render_texture(radiosity_visibility());
                 break;
         }
+        gpu_timer_end(ctx->preview_timers[preview_idx]);
     }
 
     /* End rendering mini-previews */
     glDisable(GL_SCISSOR_TEST);
     glScissor(default_vp[0], default_vp[1], default_vp[2], default_vp[3]);
     glViewport(default_vp[0], default_vp[1], default_vp[2], default_vp[3]);
+    gi_sched_frame_end(&ctx->gi_sched);
 
     /* Show rendered contents from the backbuffer */
     window_swap_buffers(ctx->wnd);
@@ -361,20 +329,42 @@ void game_render(void* userdata, float interpolation)
 void game_perf_update(void* userdata, float msec, float fps)
 {
     struct game_context* ctx = userdata;
-    char suffix_buf[64];
-    snprintf(suffix_buf, sizeof(suffix_buf), "[Msec: %.2f / Fps: %.2f]", msec, fps);
+    char suffix_buf[128];
+    snprintf(suffix_buf, sizeof(suffix_buf), "[Msec: %.2f / Fps: %.2f / Passes: %d / Residual: %.2f%%%s%s]",
+             msec, fps, ctx->gi_sched.passes, radiosity_residual() * 100.0f,
+             radiosity_converged() ? " (converged)" : "", ctx->background ? " (background)" : "");
     window_set_title_suffix(ctx->wnd, suffix_buf);
 }
 
 void game_shutdown(struct game_context* ctx)
 {
+    /* Persist the solution for the next launch, once there is one */
+    if (ctx->baked) {
+        baked_scene_free(ctx->baked);
+        free(ctx->baked);
+    }
+    if (ctx->warm_start) {
+        bake_cache_free(ctx->warm_start);
+        free(ctx->warm_start);
+    } else if (!ctx->from_baked && radiosity_initial_energy() > 0.0f) {
+        struct bake_cache bc;
+        bake_cache_capture(&bc, ctx->bake_key, &ctx->mesh, LIGHTMAP_SIZE, LIGHTMAP_SIZE);
+        if (!bake_cache_save(&bc, ctx->bake_cache_path))
+            fprintf(stderr, "Could not write bake cache %s\n", ctx->bake_cache_path);
+        bake_cache_free(&bc);
+    }
+    /* Per stage gpu timings of the whole session */
+    if (!gpu_timer_dump(GPU_TIMINGS_FILE))
+        fprintf(stderr, "Could not write gpu timings %s\n", GPU_TIMINGS_FILE);
+    gpu_timer_destroy();
     radiosity_destroy();
     hemicube_rndr_destroy(ctx->hc_rndr);
     free(ctx->hc_rndr);
     glutil_deinit();
+    glDeleteBuffers(1, &ctx->view_ubo);
+    glDeleteProgram(ctx->shdr);
     /* Free mesh */
-    free_cornell_box(&ctx->mesh.vao, &ctx->mesh.vbo, &ctx->mesh.ebo, &ctx->mesh.nrm, &ctx->mesh.col, &ctx->mesh.lm_uvs);
-    memset(&ctx->mesh, 0, sizeof(ctx->mesh));
+    scene_mesh_free(&ctx->mesh);
     /* Close window */
     window_destroy(ctx->wnd);
 }
@@ -31,6 +31,13 @@
 #ifndef _GAME_H_
 #define _GAME_H_
 
+#include "scene.h"
+#include "gi_sched.h"
+#include "shader_util.h"
+
+struct bake_cache;
+struct baked_scene;
+
 struct game_context
 {
     /* Window assiciated with the game */
@@ -38,13 +45,32 @@ struct game_context
     /* Master run flag, indicates when the game should exit */
     int* should_terminate;
     /* Mesh */
-    struct {
-        unsigned int vao, vbo, nrm, col, ebo, lm_uvs;
-        unsigned int num_indices;
-    } mesh;
+    struct scene_mesh mesh;
     unsigned int shdr;
+    struct {
+        struct shader_uniform model, mode, lm_mode;
+    } shdr_u;
+    /* Camera of the view being rendered, see struct view_params */
+    unsigned int view_ubo;
     /* Hemicube renderer state */
     struct hemicube_rndr* hc_rndr;
+    /* Baked scene container shown instead of the cornell box when it loads, null for the default */
+    const char* scene_file;
+    /* Mapped baked scene, held until its lightmap is restored */
+    struct baked_scene* baked;
+    /* The scene came from a baked container, the bake cache stays out of play */
+    int from_baked;
+    /* Bake cache, warm_start holds a loaded solution until it is restored */
+    struct bake_cache* warm_start;
+    unsigned long long bake_key;
+    char bake_cache_path[512];
+    /* Gpu timer stages of the non solver renders */
+    int scene_timer;
+    int preview_timers[4];
+    /* Gi passes per frame, adapted to the frame time budget */
+    struct gi_sched gi_sched;
+    /* Solve with whole frames and render nothing else, toggled with B */
+    int background;
     /* Misc state */
     unsigned int rndr_mode;
 };
@@ -0,0 +1,77 @@
+#include "gi_sched.h"
+#include <string.h>
+#include "gpu_timer.h"
+
+/* Weight of a new timing sample in the running estimates */
+#define GI_SCHED_SMOOTHING 0.25f
+/* Factor the pass count may grow by at most from one frame to the next */
+#define GI_SCHED_MAX_GROWTH 2
+/* Upper bound of passes per frame by default */
+#define GI_SCHED_MAX_PASSES 1024
+
+void gi_sched_init(struct gi_sched* s, float budget_ms)
+{
+    memset(s, 0, sizeof(*s));
+    s->budget_ms = budget_ms;
+    s->min_passes = 1;
+    s->max_passes = GI_SCHED_MAX_PASSES;
+    s->passes = s->min_passes;
+    /* Unknown until the first timings land */
+    s->pass_ms = s->other_ms = -1.0f;
+    s->frame_stage = gpu_timer_stage("gi_sched_frame");
+    s->gi_stage = gpu_timer_stage("gi_sched_solve");
+}
+
+static float smooth(float est, float sample)
+{
+    return est < 0.0f ? sample : est + (sample - est) * GI_SCHED_SMOOTHING;
+}
+
+/* Folds in the timings of an earlier frame, once both of its stages have landed */
+static void gi_sched_feedback(struct gi_sched* s)
+{
+    unsigned long frame_seq = 0, gi_seq = 0;
+    double frame_ms = gpu_timer_latest(s->frame_stage, &frame_seq);
+    double gi_ms = gpu_timer_latest(s->gi_stage, &gi_seq);
+    if (frame_ms < 0.0 || gi_ms < 0.0 || frame_seq != gi_seq
+     || frame_seq < s->next_feedback || s->frame - frame_seq > GI_SCHED_HISTORY)
+        return;
+    s->next_feedback = frame_seq + 1;
+
+    unsigned int h = frame_seq % GI_SCHED_HISTORY;
+    if (s->history[h].passes > 0)
+        s->pass_ms = smooth(s->pass_ms, gi_ms / s->history[h].passes);
+    /* Hidden frames render nothing besides the solve and say nothing about the preview cost */
+    if (s->history[h].visible)
+        s->other_ms = smooth(s->other_ms, frame_ms > gi_ms ? frame_ms - gi_ms : 0.0f);
+}
+
+int gi_sched_frame_begin(struct gi_sched* s, int visible, int converged)
+{
+    gi_sched_feedback(s);
+
+    int passes = s->min_passes;
+    if (converged) {
+        passes = 0;
+    } else if (s->pass_ms > 0.0f) {
+        /* What is left of the budget after the preview, the whole of it when nothing is shown */
+        float avail = s->budget_ms - (visible && s->other_ms > 0.0f ? s->other_ms : 0.0f);
+        passes = (int)(avail / s->pass_ms);
+        /* Timings lag a few frames behind, so ramp up gradually instead of overshooting */
+        int prev = s->passes > s->min_passes ? s->passes : s->min_passes;
+        passes = passes < prev * GI_SCHED_MAX_GROWTH ? passes : prev * GI_SCHED_MAX_GROWTH;
+        passes = passes < s->min_passes ? s->min_passes : (passes > s->max_passes ? s->max_passes : passes);
+    }
+    s->passes = passes;
+
+    unsigned int h = s->frame % GI_SCHED_HISTORY;
+    s->history[h].passes = passes;
+    s->history[h].visible = visible;
+    ++s->frame;
+    gpu_timer_begin(s->frame_stage);
+    return passes;
+}
+
+void gi_sched_solve_begin(struct gi_sched* s) { gpu_timer_begin(s->gi_stage); }
+void gi_sched_solve_end(struct gi_sched* s) { gpu_timer_end(s->gi_stage); }
+void gi_sched_frame_end(struct gi_sched* s) { gpu_timer_end(s->frame_stage); }
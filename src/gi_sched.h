@@ -0,0 +1,66 @@
+/*********************************************************************************************************************/
+/*                                                  /===-_---~~~~~~~~~------____                                     */
+/*                                                 |===-~___                _,-'                                     */
+/*                  -==\\                         `//~\\   ~~~~`---.___.-~~                                          */
+/*              ______-==|                         | |  \\           _-~`                                            */
+/*        __--~~~  ,-/-==\\                        | |   `\        ,'                                                */
+/*     _-~       /'    |  \\                      / /      \      /                                                  */
+/*   .'        /       |   \\                   /' /        \   /'                                                   */
+/*  /  ____  /         |    \`\.__/-~~ ~ \ _ _/'  /          \/'                                                     */
+/* /-'~    ~~~~~---__  |     ~-/~         ( )   /'        _--~`                                                      */
+/*                   \_|      /        _)   ;  ),   __--~~                                                           */
+/*                     '~~--_/      _-~/-  / \   '-~ \                                                               */
+/*                    {\__--_/}    / \\_>- )<__\      \                                                              */
+/*                    /'   (_/  _-~  | |__>--<__|      |                                                             */
+/*                   |0  0 _/) )-~     | |__>--<__|     |                                                            */
+/*                   / /~ ,_/       / /__>---<__/      |                                                             */
+/*                  o o _//        /-~_>---<__-~      /                                                              */
+/*                  (^(~          /~_>---<__-      _-~                                                               */
+/*                 ,/|           /__>--<__/     _-~                                                                  */
+/*              ,//('(          |__>--<__|     /                  .----_                                             */
+/*             ( ( '))          |__>--<__|    |                 /' _---_~\                                           */
+/*          `-)) )) (           |__>--<__|    |               /'  /     ~\`\                                         */
+/*         ,/,'//( (             \__>--<__\    \            /'  //        ||                                         */
+/*       ,( ( ((, ))              ~-__>--<_~-_  ~--____---~' _/'/        /'                                          */
+/*     `~/  )` ) ,/|                 ~-_~>--<_/-__       __-~ _/                                                     */
+/*   ._-~//( )/ )) `                    ~~-'_/_/ /~~~~~~~__--~                                                       */
+/*    ;'( ')/ ,)(                              ~~~~~~~~~~                                                            */
+/*   ' ') '( (/                                                                                                      */
+/*     '   '  `                                                                                                      */
+#ifndef _GI_SCHED_H_
+#define _GI_SCHED_H_
+
+/* Frames whose pass counts are remembered until their gpu timings land */
+#define GI_SCHED_HISTORY 8
+
+/* Spreads gi passes over frames so that the preview holds its frame time budget */
+struct gi_sched {
+    /* Gpu milliseconds a frame may take */
+    float budget_ms;
+    /* Bounds of the passes run per frame */
+    int min_passes, max_passes;
+    /* Passes scheduled for the current frame */
+    int passes;
+    /* Estimated gpu cost of a single gi pass and of the rest of the frame */
+    float pass_ms, other_ms;
+    /* Gpu timer stages of the whole frame and of its gi passes */
+    int frame_stage, gi_stage;
+    /* Frames begun so far, and the first frame whose timings are still to be used */
+    unsigned long frame, next_feedback;
+    /* What each of the recent frames ran */
+    struct {
+        int passes;
+        int visible;
+    } history[GI_SCHED_HISTORY];
+};
+
+void gi_sched_init(struct gi_sched* s, float budget_ms);
+/* Starts timing a frame and returns the number of gi passes to run in it.
+ * A hidden preview hands the whole frame to the solver, a converged solver gets none */
+int  gi_sched_frame_begin(struct gi_sched* s, int visible, int converged);
+/* Bracket the gi passes of the frame */
+void gi_sched_solve_begin(struct gi_sched* s);
+void gi_sched_solve_end(struct gi_sched* s);
+void gi_sched_frame_end(struct gi_sched* s);
+
+#endif /* ! _GI_SCHED_H_ */
@@ -83,6 +83,10 @@ static void texture_render_init()
     st.tex_shdr = shader_build((struct shader_attachment[]){
         {GL_VERTEX_SHADER,   rndr_tex_vs_src},
         {GL_FRAGMENT_SHADER, rndr_tex_fs_src}}, 2);
+    /* Always sampled from the first unit */
+    glUseProgram(st.tex_shdr);
+    glUniform1i(glGetUniformLocation(st.tex_shdr, "tex"), 0);
+    glUseProgram(0);
 }
 
 static void texture_render_destroy()
@@ -94,7 +98,6 @@ static void texture_render_destroy()
 void render_texture(unsigned int tex)
 {
     glUseProgram(st.tex_shdr);
-    glUniform1i(glGetUniformLocation(st.tex_shdr, "tex"), 0);
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, tex);
     render_quad();
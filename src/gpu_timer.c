@@ -0,0 +1,181 @@
+#include "gpu_timer.h"
+#include <stdio.h>
+#include <string.h>
+#include <glad/glad.h>
+
+/* Query pairs per stage, a pair is read back when its slot comes around again */
+#define GPU_TIMER_BUFFERS 2
+#define GPU_TIMER_NAME_LEN 32
+
+struct gpu_timer_stage {
+    char name[GPU_TIMER_NAME_LEN];
+    /* Start and end timestamps, these unlike elapsed time queries may nest */
+    GLuint queries[GPU_TIMER_BUFFERS][2];
+    int pending[GPU_TIMER_BUFFERS];
+    /* Begin count at the time each slot was issued */
+    unsigned long seqs[GPU_TIMER_BUFFERS];
+    unsigned long begins;
+    unsigned int cur;
+    /* Most recently landed sample and the begin count it was issued at */
+    GLuint64 latest;
+    unsigned long latest_seq;
+    int has_latest;
+    /* Rolling window of samples in nanoseconds */
+    GLuint64 window[GPU_TIMER_WINDOW];
+    unsigned long samples;
+    unsigned long dropped;
+    double total_ms;
+};
+
+static struct {
+    struct gpu_timer_stage stages[GPU_TIMER_MAX_STAGES];
+    int num_stages;
+} st;
+
+static void stage_add_sample(struct gpu_timer_stage* s, GLuint64 ns)
+{
+    s->window[s->samples % GPU_TIMER_WINDOW] = ns;
+    ++s->samples;
+    s->total_ms += ns / 1e6;
+}
+
+/* Reads the result of a slot, without waiting unless asked to */
+static int stage_collect(struct gpu_timer_stage* s, unsigned int slot, int wait)
+{
+    if (!s->pending[slot])
+        return 1;
+    /* The end timestamp lands last */
+    GLint available = 0;
+    if (!wait)
+        glGetQueryObjectiv(s->queries[slot][1], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!wait && !available)
+        return 0;
+    GLuint64 t0 = 0, t1 = 0;
+    glGetQueryObjectui64v(s->queries[slot][0], GL_QUERY_RESULT, &t0);
+    glGetQueryObjectui64v(s->queries[slot][1], GL_QUERY_RESULT, &t1);
+    stage_add_sample(s, t1 > t0 ? t1 - t0 : 0);
+    s->pending[slot] = 0;
+    if (!s->has_latest || s->seqs[slot] >= s->latest_seq) {
+        s->latest = t1 > t0 ? t1 - t0 : 0;
+        s->latest_seq = s->seqs[slot];
+        s->has_latest = 1;
+    }
+    return 1;
+}
+
+int gpu_timer_stage(const char* name)
+{
+    for (int i = 0; i < st.num_stages; ++i)
+        if (strncmp(st.stages[i].name, name, GPU_TIMER_NAME_LEN - 1) == 0)
+            return i;
+    if (st.num_stages == GPU_TIMER_MAX_STAGES)
+        return -1;
+    struct gpu_timer_stage* s = &st.stages[st.num_stages];
+    memset(s, 0, sizeof(*s));
+    snprintf(s->name, sizeof(s->name), "%s", name);
+    glGenQueries(2 * GPU_TIMER_BUFFERS, s->queries[0]);
+    return st.num_stages++;
+}
+
+void gpu_timer_begin(int stage)
+{
+    if (stage < 0)
+        return;
+    struct gpu_timer_stage* s = &st.stages[stage];
+    /* Reusing a query whose result has not arrived yet would stall, drop that sample instead */
+    if (!stage_collect(s, s->cur, 0)) {
+        s->pending[s->cur] = 0;
+        ++s->dropped;
+    }
+    glQueryCounter(s->queries[s->cur][0], GL_TIMESTAMP);
+    s->seqs[s->cur] = s->begins++;
+}
+
+void gpu_timer_end(int stage)
+{
+    if (stage < 0)
+        return;
+    struct gpu_timer_stage* s = &st.stages[stage];
+    glQueryCounter(s->queries[s->cur][1], GL_TIMESTAMP);
+    s->pending[s->cur] = 1;
+    s->cur = (s->cur + 1) % GPU_TIMER_BUFFERS;
+}
+
+int gpu_timer_num_stages() { return st.num_stages; }
+
+double gpu_timer_latest(int stage, unsigned long* seq)
+{
+    if (stage < 0 || stage >= st.num_stages)
+        return -1.0;
+    struct gpu_timer_stage* s = &st.stages[stage];
+    for (unsigned int i = 0; i < GPU_TIMER_BUFFERS; ++i)
+        stage_collect(s, (s->cur + i) % GPU_TIMER_BUFFERS, 0);
+    if (!s->has_latest)
+        return -1.0;
+    if (seq)
+        *seq = s->latest_seq;
+    return s->latest / 1e6;
+}
+
+void gpu_timer_stats(int stage, struct gpu_timer_stats* out)
+{
+    memset(out, 0, sizeof(*out));
+    if (stage < 0 || stage >= st.num_stages)
+        return;
+    struct gpu_timer_stage* s = &st.stages[stage];
+    /* Oldest slot first, keeps samples in submission order */
+    for (unsigned int i = 0; i < GPU_TIMER_BUFFERS; ++i)
+        stage_collect(s, (s->cur + i) % GPU_TIMER_BUFFERS, 1);
+
+    out->name = s->name;
+    out->samples = s->samples;
+    out->dropped = s->dropped;
+    out->total_ms = s->total_ms;
+    unsigned long n = s->samples < GPU_TIMER_WINDOW ? s->samples : GPU_TIMER_WINDOW;
+    if (n == 0)
+        return;
+    GLuint64 mn = s->window[0], mx = s->window[0], sum = 0;
+    for (unsigned long i = 0; i < n; ++i) {
+        GLuint64 v = s->window[i];
+        mn = v < mn ? v : mn;
+        mx = v > mx ? v : mx;
+        sum += v;
+    }
+    out->min_ms = mn / 1e6;
+    out->max_ms = mx / 1e6;
+    out->avg_ms = sum / 1e6 / n;
+}
+
+int gpu_timer_dump(const char* fpath)
+{
+    FILE* f = fopen(fpath, "w");
+    if (!f)
+        return 0;
+    size_t len = strlen(fpath);
+    int json = len >= 5 && strcmp(fpath + len - 5, ".json") == 0;
+    if (json)
+        fprintf(f, "{\n  \"window\": %d,\n  \"stages\": [", GPU_TIMER_WINDOW);
+    else
+        fprintf(f, "stage,samples,dropped,min_ms,avg_ms,max_ms,total_ms\n");
+    for (int i = 0; i < st.num_stages; ++i) {
+        struct gpu_timer_stats s;
+        gpu_timer_stats(i, &s);
+        if (json)
+            fprintf(f, "%s\n    { \"stage\": \"%s\", \"samples\": %lu, \"dropped\": %lu, "
+                       "\"min_ms\": %.6f, \"avg_ms\": %.6f, \"max_ms\": %.6f, \"total_ms\": %.6f }",
+                    i ? "," : "", s.name, s.samples, s.dropped, s.min_ms, s.avg_ms, s.max_ms, s.total_ms);
+        else
+            fprintf(f, "%s,%lu,%lu,%.6f,%.6f,%.6f,%.6f\n",
+                    s.name, s.samples, s.dropped, s.min_ms, s.avg_ms, s.max_ms, s.total_ms);
+    }
+    if (json)
+        fprintf(f, "\n  ]\n}\n");
+    return fclose(f) == 0;
+}
+
+void gpu_timer_destroy()
+{
+    for (int i = 0; i < st.num_stages; ++i)
+        glDeleteQueries(2 * GPU_TIMER_BUFFERS, st.stages[i].queries[0]);
+    memset(&st, 0, sizeof(st));
+}
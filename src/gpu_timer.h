@@ -0,0 +1,65 @@
+/*********************************************************************************************************************/
+/*                                                  /===-_---~~~~~~~~~------____                                     */
+/*                                                 |===-~___                _,-'                                     */
+/*                  -==\\                         `//~\\   ~~~~`---.___.-~~                                          */
+/*              ______-==|                         | |  \\           _-~`                                            */
+/*        __--~~~  ,-/-==\\                        | |   `\        ,'                                                */
+/*     _-~       /'    |  \\                      / /      \      /                                                  */
+/*   .'        /       |   \\                   /' /        \   /'                                                   */
+/*  /  ____  /         |    \`\.__/-~~ ~ \ _ _/'  /          \/'                                                     */
+/* /-'~    ~~~~~---__  |     ~-/~         ( )   /'        _--~`                                                      */
+/*                   \_|      /        _)   ;  ),   __--~~                                                           */
+/*                     '~~--_/      _-~/-  / \   '-~ \                                                               */
+/*                    {\__--_/}    / \\_>- )<__\      \                                                              */
+/*                    /'   (_/  _-~  | |__>--<__|      |                                                             */
+/*                   |0  0 _/) )-~     | |__>--<__|     |                                                            */
+/*                   / /~ ,_/       / /__>---<__/      |                                                             */
+/*                  o o _//        /-~_>---<__-~      /                                                              */
+/*                  (^(~          /~_>---<__-      _-~                                                               */
+/*                 ,/|           /__>--<__/     _-~                                                                  */
+/*              ,//('(          |__>--<__|     /                  .----_                                             */
+/*             ( ( '))          |__>--<__|    |                 /' _---_~\                                           */
+/*          `-)) )) (           |__>--<__|    |               /'  /     ~\`\                                         */
+/*         ,/,'//( (             \__>--<__\    \            /'  //        ||                                         */
+/*       ,( ( ((, ))              ~-__>--<_~-_  ~--____---~' _/'/        /'                                          */
+/*     `~/  )` ) ,/|                 ~-_~>--<_/-__       __-~ _/                                                     */
+/*   ._-~//( )/ )) `                    ~~-'_/_/ /~~~~~~~__--~                                                       */
+/*    ;'( ')/ ,)(                              ~~~~~~~~~~                                                            */
+/*   ' ') '( (/                                                                                                      */
+/*     '   '  `                                                                                                      */
+#ifndef _GPU_TIMER_H_
+#define _GPU_TIMER_H_
+
+/* Maximum number of distinct timed stages */
+#define GPU_TIMER_MAX_STAGES 16
+/* Number of most recent samples the rolling statistics cover */
+#define GPU_TIMER_WINDOW 128
+
+struct gpu_timer_stats {
+    const char* name;
+    /* Samples gathered since registration, and those dropped because a result was late */
+    unsigned long samples;
+    unsigned long dropped;
+    /* Rolling statistics over the last GPU_TIMER_WINDOW samples, in milliseconds */
+    double min_ms, avg_ms, max_ms;
+    /* Sum of all samples */
+    double total_ms;
+};
+
+/* Returns the handle of the named stage, registering it on first use */
+int gpu_timer_stage(const char* name);
+/* Brackets the gl commands of a stage with timestamps, a stage must not nest within itself */
+void gpu_timer_begin(int stage);
+void gpu_timer_end(int stage);
+int gpu_timer_num_stages();
+/* Most recent landed sample in milliseconds without waiting, negative before the first one lands.
+ * seq receives the number of begins that preceded the sample, to tie it to the work it measured */
+double gpu_timer_latest(int stage, unsigned long* seq);
+/* Includes every finished result, waits for the ones still in flight */
+void gpu_timer_stats(int stage, struct gpu_timer_stats* s);
+/* Writes the stats of every stage, as JSON when the path ends in .json and CSV otherwise */
+int gpu_timer_dump(const char* fpath);
+/* Deletes the queries and forgets all stages */
+void gpu_timer_destroy();
+
+#endif /* ! _GPU_TIMER_H_ */
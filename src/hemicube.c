@@ -5,41 +5,68 @@
 #include <glad/glad.h>
 #include "shader_util.h"
 
-#define hres HEMICUBE_SRES
-
+/* Face rectangles in units of half the face resolution */
 static const GLint scissors[5][4] = {
-    { 3*hres/2,   hres/2, hres/2,   hres }, /* +x */
-    {        0,   hres/2, hres/2,   hres }, /* -x */
-    {   hres/2, 3*hres/2,   hres, hres/2 }, /* +y */
-    {   hres/2,        0,   hres, hres/2 }, /* -y */
-    {   hres/2,   hres/2,   hres,   hres }  /* -z */
+    { 3, 1, 1, 2 }, /* +x */
+    { 0, 1, 1, 2 }, /* -x */
+    { 1, 3, 2, 1 }, /* +y */
+    { 1, 0, 2, 1 }, /* -y */
+    { 1, 1, 2, 2 }  /* -z */
 };
 
 static const GLint viewports[5][4] = {
-    { 3*hres/2,   hres/2, hres, hres}, /* +x */
-    {  -hres/2,   hres/2, hres, hres}, /* -x */
-    {   hres/2, 3*hres/2, hres, hres}, /* +y */
-    {   hres/2,  -hres/2, hres, hres}, /* -y */
-    {   hres/2,   hres/2, hres, hres}  /* -z */
+    {  3,  1, 2, 2 }, /* +x */
+    { -1,  1, 2, 2 }, /* -x */
+    {  1,  3, 2, 2 }, /* +y */
+    {  1, -1, 2, 2 }, /* -y */
+    {  1,  1, 2, 2 }  /* -z */
 };
 
-void hemicube_rndr_init(struct hemicube_rndr* hr)
+/* Face viewport and scissor box within the current slot */
+static void face_rects(struct hemicube_rndr* hr, unsigned int face, GLint vp[4], GLint sc[4])
+{
+    GLint half = hr->sres / 2;
+    GLint ox = hr->run_st.cur_slot * 2 * hr->sres;
+    for (unsigned int i = 0; i < 4; ++i) {
+        vp[i] = viewports[face][i] * half;
+        sc[i] = scissors[face][i] * half;
+    }
+    vp[0] += ox;
+    sc[0] += ox;
+}
+
+unsigned int hemicube_rndr_max_slots(unsigned int sres)
+{
+    /* Both the color texture and the depth renderbuffer span the whole atlas */
+    GLint max_tex = 0, max_rb = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_tex);
+    glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &max_rb);
+    GLuint limit = max_tex < max_rb ? max_tex : max_rb;
+    return sres * 2 > limit ? 0 : limit / (sres * 2);
+}
+
+void hemicube_rndr_init_res(struct hemicube_rndr* hr, unsigned int slots, unsigned int sres)
 {
     GLuint fbo, col_tex, depth_rb;
 
-    /* Color buffer */
+    /* Drop the slots that would not fit the atlas */
+    unsigned int max_slots = hemicube_rndr_max_slots(sres);
+    assert(max_slots > 0);
+    slots = slots < max_slots ? slots : max_slots;
+
+    /* Color buffer, hemicube atlases are laid out horizontally one per slot */
     glGenTextures(1, &col_tex);
     glBindTexture(GL_TEXTURE_2D, col_tex);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, HEMICUBE_SRES * 2, HEMICUBE_SRES * 2, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16, sres * 2 * slots, sres * 2, 0, GL_RGBA, GL_UNSIGNED_SHORT, 0);
 
     /* Depth buffer */
     glGenRenderbuffers(1, &depth_rb);
     glBindRenderbuffer(GL_RENDERBUFFER, depth_rb);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, HEMICUBE_SRES * 2, HEMICUBE_SRES * 2);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, sres * 2 * slots, sres * 2);
 
     /* Fbo */
     glGenFramebuffers(1, &fbo);
@@ -56,12 +83,40 @@ void hemicube_rndr_init(struct hemicube_rndr* hr)
     hr->fbo = fbo;
     hr->col_tex = col_tex;
     hr->depth_rb = depth_rb;
+    hr->slots = slots;
+    hr->sres = sres;
+    hr->layered = 0;
+    hr->run_st.cur_slot = 0;
+}
+
+void hemicube_rndr_init_slots(struct hemicube_rndr* hr, unsigned int slots)
+{
+    hemicube_rndr_init_res(hr, slots, HEMICUBE_SRES);
+}
+
+void hemicube_rndr_init(struct hemicube_rndr* hr)
+{
+    hemicube_rndr_init_slots(hr, 1);
+}
+
+void hemicube_rndr_set_slot(struct hemicube_rndr* hr, unsigned int slot)
+{
+    assert(slot < hr->slots);
+    hr->run_st.cur_slot = slot;
+}
+
+void hemicube_rndr_set_layered(struct hemicube_rndr* hr, int layered)
+{
+    hr->layered = layered;
 }
 
 void hemicube_render_begin(struct hemicube_rndr* hr, const float pos[3], const float norm[3])
 {
-    memcpy(hr->run_st.pos, pos, 3 * sizeof(float));
-    memcpy(hr->run_st.norm, norm, 3 * sizeof(float));
+    /* Position and normal may be omitted when face matrices are computed elsewhere (e.g. on the gpu) */
+    if (pos && norm) {
+        memcpy(hr->run_st.pos, pos, 3 * sizeof(float));
+        memcpy(hr->run_st.norm, norm, 3 * sizeof(float));
+    }
     hr->run_st.cur_face = HF_POSITIVE_X;
     hr->run_st.prev.scissor_test = glIsEnabled(GL_SCISSOR_TEST);
     glGetIntegerv(GL_VIEWPORT, (GLint*)hr->run_st.prev.vp);
@@ -87,14 +142,32 @@ static void calc_vp_face_matrices(mat4* view, mat4* proj, enum hemicube_face fac
     *proj = mat4_perspective(radians(90.0), 0.1, 3000.0, 1.0f);
 }
 
+static void set_layered_viewports(struct hemicube_rndr* hr)
+{
+    /* Viewport i receives the primitives emitted with gl_ViewportIndex == i */
+    for (unsigned int i = 0; i < HF_MAX; ++i) {
+        GLint vp[4], sc[4];
+        face_rects(hr, i, vp, sc);
+        glViewportIndexedf(i, vp[0], vp[1], vp[2], vp[3]);
+        glScissorIndexed(i, sc[0], sc[1], sc[2], sc[3]);
+    }
+}
+
 int hemicube_render_next(struct hemicube_rndr* hr, mat4* view, mat4* proj)
 {
     if (hr->run_st.cur_face >= HF_MAX)
         return 0;
+    if (hr->layered) {
+        /* Single draw for all the faces, the geometry shader replicates each primitive per face */
+        hr->run_st.cur_face = HF_MAX;
+        set_layered_viewports(hr);
+        return 1;
+    }
     unsigned int idx = hr->run_st.cur_face++;
-    calc_vp_face_matrices(view, proj, idx, *(vec3*)hr->run_st.pos, *(vec3*) hr->run_st.norm);
-    GLint* vp = (GLint*) viewports[idx];
-    GLint* sc = (GLint*) scissors[idx];
+    if (view && proj)
+        calc_vp_face_matrices(view, proj, idx, *(vec3*)hr->run_st.pos, *(vec3*) hr->run_st.norm);
+    GLint vp[4], sc[4];
+    face_rects(hr, idx, vp, sc);
     glViewport(vp[0], vp[1], vp[2], vp[3]);
     glScissor(sc[0], sc[1], sc[2], sc[3]);
     return 1;
@@ -122,6 +195,23 @@ void hemicube_rndr_clear(struct hemicube_rndr* hr)
         glEnable(GL_SCISSOR_TEST);
 }
 
+void hemicube_rndr_clear_slots(struct hemicube_rndr* hr, unsigned int num_slots)
+{
+    assert(num_slots <= hr->slots);
+    GLint sc_test = glIsEnabled(GL_SCISSOR_TEST);
+    GLint prev_sc[4];
+    glGetIntegerv(GL_SCISSOR_BOX, prev_sc);
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(0, 0, num_slots * 2 * hr->sres, 2 * hr->sres);
+    glBindFramebuffer(GL_FRAMEBUFFER, hr->fbo);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glScissor(prev_sc[0], prev_sc[1], prev_sc[2], prev_sc[3]);
+    if (!sc_test)
+        glDisable(GL_SCISSOR_TEST);
+}
+
 void hemicube_rndr_destroy(struct hemicube_rndr* hr)
 {
     glBindFramebuffer(GL_FRAMEBUFFER, hr->fbo);
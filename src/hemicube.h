@@ -33,6 +33,7 @@
 
 #include "linalgb.h"
 
+/* Default face resolution */
 #define HEMICUBE_SRES 128
 
 enum hemicube_face {
@@ -48,21 +49,36 @@ struct hemicube_rndr {
     unsigned int fbo;
     unsigned int col_tex;
     unsigned int depth_rb;
+    /* Number of hemicubes laid out side by side in the color atlas */
+    unsigned int slots;
+    /* Face resolution, every slot takes 2 * sres squared of the atlas */
+    unsigned int sres;
+    /* Draw all faces at once through indexed viewports, face matrices are left to the shaders */
+    int layered;
     struct {
         struct {
             int vp[4];
             int scissor_test;
         } prev;
         enum hemicube_face cur_face;
+        unsigned int cur_slot;
         float pos[3], norm[3];
     } run_st;
 };
 
 void hemicube_rndr_init(struct hemicube_rndr* hr);
+void hemicube_rndr_init_slots(struct hemicube_rndr* hr, unsigned int slots);
+/* Slots are clamped to hemicube_rndr_max_slots, sres must fit at least one */
+void hemicube_rndr_init_res(struct hemicube_rndr* hr, unsigned int slots, unsigned int sres);
+/* Number of slots whose atlas fits the texture size limits, zero if a single one does not */
+unsigned int hemicube_rndr_max_slots(unsigned int sres);
+void hemicube_rndr_set_slot(struct hemicube_rndr* hr, unsigned int slot);
+void hemicube_rndr_set_layered(struct hemicube_rndr* hr, int layered);
 void hemicube_render_begin(struct hemicube_rndr* hr, const float pos[3], const float norm[3]);
 int hemicube_render_next(struct hemicube_rndr* hr, mat4* view, mat4* proj);
 void hemicube_render_end(struct hemicube_rndr* hr);
 void hemicube_rndr_clear(struct hemicube_rndr* hr);
+void hemicube_rndr_clear_slots(struct hemicube_rndr* hr, unsigned int num_slots);
 void hemicube_rndr_destroy(struct hemicube_rndr* hr);
 
 #endif /* ! _HEMICUBE_H_ */
@@ -0,0 +1,154 @@
+#include "light_grid.h"
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+
+/* Irradiance below which a light without an explicit range stops contributing */
+#define LIGHT_GRID_CUTOFF 1e-3f
+
+static float max3(const float* v)
+{
+    return fmaxf(v[0], fmaxf(v[1], v[2]));
+}
+
+/* Influence sphere of a light, ranges are measured from the centroid of area lights */
+static void light_center(const struct radiosity_light* l, float c[3])
+{
+    for (int k = 0; k < 3; ++k)
+        c[k] = l->type == RADIOSITY_LIGHT_AREA
+            ? (l->position[k] + l->corner1[k] + l->corner2[k]) / 3.0f
+            : l->position[k];
+}
+
+static float light_range(const struct radiosity_light* l)
+{
+    float power = l->intensity * max3(l->color);
+    if (l->type != RADIOSITY_LIGHT_AREA)
+        return sqrtf(fmaxf(power, 0.0f) / LIGHT_GRID_CUTOFF);
+
+    /* Seen from afar the triangle is a point of intensity radiance times area, pad by its extent */
+    float e1[3], e2[3], n[3], c[3], radius = 0.0f;
+    for (int k = 0; k < 3; ++k) {
+        e1[k] = l->corner1[k] - l->position[k];
+        e2[k] = l->corner2[k] - l->position[k];
+    }
+    n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+    float area = 0.5f * sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    light_center(l, c);
+    const float* corners[3] = { l->position, l->corner1, l->corner2 };
+    for (int i = 0; i < 3; ++i) {
+        float d[3] = { corners[i][0] - c[0], corners[i][1] - c[1], corners[i][2] - c[2] };
+        radius = fmaxf(radius, sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]));
+    }
+    return radius + sqrtf(fmaxf(power * area, 0.0f) / LIGHT_GRID_CUTOFF);
+}
+
+/* Cell range along one axis overlapped by [lo, hi] */
+static void cell_span(const struct light_grid_header* h, int axis, float lo, float hi, int* first, int* last)
+{
+    int a = (int)floorf((lo - h->bmin[axis]) * h->inv_cell_size[axis]);
+    int b = (int)floorf((hi - h->bmin[axis]) * h->inv_cell_size[axis]);
+    *first = a < 0 ? 0 : a;
+    *last = b >= h->dims[axis] ? h->dims[axis] - 1 : b;
+}
+
+static int sphere_touches_cell(const struct light_grid_header* h, const float c[3], float r, const int cell[3])
+{
+    float d2 = 0.0f;
+    for (int k = 0; k < 3; ++k) {
+        float lo = h->bmin[k] + cell[k] / h->inv_cell_size[k];
+        float hi = h->bmin[k] + (cell[k] + 1) / h->inv_cell_size[k];
+        float d = c[k] < lo ? lo - c[k] : (c[k] > hi ? c[k] - hi : 0.0f);
+        d2 += d * d;
+    }
+    return d2 <= r * r;
+}
+
+/* Adds the light to every cell its influence sphere touches, only counting the
+ * references per cell without data, returns the number of cells touched */
+static size_t bin_light(const struct light_grid_header* h, const float c[3], float r, unsigned int light, unsigned int* counts, unsigned int* data)
+{
+    int span[3][2];
+    for (int k = 0; k < 3; ++k)
+        cell_span(h, k, c[k] - r, c[k] + r, &span[k][0], &span[k][1]);
+    size_t n = 0;
+    int cell[3];
+    for (cell[2] = span[2][0]; cell[2] <= span[2][1]; ++cell[2])
+    for (cell[1] = span[1][0]; cell[1] <= span[1][1]; ++cell[1])
+    for (cell[0] = span[0][0]; cell[0] <= span[0][1]; ++cell[0]) {
+        if (!sphere_touches_cell(h, c, r, cell))
+            continue;
+        size_t i = ((size_t)cell[2] * h->dims[1] + cell[1]) * h->dims[0] + cell[0];
+        if (data)
+            data[data[2 * i] + data[2 * i + 1]++] = light;
+        else
+            ++counts[i];
+        ++n;
+    }
+    return n;
+}
+
+void light_grid_build(struct light_grid* g, struct radiosity_light* lights, unsigned int num_lights)
+{
+    memset(g, 0, sizeof(*g));
+    g->hdr.num_lights = num_lights;
+    if (num_lights == 0) {
+        /* Single empty cell, so that the buffer is never zero sized */
+        g->size = 2;
+        g->data = calloc(g->size, sizeof(unsigned int));
+        return;
+    }
+
+    /* Bounds of all influence spheres */
+    float (*centers)[3] = malloc(num_lights * sizeof(*centers));
+    float bmin[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, bmax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for (unsigned int i = 0; i < num_lights; ++i) {
+        struct radiosity_light* l = &lights[i];
+        if (l->range <= 0.0f)
+            l->range = light_range(l);
+        light_center(l, centers[i]);
+        for (int k = 0; k < 3; ++k) {
+            bmin[k] = fminf(bmin[k], centers[i][k] - l->range);
+            bmax[k] = fmaxf(bmax[k], centers[i][k] + l->range);
+        }
+    }
+
+    /* Cubic cells, LIGHT_GRID_DIM along the longest axis */
+    float extent = fmaxf(bmax[0] - bmin[0], fmaxf(bmax[1] - bmin[1], bmax[2] - bmin[2]));
+    float cell_size = extent > 0.0f ? extent / LIGHT_GRID_DIM : 1.0f;
+    for (int k = 0; k < 3; ++k) {
+        int d = (int)ceilf((bmax[k] - bmin[k]) / cell_size);
+        g->hdr.bmin[k] = bmin[k];
+        g->hdr.inv_cell_size[k] = 1.0f / cell_size;
+        g->hdr.dims[k] = d < 1 ? 1 : (d > LIGHT_GRID_DIM ? LIGHT_GRID_DIM : d);
+    }
+    size_t num_cells = (size_t)g->hdr.dims[0] * g->hdr.dims[1] * g->hdr.dims[2];
+
+    /* Count per cell, then lay out the index lists behind the cells and fill them */
+    unsigned int* counts = calloc(num_cells, sizeof(unsigned int));
+    size_t num_refs = 0;
+    for (unsigned int i = 0; i < num_lights; ++i)
+        num_refs += bin_light(&g->hdr, centers[i], lights[i].range, i, counts, 0);
+    g->size = 2 * num_cells + num_refs;
+    g->data = malloc(g->size * sizeof(unsigned int));
+    unsigned int offset = 2 * num_cells;
+    for (size_t c = 0; c < num_cells; ++c) {
+        g->data[2 * c] = offset;
+        g->data[2 * c + 1] = 0;
+        offset += counts[c];
+    }
+    for (unsigned int i = 0; i < num_lights; ++i)
+        bin_light(&g->hdr, centers[i], lights[i].range, i, 0, g->data);
+
+    free(counts);
+    free(centers);
+}
+
+void light_grid_free(struct light_grid* g)
+{
+    free(g->data);
+    memset(g, 0, sizeof(*g));
+}
@@ -0,0 +1,61 @@
+/*********************************************************************************************************************/
+/*                                                  /===-_---~~~~~~~~~------____                                     */
+/*                                                 |===-~___                _,-'                                     */
+/*                  -==\\                         `//~\\   ~~~~`---.___.-~~                                          */
+/*              ______-==|                         | |  \\           _-~`                                            */
+/*        __--~~~  ,-/-==\\                        | |   `\        ,'                                                */
+/*     _-~       /'    |  \\                      / /      \      /                                                  */
+/*   .'        /       |   \\                   /' /        \   /'                                                   */
+/*  /  ____  /         |    \`\.__/-~~ ~ \ _ _/'  /          \/'                                                     */
+/* /-'~    ~~~~~---__  |     ~-/~         ( )   /'        _--~`                                                      */
+/*                   \_|      /        _)   ;  ),   __--~~                                                           */
+/*                     '~~--_/      _-~/-  / \   '-~ \                                                               */
+/*                    {\__--_/}    / \\_>- )<__\      \                                                              */
+/*                    /'   (_/  _-~  | |__>--<__|      |                                                             */
+/*                   |0  0 _/) )-~     | |__>--<__|     |                                                            */
+/*                   / /~ ,_/       / /__>---<__/      |                                                             */
+/*                  o o _//        /-~_>---<__-~      /                                                              */
+/*                  (^(~          /~_>---<__-      _-~                                                               */
+/*                 ,/|           /__>--<__/     _-~                                                                  */
+/*              ,//('(          |__>--<__|     /                  .----_                                             */
+/*             ( ( '))          |__>--<__|    |                 /' _---_~\                                           */
+/*          `-)) )) (           |__>--<__|    |               /'  /     ~\`\                                         */
+/*         ,/,'//( (             \__>--<__\    \            /'  //        ||                                         */
+/*       ,( ( ((, ))              ~-__>--<_~-_  ~--____---~' _/'/        /'                                          */
+/*     `~/  )` ) ,/|                 ~-_~>--<_/-__       __-~ _/                                                     */
+/*   ._-~//( )/ )) `                    ~~-'_/_/ /~~~~~~~__--~                                                       */
+/*    ;'( ')/ ,)(                              ~~~~~~~~~~                                                            */
+/*   ' ') '( (/                                                                                                      */
+/*     '   '  `                                                                                                      */
+#ifndef _LIGHT_GRID_H_
+#define _LIGHT_GRID_H_
+
+#include <stddef.h>
+#include "radiosity.h"
+
+/* Cells along the longest axis of the grid */
+#define LIGHT_GRID_DIM 16
+
+/* Grid placement, leads the light list in its shader storage buffer, std430 */
+struct light_grid_header {
+    float bmin[3];
+    unsigned int num_lights;
+    float inv_cell_size[3];
+    unsigned int padding0;
+    int dims[3];
+    unsigned int padding1;
+};
+
+/* Uniform grid over the light influence spheres, so that a receiver only visits the lights that reach its cell */
+struct light_grid {
+    struct light_grid_header hdr;
+    /* First index and count of every cell, followed by the light indices the cells point at */
+    unsigned int* data;
+    size_t size;
+};
+
+/* Fills in the ranges left at zero and bins the lights, empty lists give an empty grid */
+void light_grid_build(struct light_grid* g, struct radiosity_light* lights, unsigned int num_lights);
+void light_grid_free(struct light_grid* g);
+
+#endif /* ! _LIGHT_GRID_H_ */
@@ -34,12 +34,10 @@
 
 int main(int argc, char* argv[])
 {
-    (void) argc;
-    (void) argv;
-
-    /* Initialize */
+    /* Initialize, an optional baked scene to view replaces the default one */
     struct game_context ctx;
     memset(&ctx, 0, sizeof(struct game_context));
+    ctx.scene_file = argc > 1 ? argv[1] : 0;
     game_init(&ctx);
 
     /* Setup mainloop parameters */
@@ -0,0 +1,796 @@
+#include "mesh_import.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include "file_map.h"
+
+/* Color of surfaces that specify none */
+#define MESH_DEFAULT_COLOR 0.75f
+/* Welding table slots per vertex, the table grows to stay at a load of one half */
+#define WELD_MAX_LOAD 2
+#define WELD_EMPTY 0xFFFFFFFFu
+/* Floats per vertex while welding, position, normal, color and emission */
+#define WELD_VERTEX_FLOATS 12
+/* Steps per unit of computed face normal components */
+#define FACE_NORMAL_GRID 65536.0f
+
+/* Doubles the capacity of an array until it holds need elements */
+static void* array_reserve(void* p, size_t* cap, size_t need, size_t elem_sz)
+{
+    if (need <= *cap)
+        return p;
+    size_t c = *cap ? *cap : 256;
+    while (c < need)
+        c *= 2;
+    *cap = c;
+    return realloc(p, c * elem_sz);
+}
+
+/*-----------------------------------------------------------------
+ * Vertex welding
+ *-----------------------------------------------------------------*/
+struct mesh_builder {
+    struct mesh_data* md;
+    size_t cap_vertices, cap_indices;
+    /* Open addressing table of vertex indices */
+    unsigned int* table;
+    size_t table_size;
+};
+
+static uint32_t vertex_hash(const float v[WELD_VERTEX_FLOATS])
+{
+    uint32_t bits[WELD_VERTEX_FLOATS];
+    memcpy(bits, v, sizeof(bits));
+    /* Multiply rotate per word and a final avalanche, cheap and spreads neighbouring floats */
+    uint32_t h = 0x9E3779B9u;
+    for (unsigned int i = 0; i < WELD_VERTEX_FLOATS; ++i) {
+        h ^= bits[i] * 0xCC9E2D51u;
+        h = ((h << 13) | (h >> 19)) * 5u + 0xE6546B64u;
+    }
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    return h;
+}
+
+static int vertex_equal(const struct mesh_data* md, unsigned int i, const float v[WELD_VERTEX_FLOATS])
+{
+    return memcmp(md->positions + 3 * i, v + 0, 3 * sizeof(float)) == 0
+        && memcmp(md->normals + 3 * i, v + 3, 3 * sizeof(float)) == 0
+        && memcmp(md->colors + 3 * i, v + 6, 3 * sizeof(float)) == 0
+        && memcmp(md->emissions + 3 * i, v + 9, 3 * sizeof(float)) == 0;
+}
+
+static void builder_rehash(struct mesh_builder* b, size_t table_size)
+{
+    free(b->table);
+    b->table_size = table_size;
+    b->table = malloc(table_size * sizeof(*b->table));
+    memset(b->table, 0xFF, table_size * sizeof(*b->table));
+    for (unsigned int i = 0; i < b->md->num_vertices; ++i) {
+        float v[WELD_VERTEX_FLOATS];
+        memcpy(v + 0, b->md->positions + 3 * i, 3 * sizeof(float));
+        memcpy(v + 3, b->md->normals + 3 * i, 3 * sizeof(float));
+        memcpy(v + 6, b->md->colors + 3 * i, 3 * sizeof(float));
+        memcpy(v + 9, b->md->emissions + 3 * i, 3 * sizeof(float));
+        size_t s = vertex_hash(v) & (table_size - 1);
+        while (b->table[s] != WELD_EMPTY)
+            s = (s + 1) & (table_size - 1);
+        b->table[s] = i;
+    }
+}
+
+/* The expected vertex count sizes the table up front, rehashing takes over past it */
+static void builder_init(struct mesh_builder* b, struct mesh_data* md, size_t expected_vertices)
+{
+    memset(md, 0, sizeof(*md));
+    memset(b, 0, sizeof(*b));
+    b->md = md;
+    size_t table_size = 1024;
+    while (table_size < expected_vertices * WELD_MAX_LOAD)
+        table_size *= 2;
+    builder_rehash(b, table_size);
+}
+
+/* Returns the index of the vertex with the given position, normal, color and emission, adding it if new */
+static unsigned int builder_vertex(struct mesh_builder* b, float v[WELD_VERTEX_FLOATS])
+{
+    struct mesh_data* md = b->md;
+    /* Negative zero must weld with positive zero */
+    for (unsigned int k = 0; k < WELD_VERTEX_FLOATS; ++k)
+        if (v[k] == 0.0f)
+            v[k] = 0.0f;
+
+    size_t s = vertex_hash(v) & (b->table_size - 1);
+    for (; b->table[s] != WELD_EMPTY; s = (s + 1) & (b->table_size - 1))
+        if (vertex_equal(md, b->table[s], v))
+            return b->table[s];
+
+    unsigned int i = md->num_vertices++;
+    if (md->num_vertices > b->cap_vertices) {
+        b->cap_vertices = b->cap_vertices ? 2 * b->cap_vertices : 1024;
+        md->positions = realloc(md->positions, b->cap_vertices * 3 * sizeof(float));
+        md->normals = realloc(md->normals, b->cap_vertices * 3 * sizeof(float));
+        md->colors = realloc(md->colors, b->cap_vertices * 3 * sizeof(float));
+        md->emissions = realloc(md->emissions, b->cap_vertices * 3 * sizeof(float));
+    }
+    memcpy(md->positions + 3 * i, v + 0, 3 * sizeof(float));
+    memcpy(md->normals + 3 * i, v + 3, 3 * sizeof(float));
+    memcpy(md->colors + 3 * i, v + 6, 3 * sizeof(float));
+    memcpy(md->emissions + 3 * i, v + 9, 3 * sizeof(float));
+    b->table[s] = i;
+    if (md->num_vertices * WELD_MAX_LOAD > b->table_size)
+        builder_rehash(b, b->table_size * 2);
+    return i;
+}
+
+static void builder_triangle(struct mesh_builder* b, unsigned int i0, unsigned int i1, unsigned int i2)
+{
+    /* Drop triangles that collapsed while welding */
+    if (i0 == i1 || i1 == i2 || i2 == i0)
+        return;
+    struct mesh_data* md = b->md;
+    md->indices = array_reserve(md->indices, &b->cap_indices, md->num_indices + 3, sizeof(unsigned int));
+    md->indices[md->num_indices++] = i0;
+    md->indices[md->num_indices++] = i1;
+    md->indices[md->num_indices++] = i2;
+}
+
+static void builder_finish(struct mesh_builder* b)
+{
+    free(b->table);
+    b->table = 0;
+}
+
+/* Newell normal of a polygon, stays sensible for slightly non planar faces.
+ * Corner positions are read at stride floats times the corner index. The result is
+ * snapped to a fixed grid, so that coplanar neighbours agree bit for bit and weld */
+static void polygon_normal(float n[3], const float* positions, size_t stride, const unsigned int* corners, size_t num_corners)
+{
+    n[0] = n[1] = n[2] = 0.0f;
+    for (size_t i = 0; i < num_corners; ++i) {
+        const float* a = positions + stride * corners[i];
+        const float* c = positions + stride * corners[(i + 1) % num_corners];
+        n[0] += (a[1] - c[1]) * (a[2] + c[2]);
+        n[1] += (a[2] - c[2]) * (a[0] + c[0]);
+        n[2] += (a[0] - c[0]) * (a[1] + c[1]);
+    }
+    float len = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if (len > 0.0f)
+        for (unsigned int k = 0; k < 3; ++k)
+            n[k] = roundf(n[k] / len * FACE_NORMAL_GRID) / FACE_NORMAL_GRID;
+}
+
+/*-----------------------------------------------------------------
+ * Text tokenizer, the mapped file is not null terminated
+ *-----------------------------------------------------------------*/
+struct cursor {
+    const char* p;
+    const char* end;
+};
+
+static void skip_space(struct cursor* c)
+{
+    while (c->p < c->end && (*c->p == ' ' || *c->p == '\t' || *c->p == '\r'))
+        ++c->p;
+}
+
+static void skip_line(struct cursor* c)
+{
+    const char* nl = memchr(c->p, '\n', c->end - c->p);
+    c->p = nl ? nl + 1 : c->end;
+}
+
+/* Reads the next whitespace delimited token of the current line */
+static size_t read_token(struct cursor* c, const char** tok)
+{
+    skip_space(c);
+    *tok = c->p;
+    while (c->p < c->end && *c->p != ' ' && *c->p != '\t' && *c->p != '\r' && *c->p != '\n')
+        ++c->p;
+    return c->p - *tok;
+}
+
+static int token_is(const char* tok, size_t len, const char* s)
+{
+    return strlen(s) == len && memcmp(tok, s, len) == 0;
+}
+
+static int parse_int(struct cursor* c, long* out)
+{
+    skip_space(c);
+    const char* p = c->p;
+    int neg = 0;
+    if (p < c->end && (*p == '-' || *p == '+'))
+        neg = *p++ == '-';
+    if (p == c->end || *p < '0' || *p > '9')
+        return 0;
+    long v = 0;
+    while (p < c->end && *p >= '0' && *p <= '9')
+        v = v * 10 + (*p++ - '0');
+    *out = neg ? -v : v;
+    c->p = p;
+    return 1;
+}
+
+static int parse_float(struct cursor* c, float* out)
+{
+    static const double pow10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    skip_space(c);
+    const char* p = c->p;
+    int neg = 0;
+    if (p < c->end && (*p == '-' || *p == '+'))
+        neg = *p++ == '-';
+
+    /* Mantissa digits past what a 64 bit integer holds only shift the exponent */
+    uint64_t mant = 0;
+    int exp = 0, digits = 0, any = 0;
+    for (; p < c->end && *p >= '0' && *p <= '9'; ++p, any = 1) {
+        if (digits < 19) {
+            mant = mant * 10 + (*p - '0');
+            digits += mant != 0;
+        } else {
+            ++exp;
+        }
+    }
+    if (p < c->end && *p == '.') {
+        for (++p; p < c->end && *p >= '0' && *p <= '9'; ++p, any = 1) {
+            if (digits < 19) {
+                mant = mant * 10 + (*p - '0');
+                digits += mant != 0;
+                --exp;
+            }
+        }
+    }
+    if (!any)
+        return 0;
+    if (p < c->end && (*p == 'e' || *p == 'E')) {
+        struct cursor ec = { p + 1, c->end };
+        long e;
+        if (parse_int(&ec, &e)) {
+            exp += (int)(e > 1000 ? 1000 : e < -1000 ? -1000 : e);
+            p = ec.p;
+        }
+    }
+
+    double v = (double)mant;
+    while (exp > 22) {
+        v *= 1e22;
+        exp -= 22;
+    }
+    while (exp < -22) {
+        v /= 1e22;
+        exp += 22;
+    }
+    v = exp >= 0 ? v * pow10[exp] : v / pow10[-exp];
+    *out = (float)(neg ? -v : v);
+    c->p = p;
+    return 1;
+}
+
+/*-----------------------------------------------------------------
+ * OBJ
+ *-----------------------------------------------------------------*/
+struct obj_material {
+    char name[64];
+    float kd[3];
+    float ke[3];
+};
+
+struct obj_state {
+    float* positions;           /* 3 floats per v */
+    float* colors;              /* 3 floats per v, negative when the v has no color */
+    size_t num_positions, cap_positions, cap_colors;
+    float* normals;             /* 3 floats per vn */
+    size_t num_normals, cap_normals;
+    struct obj_material* materials;
+    size_t num_materials, cap_materials;
+    float color[3];             /* Diffuse of the current material */
+    float emission[3];          /* Emissive of the current material */
+    /* Corners of the face being read */
+    unsigned int* corners;
+    long* corner_normals;
+    size_t cap_corners, cap_corner_normals;
+};
+
+static void obj_load_mtllib(struct obj_state* s, const char* obj_path, const char* name, size_t name_len)
+{
+    /* Material libraries are relative to the obj file */
+    char fpath[4096];
+    const char* sep = strrchr(obj_path, '/');
+#ifdef _WIN32
+    const char* bsep = strrchr(obj_path, '\\');
+    if (bsep > sep)
+        sep = bsep;
+#endif
+    int dir_len = sep ? (int)(sep - obj_path + 1) : 0;
+    snprintf(fpath, sizeof(fpath), "%.*s%.*s", dir_len, obj_path, (int)name_len, name);
+
+    struct file_map fm;
+    if (!file_map_open(&fm, fpath)) {
+        fprintf(stderr, "Could not open material library %s\n", fpath);
+        return;
+    }
+    struct cursor c = { fm.data, fm.data + fm.size };
+    struct obj_material* cur = 0;
+    while (c.p < c.end) {
+        const char* tok;
+        size_t len = read_token(&c, &tok);
+        if (token_is(tok, len, "newmtl")) {
+            len = read_token(&c, &tok);
+            s->materials = array_reserve(s->materials, &s->cap_materials, s->num_materials + 1, sizeof(*s->materials));
+            cur = &s->materials[s->num_materials++];
+            snprintf(cur->name, sizeof(cur->name), "%.*s", (int)len, tok);
+            cur->kd[0] = cur->kd[1] = cur->kd[2] = MESH_DEFAULT_COLOR;
+            cur->ke[0] = cur->ke[1] = cur->ke[2] = 0.0f;
+        } else if (cur && token_is(tok, len, "Kd")) {
+            for (unsigned int k = 0; k < 3; ++k)
+                if (!parse_float(&c, &cur->kd[k]))
+                    cur->kd[k] = k > 0 ? cur->kd[k - 1] : MESH_DEFAULT_COLOR;
+        } else if (cur && token_is(tok, len, "Ke")) {
+            for (unsigned int k = 0; k < 3; ++k)
+                if (!parse_float(&c, &cur->ke[k]))
+                    cur->ke[k] = k > 0 ? cur->ke[k - 1] : 0.0f;
+        }
+        skip_line(&c);
+    }
+    file_map_close(&fm);
+}
+
+static void obj_use_material(struct obj_state* s, const char* name, size_t name_len)
+{
+    s->color[0] = s->color[1] = s->color[2] = MESH_DEFAULT_COLOR;
+    s->emission[0] = s->emission[1] = s->emission[2] = 0.0f;
+    for (size_t i = 0; i < s->num_materials; ++i) {
+        if (token_is(name, name_len, s->materials[i].name)) {
+            memcpy(s->color, s->materials[i].kd, sizeof(s->color));
+            memcpy(s->emission, s->materials[i].ke, sizeof(s->emission));
+            return;
+        }
+    }
+}
+
+/* Resolves a one based, possibly negative obj index against the count read so far */
+static int obj_index(long i, size_t count, unsigned int* out)
+{
+    long r = i < 0 ? (long)count + i : i - 1;
+    if (r < 0 || (size_t)r >= count)
+        return 0;
+    *out = (unsigned int)r;
+    return 1;
+}
+
+static int obj_face(struct obj_state* s, struct mesh_builder* b, struct cursor* c)
+{
+    size_t num_corners = 0;
+    int need_face_normal = 0;
+    for (;;) {
+        skip_space(c);
+        if (c->p == c->end || *c->p == '\n' || *c->p == '#')
+            break;
+        /* v, v/vt, v//vn or v/vt/vn */
+        long v, vt, vn = 0;
+        if (!parse_int(c, &v))
+            return 0;
+        if (c->p < c->end && *c->p == '/') {
+            /* Texture coordinates are not used, lightmap uvs are generated */
+            ++c->p;
+            if (c->p < c->end && *c->p != '/' && !parse_int(c, &vt))
+                return 0;
+            if (c->p < c->end && *c->p == '/') {
+                ++c->p;
+                if (!parse_int(c, &vn))
+                    return 0;
+            }
+        }
+        s->corners = array_reserve(s->corners, &s->cap_corners, num_corners + 1, sizeof(*s->corners));
+        s->corner_normals = array_reserve(s->corner_normals, &s->cap_corner_normals, num_corners + 1, sizeof(*s->corner_normals));
+        if (!obj_index(v, s->num_positions, &s->corners[num_corners]))
+            return 0;
+        unsigned int n;
+        if (vn != 0 && obj_index(vn, s->num_normals, &n)) {
+            s->corner_normals[num_corners] = n;
+        } else {
+            s->corner_normals[num_corners] = -1;
+            need_face_normal = 1;
+        }
+        ++num_corners;
+    }
+    if (num_corners < 3)
+        return 1;
+
+    float face_n[3];
+    if (need_face_normal)
+        polygon_normal(face_n, s->positions, 3, s->corners, num_corners);
+
+    /* Weld the corners, then triangulate as a fan */
+    unsigned int first = 0, prev = 0;
+    for (size_t i = 0; i < num_corners; ++i) {
+        float vtx[WELD_VERTEX_FLOATS];
+        unsigned int p = s->corners[i];
+        memcpy(vtx, s->positions + 3 * p, 3 * sizeof(float));
+        if (s->corner_normals[i] >= 0)
+            memcpy(vtx + 3, s->normals + 3 * s->corner_normals[i], 3 * sizeof(float));
+        else
+            memcpy(vtx + 3, face_n, 3 * sizeof(float));
+        memcpy(vtx + 6, s->colors[3 * p] >= 0.0f ? s->colors + 3 * p : s->color, 3 * sizeof(float));
+        memcpy(vtx + 9, s->emission, 3 * sizeof(float));
+        unsigned int idx = builder_vertex(b, vtx);
+        if (i == 0)
+            first = idx;
+        else if (i >= 2)
+            builder_triangle(b, first, prev, idx);
+        prev = idx;
+    }
+    return 1;
+}
+
+static int obj_import(struct mesh_data* md, const char* fpath, const struct file_map* fm)
+{
+    struct obj_state s;
+    memset(&s, 0, sizeof(s));
+    s.color[0] = s.color[1] = s.color[2] = MESH_DEFAULT_COLOR;
+    struct mesh_builder b;
+    builder_init(&b, md, 0);
+
+    struct cursor c = { fm->data, fm->data + fm->size };
+    size_t line = 1;
+    int ok = 1;
+    while (c.p < c.end && ok) {
+        const char* tok;
+        size_t len = read_token(&c, &tok);
+        if (token_is(tok, len, "v")) {
+            s.positions = array_reserve(s.positions, &s.cap_positions, s.num_positions + 1, 3 * sizeof(float));
+            s.colors = array_reserve(s.colors, &s.cap_colors, s.num_positions + 1, 3 * sizeof(float));
+            float* p = s.positions + 3 * s.num_positions;
+            float* col = s.colors + 3 * s.num_positions;
+            ok = parse_float(&c, &p[0]) && parse_float(&c, &p[1]) && parse_float(&c, &p[2]);
+            /* Optional vertex colors follow the position */
+            if (!(parse_float(&c, &col[0]) && parse_float(&c, &col[1]) && parse_float(&c, &col[2])))
+                col[0] = -1.0f;
+            ++s.num_positions;
+        } else if (token_is(tok, len, "vn")) {
+            s.normals = array_reserve(s.normals, &s.cap_normals, s.num_normals + 1, 3 * sizeof(float));
+            float* n = s.normals + 3 * s.num_normals++;
+            ok = parse_float(&c, &n[0]) && parse_float(&c, &n[1]) && parse_float(&c, &n[2]);
+        } else if (token_is(tok, len, "f")) {
+            ok = obj_face(&s, &b, &c);
+        } else if (token_is(tok, len, "mtllib")) {
+            len = read_token(&c, &tok);
+            obj_load_mtllib(&s, fpath, tok, len);
+        } else if (token_is(tok, len, "usemtl")) {
+            len = read_token(&c, &tok);
+            obj_use_material(&s, tok, len);
+        }
+        if (ok) {
+            skip_line(&c);
+            ++line;
+        }
+    }
+    if (!ok)
+        fprintf(stderr, "Could not parse %s:%lu\n", fpath, (unsigned long)line);
+
+    builder_finish(&b);
+    free(s.corner_normals);
+    free(s.corners);
+    free(s.materials);
+    free(s.normals);
+    free(s.colors);
+    free(s.positions);
+    return ok;
+}
+
+/*-----------------------------------------------------------------
+ * Binary PLY
+ *-----------------------------------------------------------------*/
+enum ply_type {
+    PLY_INVALID = 0,
+    PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16, PLY_INT32, PLY_UINT32, PLY_FLOAT32, PLY_FLOAT64
+};
+
+static const struct {
+    const char* names[2];
+    unsigned int size;
+} ply_types[] = {
+    [PLY_INVALID] = { { "", "" }, 0 },
+    [PLY_INT8]    = { { "char",   "int8"    }, 1 },
+    [PLY_UINT8]   = { { "uchar",  "uint8"   }, 1 },
+    [PLY_INT16]   = { { "short",  "int16"   }, 2 },
+    [PLY_UINT16]  = { { "ushort", "uint16"  }, 2 },
+    [PLY_INT32]   = { { "int",    "int32"   }, 4 },
+    [PLY_UINT32]  = { { "uint",   "uint32"  }, 4 },
+    [PLY_FLOAT32] = { { "float",  "float32" }, 4 },
+    [PLY_FLOAT64] = { { "double", "float64" }, 8 },
+};
+
+/* Vertex properties the importer reads */
+enum ply_attrib {
+    PLY_X, PLY_Y, PLY_Z, PLY_NX, PLY_NY, PLY_NZ, PLY_RED, PLY_GREEN, PLY_BLUE, PLY_NUM_ATTRIBS, PLY_OTHER = PLY_NUM_ATTRIBS
+};
+static const char* ply_attrib_names[PLY_NUM_ATTRIBS] = { "x", "y", "z", "nx", "ny", "nz", "red", "green", "blue" };
+
+#define PLY_MAX_PROPERTIES 32
+#define PLY_MAX_ELEMENTS 8
+
+struct ply_property {
+    enum ply_type type;
+    enum ply_type count_type;   /* Set for list properties */
+    enum ply_attrib attrib;
+    int is_face_indices;
+};
+
+struct ply_element {
+    char name[32];
+    size_t count;
+    struct ply_property props[PLY_MAX_PROPERTIES];
+    unsigned int num_props;
+};
+
+static enum ply_type ply_type_parse(const char* tok, size_t len)
+{
+    for (unsigned int t = PLY_INT8; t <= PLY_FLOAT64; ++t)
+        if (token_is(tok, len, ply_types[t].names[0]) || token_is(tok, len, ply_types[t].names[1]))
+            return t;
+    return PLY_INVALID;
+}
+
+/* Little endian value at p, converted to double */
+static double ply_read(const char* p, enum ply_type t)
+{
+    union { int8_t i8; uint8_t u8; int16_t i16; uint16_t u16; int32_t i32; uint32_t u32; float f32; double f64; } v;
+    memcpy(&v, p, ply_types[t].size);
+    switch (t) {
+        case PLY_INT8:    return v.i8;
+        case PLY_UINT8:   return v.u8;
+        case PLY_INT16:   return v.i16;
+        case PLY_UINT16:  return v.u16;
+        case PLY_INT32:   return v.i32;
+        case PLY_UINT32:  return v.u32;
+        case PLY_FLOAT32: return v.f32;
+        case PLY_FLOAT64: return v.f64;
+        default:          return 0.0;
+    }
+}
+
+static int ply_parse_header(struct cursor* c, struct ply_element* elems, unsigned int* num_elems, const char* fpath)
+{
+    const char* tok;
+    size_t len = read_token(c, &tok);
+    if (!token_is(tok, len, "ply"))
+        return 0;
+    skip_line(c);
+
+    struct ply_element* cur = 0;
+    *num_elems = 0;
+    while (c->p < c->end) {
+        len = read_token(c, &tok);
+        if (token_is(tok, len, "end_header")) {
+            skip_line(c);
+            return 1;
+        } else if (token_is(tok, len, "format")) {
+            len = read_token(c, &tok);
+            if (!token_is(tok, len, "binary_little_endian")) {
+                fprintf(stderr, "Unsupported PLY format %.*s in %s, only binary_little_endian is read\n", (int)len, tok, fpath);
+                return 0;
+            }
+        } else if (token_is(tok, len, "element")) {
+            if (*num_elems == PLY_MAX_ELEMENTS)
+                return 0;
+            cur = &elems[(*num_elems)++];
+            memset(cur, 0, sizeof(*cur));
+            len = read_token(c, &tok);
+            snprintf(cur->name, sizeof(cur->name), "%.*s", (int)len, tok);
+            long count;
+            if (!parse_int(c, &count) || count < 0)
+                return 0;
+            cur->count = (size_t)count;
+        } else if (token_is(tok, len, "property")) {
+            if (!cur || cur->num_props == PLY_MAX_PROPERTIES)
+                return 0;
+            struct ply_property* prop = &cur->props[cur->num_props++];
+            memset(prop, 0, sizeof(*prop));
+            len = read_token(c, &tok);
+            if (token_is(tok, len, "list")) {
+                len = read_token(c, &tok);
+                prop->count_type = ply_type_parse(tok, len);
+                len = read_token(c, &tok);
+                if (prop->count_type == PLY_INVALID)
+                    return 0;
+            }
+            prop->type = ply_type_parse(tok, len);
+            if (prop->type == PLY_INVALID)
+                return 0;
+            len = read_token(c, &tok);
+            prop->attrib = PLY_OTHER;
+            for (unsigned int a = 0; a < PLY_NUM_ATTRIBS; ++a)
+                if (!prop->count_type && token_is(tok, len, ply_attrib_names[a]))
+                    prop->attrib = a;
+            prop->is_face_indices = prop->count_type
+                && (token_is(tok, len, "vertex_indices") || token_is(tok, len, "vertex_index"));
+        }
+        skip_line(c);
+    }
+    return 0;
+}
+
+static int ply_import(struct mesh_data* md, const char* fpath, const struct file_map* fm)
+{
+    struct cursor c = { fm->data, fm->data + fm->size };
+    struct ply_element elems[PLY_MAX_ELEMENTS];
+    unsigned int num_elems;
+    if (!ply_parse_header(&c, elems, &num_elems, fpath)) {
+        fprintf(stderr, "Could not parse PLY header of %s\n", fpath);
+        return 0;
+    }
+
+    /* Welding rarely leaves more vertices than the file lists */
+    size_t expected_vertices = 0;
+    for (unsigned int e = 0; e < num_elems; ++e)
+        if (strcmp(elems[e].name, "vertex") == 0)
+            expected_vertices = elems[e].count;
+    struct mesh_builder b;
+    builder_init(&b, md, expected_vertices);
+    /* Source vertex attributes, welded per face corner once the face normal is known */
+    float* verts = 0;
+    size_t num_verts = 0;
+    int has_normals = 0, has_colors = 0;
+    unsigned int* corners = 0;
+    size_t cap_corners = 0;
+
+    const char* p = c.p;
+    const char* end = c.end;
+    int ok = 1;
+    for (unsigned int e = 0; e < num_elems && ok; ++e) {
+        struct ply_element* el = &elems[e];
+        int is_vertex = strcmp(el->name, "vertex") == 0;
+        int is_face = strcmp(el->name, "face") == 0;
+        float color_scale[3] = { 1.0f, 1.0f, 1.0f };
+        if (is_vertex) {
+            free(verts);
+            num_verts = el->count;
+            verts = calloc(num_verts ? num_verts : 1, PLY_NUM_ATTRIBS * sizeof(float));
+            for (unsigned int i = 0; i < el->num_props; ++i) {
+                enum ply_attrib a = el->props[i].attrib;
+                has_normals |= a == PLY_NX;
+                has_colors |= a == PLY_RED;
+                /* Integer colors are normalized to their type range */
+                if (a >= PLY_RED && a <= PLY_BLUE && el->props[i].type != PLY_FLOAT32 && el->props[i].type != PLY_FLOAT64)
+                    color_scale[a - PLY_RED] = 1.0f / ((1ull << (8 * ply_types[el->props[i].type].size)) - 1);
+            }
+        }
+
+        for (size_t r = 0; r < el->count && ok; ++r) {
+            float* vtx = is_vertex ? verts + PLY_NUM_ATTRIBS * r : 0;
+            for (unsigned int i = 0; i < el->num_props && ok; ++i) {
+                struct ply_property* prop = &el->props[i];
+                unsigned int sz = ply_types[prop->type].size;
+                if (!prop->count_type) {
+                    if ((size_t)(end - p) < sz) {
+                        ok = 0;
+                        break;
+                    }
+                    if (vtx && prop->attrib != PLY_OTHER) {
+                        float v = (float)ply_read(p, prop->type);
+                        if (prop->attrib >= PLY_RED)
+                            v *= color_scale[prop->attrib - PLY_RED];
+                        vtx[prop->attrib] = v;
+                    }
+                    p += sz;
+                    continue;
+                }
+
+                unsigned int csz = ply_types[prop->count_type].size;
+                if ((size_t)(end - p) < csz) {
+                    ok = 0;
+                    break;
+                }
+                size_t n = (size_t)ply_read(p, prop->count_type);
+                p += csz;
+                if ((size_t)(end - p) < n * sz) {
+                    ok = 0;
+                    break;
+                }
+                if (!is_face || !prop->is_face_indices) {
+                    p += n * sz;
+                    continue;
+                }
+
+                /* Face, welded per corner and triangulated as a fan */
+                corners = array_reserve(corners, &cap_corners, n, sizeof(*corners));
+                for (size_t k = 0; k < n; ++k, p += sz) {
+                    double idx = ply_read(p, prop->type);
+                    if (idx < 0 || idx >= num_verts) {
+                        ok = 0;
+                        break;
+                    }
+                    corners[k] = (unsigned int)idx;
+                }
+                if (!ok || n < 3)
+                    continue;
+                float face_n[3];
+                if (!has_normals)
+                    polygon_normal(face_n, verts + PLY_X, PLY_NUM_ATTRIBS, corners, n);
+                unsigned int first = 0, prev = 0;
+                for (size_t k = 0; k < n; ++k) {
+                    const float* src = verts + PLY_NUM_ATTRIBS * corners[k];
+                    float v[WELD_VERTEX_FLOATS];
+                    memcpy(v, src + PLY_X, 3 * sizeof(float));
+                    memcpy(v + 3, has_normals ? src + PLY_NX : face_n, 3 * sizeof(float));
+                    if (has_colors)
+                        memcpy(v + 6, src + PLY_RED, 3 * sizeof(float));
+                    else
+                        v[6] = v[7] = v[8] = MESH_DEFAULT_COLOR;
+                    v[9] = v[10] = v[11] = 0.0f;
+                    unsigned int idx = builder_vertex(&b, v);
+                    if (k == 0)
+                        first = idx;
+                    else if (k >= 2)
+                        builder_triangle(&b, first, prev, idx);
+                    prev = idx;
+                }
+            }
+        }
+    }
+    if (!ok)
+        fprintf(stderr, "Truncated or invalid PLY data in %s\n", fpath);
+
+    builder_finish(&b);
+    free(corners);
+    free(verts);
+    return ok;
+}
+
+static int has_extension(const char* fpath, const char* ext)
+{
+    size_t n = strlen(fpath), e = strlen(ext);
+    if (n < e)
+        return 0;
+    for (size_t i = 0; i < e; ++i) {
+        char ch = fpath[n - e + i];
+        if (ch >= 'A' && ch <= 'Z')
+            ch += 'a' - 'A';
+        if (ch != ext[i])
+            return 0;
+    }
+    return 1;
+}
+
+int mesh_import(struct mesh_data* md, const char* fpath)
+{
+    memset(md, 0, sizeof(*md));
+    int is_obj = has_extension(fpath, ".obj");
+    if (!is_obj && !has_extension(fpath, ".ply")) {
+        fprintf(stderr, "Unknown mesh format %s, expected .obj or .ply\n", fpath);
+        return 0;
+    }
+
+    struct file_map fm;
+    if (!file_map_open(&fm, fpath)) {
+        fprintf(stderr, "Could not open %s\n", fpath);
+        return 0;
+    }
+    int ok = is_obj ? obj_import(md, fpath, &fm) : ply_import(md, fpath, &fm);
+    file_map_close(&fm);
+    if (ok && md->num_indices == 0) {
+        fprintf(stderr, "No triangles in %s\n", fpath);
+        ok = 0;
+    }
+    if (!ok)
+        mesh_data_free(md);
+    return ok;
+}
+
+void mesh_data_free(struct mesh_data* md)
+{
+    free(md->indices);
+    free(md->emissions);
+    free(md->colors);
+    free(md->normals);
+    free(md->positions);
+    memset(md, 0, sizeof(*md));
+}
@@ -1,7 +1,6 @@
 #include "opengl.h"
 #include <stdlib.h>
 #include <string.h>
-#include <stdarg.h>
 #include <stdio.h>
 
 /*-----------------------------------------------------------------
@@ -9,46 +8,25 @@
  *-----------------------------------------------------------------*/
 #define REAL_GL_FUNC(f) glad_##f
 
-/* Checks and shows last shader compile error */
-static const char* gl_check_last_compile_error(GLuint id)
-{
-    /* Check if last compile was successful */
-    GLint compile_status;
-    REAL_GL_FUNC(glGetShaderiv)(id, GL_COMPILE_STATUS, &compile_status);
-    if (compile_status == GL_FALSE) {
-        /* Gather the compile log size */
-        GLint log_length;
-        REAL_GL_FUNC(glGetShaderiv)(id, GL_INFO_LOG_LENGTH, &log_length);
-        if (log_length != 0) {
-            /* Fetch and print log */
-            GLchar* buf = calloc(1, log_length * sizeof(GLchar) + 1);
-            REAL_GL_FUNC(glGetShaderInfoLog)(id, log_length, 0, buf);
-            return buf;
-        }
-    }
-    return 0;
-}
-
-/* Checks and shows last shader link error */
-static const char* gl_check_last_link_error(GLuint id)
-{
-    /* Check if last link was successful */
-    GLint status;
-    REAL_GL_FUNC(glGetProgramiv)(id, GL_LINK_STATUS, &status);
-    if (status == GL_FALSE) {
-        /* Gather the link log size */
-        GLint log_length;
-        REAL_GL_FUNC(glGetProgramiv)(id, GL_INFO_LOG_LENGTH, &log_length);
-        if (log_length != 0) {
-            /* Fetch and print log */
-            GLchar* buf = calloc(1, log_length * sizeof(GLchar) + 1);
-            REAL_GL_FUNC(glGetProgramInfoLog)(id, log_length, 0, buf);
-            return buf;
-        }
-    }
-    return 0;
+static const char* debug_mode_names[] = {
+    [OPENGL_DEBUG_OFF]   = "off",
+    [OPENGL_DEBUG_ASYNC] = "async",
+    [OPENGL_DEBUG_SYNC]  = "sync",
+    [OPENGL_DEBUG_CHECK] = "check"
+};
+
+/* Callback data */
+static void (*showerr_cb)(void* ud, const char* msg);
+static void* showerr_ud;
+
+/* Replaces the default post call hook of the glad debug loader, which checks glGetError after every call */
+static void opengl_null_hook(const char* name, void* fptr, int len_args, ...)
+{
+    (void) name; (void) fptr; (void) len_args;
 }
 
+#ifndef OPENGL_NO_DEBUG
+
 const char* gl_error_code_desc(GLenum code)
 {
     switch (code) {
@@ -153,32 +131,17 @@ static const char* construct_opengl_debug_msg(GLenum source, GLenum type, GLuint
         "Message  : %s\n";
     size_t msg_len = snprintf(0, 0, msg_fmt, type_str, source_str, severity_str, message) + 1;
     char* msg = malloc(msg_len);
-    snprintf(msg, msg_len, msg_fmt, type_str, source_str, severity_str);
+    snprintf(msg, msg_len, msg_fmt, type_str, source_str, severity_str, message);
     return msg;
 }
 
-/* Callback data */
-static void (*showerr_cb)(void* ud, const char* msg);
-static void* showerr_ud;
+static enum opengl_debug_mode debug_mode = OPENGL_DEBUG_OFF;
 
 static inline void opengl_post_hook(const char* name, void* fptr, int len_args, ...)
 {
-    /* Shader errors */
-    const char* shdr_err = 0;
-    if (fptr == glCompileShader || fptr == glLinkProgram) {
-        GLuint s;
-        va_list l;
-        va_start(l, len_args);
-        s = va_arg(l, GLuint);
-        va_end(l);
-        if (fptr == glCompileShader)
-            shdr_err = gl_check_last_compile_error(s);
-        else if (fptr == glLinkProgram)
-            shdr_err = gl_check_last_link_error(s);
-    }
-
+    (void) fptr; (void) len_args;
     GLenum code = REAL_GL_FUNC(glGetError)();
-    if (code != GL_NO_ERROR || shdr_err) {
+    if (code != GL_NO_ERROR) {
         /* Header */
         size_t sz = 0;
         char* buf = 0;
@@ -187,19 +150,10 @@ static inline void opengl_post_hook(const char* name, void* fptr, int len_args,
         buf = realloc(buf, sz);
         snprintf(buf, sz, header_fmt, name);
 
-        /* Shader errors */
-        if (shdr_err) {
-            sz += strlen(shdr_err);
-            buf = realloc(buf, sz);
-            strcat(buf, shdr_err);
-            free((void*)shdr_err);
-            shdr_err = 0;
-        }
-
         /* Messages */
         for (;;) {
             GLint next_log_len = 0;
-            glGetIntegerv(GL_DEBUG_NEXT_LOGGED_MESSAGE_LENGTH, &next_log_len);
+            REAL_GL_FUNC(glGetIntegerv)(GL_DEBUG_NEXT_LOGGED_MESSAGE_LENGTH, &next_log_len);
             if (!next_log_len)
                 break;
             char* msg_buf = calloc(1, next_log_len);
@@ -222,9 +176,152 @@ static inline void opengl_post_hook(const char* name, void* fptr, int len_args,
     }
 }
 
+static void APIENTRY opengl_debug_cb(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message, const void* ud)
+{
+    (void) ud;
+    if (type != GL_DEBUG_TYPE_ERROR)
+        return;
+    /* The failing call is only known in synchronous mode, from the stack of this callback */
+    const char* header = "PANIC!\nOpenGL error:\n";
+    const char* msg = construct_opengl_debug_msg(source, type, id, severity, length, message);
+    size_t sz = strlen(header) + strlen(msg) + 1;
+    char* buf = malloc(sz);
+    strcpy(buf, header);
+    strcat(buf, msg);
+    free((void*)msg);
+    showerr_cb(showerr_ud, buf);
+    free(buf);
+}
+
+static int has_khr_debug()
+{
+    return HAS_OPENGL_EXTENSION(GL_KHR_debug)
+        || GL_VERSION_MAJ > 4 || (GL_VERSION_MAJ == 4 && GL_VERSION_MIN >= 3);
+}
+
+void opengl_set_debug_mode(enum opengl_debug_mode mode)
+{
+    int khr_debug = has_khr_debug();
+    if ((mode == OPENGL_DEBUG_ASYNC || mode == OPENGL_DEBUG_SYNC) && !khr_debug)
+        mode = OPENGL_DEBUG_CHECK;
+    debug_mode = mode;
+
+    if (khr_debug) {
+        /* Only errors are reported, keep the driver from formatting anything else */
+        glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, 0, GL_FALSE);
+        glDebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_ERROR, GL_DONT_CARE, 0, 0, GL_TRUE);
+        if (mode == OPENGL_DEBUG_ASYNC || mode == OPENGL_DEBUG_SYNC)
+            glDebugMessageCallback(opengl_debug_cb, 0);
+        else
+            glDebugMessageCallback(0, 0);
+        if (mode == OPENGL_DEBUG_OFF)
+            glDisable(GL_DEBUG_OUTPUT);
+        else
+            glEnable(GL_DEBUG_OUTPUT);
+        if (mode == OPENGL_DEBUG_SYNC)
+            glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+        else
+            glDisable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+    }
+
+    /* Shader compile and link errors are checked by shader_util once the program is needed */
+    glad_set_post_callback(mode == OPENGL_DEBUG_CHECK ? opengl_post_hook : opengl_null_hook);
+}
+
+enum opengl_debug_mode opengl_debug_mode()
+{
+    return debug_mode;
+}
+
+void opengl_register_error_handler(void(*cb)(void*, const char*), void* ud)
+{
+    showerr_cb = cb;
+    showerr_ud = ud;
+    opengl_set_debug_mode(has_khr_debug() ? OPENGL_DEBUG_ASYNC : OPENGL_DEBUG_CHECK);
+}
+#else
+/* Points the debug loader entry points the GL calls resolve to straight at the driver functions, skipping the
+ * call hooks. Every GL function called in this tree must be listed, any other one still works through the hooks */
+#define OPENGL_BYPASS(f) glad_debug_##f = glad_##f
+static void opengl_bypass_debug_wrappers()
+{
+    OPENGL_BYPASS(glActiveTexture); OPENGL_BYPASS(glAttachShader); OPENGL_BYPASS(glBindBuffer);
+    OPENGL_BYPASS(glBindBufferBase); OPENGL_BYPASS(glBindFramebuffer); OPENGL_BYPASS(glBindImageTexture);
+    OPENGL_BYPASS(glBindRenderbuffer); OPENGL_BYPASS(glBindTexture); OPENGL_BYPASS(glBindVertexArray);
+    OPENGL_BYPASS(glBufferData); OPENGL_BYPASS(glBufferStorage); OPENGL_BYPASS(glBufferSubData);
+    OPENGL_BYPASS(glCheckFramebufferStatus); OPENGL_BYPASS(glClear); OPENGL_BYPASS(glClearColor);
+    OPENGL_BYPASS(glClientWaitSync); OPENGL_BYPASS(glCompileShader); OPENGL_BYPASS(glCopyBufferSubData);
+    OPENGL_BYPASS(glCreateProgram); OPENGL_BYPASS(glCreateShader); OPENGL_BYPASS(glDebugMessageCallback);
+    OPENGL_BYPASS(glDebugMessageControl); OPENGL_BYPASS(glDeleteBuffers); OPENGL_BYPASS(glDeleteFramebuffers);
+    OPENGL_BYPASS(glDeleteProgram); OPENGL_BYPASS(glDeleteQueries); OPENGL_BYPASS(glDeleteRenderbuffers);
+    OPENGL_BYPASS(glDeleteShader); OPENGL_BYPASS(glDeleteSync); OPENGL_BYPASS(glDeleteTextures);
+    OPENGL_BYPASS(glDeleteVertexArrays); OPENGL_BYPASS(glDetachShader); OPENGL_BYPASS(glDisable);
+    OPENGL_BYPASS(glDispatchCompute); OPENGL_BYPASS(glDispatchComputeIndirect); OPENGL_BYPASS(glDrawArrays);
+    OPENGL_BYPASS(glDrawBuffer); OPENGL_BYPASS(glDrawBuffers); OPENGL_BYPASS(glDrawElements); OPENGL_BYPASS(glEnable);
+    OPENGL_BYPASS(glEnableVertexAttribArray); OPENGL_BYPASS(glFenceSync); OPENGL_BYPASS(glFinish);
+    OPENGL_BYPASS(glFramebufferRenderbuffer); OPENGL_BYPASS(glFramebufferTexture2D); OPENGL_BYPASS(glGenBuffers);
+    OPENGL_BYPASS(glGenFramebuffers); OPENGL_BYPASS(glGenQueries); OPENGL_BYPASS(glGenRenderbuffers);
+    OPENGL_BYPASS(glGenTextures); OPENGL_BYPASS(glGenVertexArrays); OPENGL_BYPASS(glGetActiveUniform);
+    OPENGL_BYPASS(glGetActiveUniformBlockiv); OPENGL_BYPASS(glGetAttachedShaders);
+    OPENGL_BYPASS(glGetBufferParameteriv); OPENGL_BYPASS(glGetBufferSubData); OPENGL_BYPASS(glGetDebugMessageLog);
+    OPENGL_BYPASS(glGetError); OPENGL_BYPASS(glGetIntegerv); OPENGL_BYPASS(glGetProgramBinary);
+    OPENGL_BYPASS(glGetProgramInfoLog); OPENGL_BYPASS(glGetProgramiv); OPENGL_BYPASS(glGetQueryObjectiv);
+    OPENGL_BYPASS(glGetQueryObjectui64v); OPENGL_BYPASS(glGetShaderInfoLog); OPENGL_BYPASS(glGetShaderiv);
+    OPENGL_BYPASS(glGetString); OPENGL_BYPASS(glGetStringi); OPENGL_BYPASS(glGetTexImage);
+    OPENGL_BYPASS(glGetUniformBlockIndex); OPENGL_BYPASS(glGetUniformLocation); OPENGL_BYPASS(glIsEnabled);
+    OPENGL_BYPASS(glLinkProgram); OPENGL_BYPASS(glMapBuffer); OPENGL_BYPASS(glMapBufferRange);
+    OPENGL_BYPASS(glMaxShaderCompilerThreadsARB); OPENGL_BYPASS(glMaxShaderCompilerThreadsKHR);
+    OPENGL_BYPASS(glMemoryBarrier); OPENGL_BYPASS(glPixelStorei); OPENGL_BYPASS(glProgramBinary);
+    OPENGL_BYPASS(glProgramParameteri); OPENGL_BYPASS(glQueryCounter); OPENGL_BYPASS(glRenderbufferStorage);
+    OPENGL_BYPASS(glScissor); OPENGL_BYPASS(glScissorIndexed); OPENGL_BYPASS(glShaderSource);
+    OPENGL_BYPASS(glTexImage2D); OPENGL_BYPASS(glTexParameteri); OPENGL_BYPASS(glTexSubImage2D);
+    OPENGL_BYPASS(glTextureBarrier); OPENGL_BYPASS(glUniform1i); OPENGL_BYPASS(glUniform2f);
+    OPENGL_BYPASS(glUniformBlockBinding); OPENGL_BYPASS(glUniformMatrix4fv); OPENGL_BYPASS(glUnmapBuffer);
+    OPENGL_BYPASS(glUseProgram); OPENGL_BYPASS(glVertexAttribPointer); OPENGL_BYPASS(glViewport);
+    OPENGL_BYPASS(glViewportIndexedf);
+}
+#undef OPENGL_BYPASS
+
+void opengl_set_debug_mode(enum opengl_debug_mode mode)
+{
+    (void) mode;
+    /* The glad package only ships the debug loader, release builds call around it */
+    opengl_bypass_debug_wrappers();
+    glad_set_post_callback(opengl_null_hook);
+}
+
+enum opengl_debug_mode opengl_debug_mode()
+{
+    return OPENGL_DEBUG_OFF;
+}
+
 void opengl_register_error_handler(void(*cb)(void*, const char*), void* ud)
 {
     showerr_cb = cb;
     showerr_ud = ud;
-    glad_set_post_callback(opengl_post_hook);
+    opengl_set_debug_mode(OPENGL_DEBUG_OFF);
+}
+#endif /* ! OPENGL_NO_DEBUG */
+
+void opengl_report_error(const char* msg)
+{
+    if (showerr_cb)
+        showerr_cb(showerr_ud, msg);
+    else
+        fprintf(stderr, "%s\n", msg);
+}
+
+const char* opengl_debug_mode_name(enum opengl_debug_mode mode)
+{
+    if ((unsigned)mode < sizeof(debug_mode_names) / sizeof(debug_mode_names[0]))
+        return debug_mode_names[mode];
+    return "???";
+}
+
+int opengl_debug_mode_from_name(const char* name)
+{
+    for (int i = 0; i < (int)(sizeof(debug_mode_names) / sizeof(debug_mode_names[0])); ++i)
+        if (strcmp(name, debug_mode_names[i]) == 0)
+            return i;
+    return -1;
 }
@@ -36,6 +36,23 @@
 #define GL_VERSION_MAJ GLVersion.major
 #define GL_VERSION_MIN GLVersion.minor
 #define GL_VERSION_ES GLAD_GL_ES_VERSION_2_0
+
+/* How GL errors reach the registered handler. OPENGL_NO_DEBUG compiles it all out and has the GL calls skip the
+ * glad debug wrappers once the handler is registered */
+enum opengl_debug_mode {
+    OPENGL_DEBUG_OFF,
+    OPENGL_DEBUG_ASYNC, /* KHR_debug callback, whenever the driver gets to report */
+    OPENGL_DEBUG_SYNC,  /* KHR_debug callback from within the failing call */
+    OPENGL_DEBUG_CHECK  /* glGetError after every call */
+};
+
+/* Installs the handler in asynchronous mode, or checking every call when KHR_debug is missing */
 void opengl_register_error_handler(void(*cb)(void*, const char*), void* ud);
+void opengl_set_debug_mode(enum opengl_debug_mode mode);
+enum opengl_debug_mode opengl_debug_mode();
+const char* opengl_debug_mode_name(enum opengl_debug_mode mode);
+int opengl_debug_mode_from_name(const char* name);
+/* Hands an error found outside of the GL calls themselves to the registered handler */
+void opengl_report_error(const char* msg);
 
 #endif /* ! _OPENGL_H_ */
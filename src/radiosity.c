@@ -1,14 +1,34 @@
 #include "radiosity.h"
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 #include <assert.h>
 #include <math.h>
 #include <linalgb.h>
 #include "opengl.h"
 #include "hemicube.h"
+#include "gpu_timer.h"
+#include "bvh.h"
+#include "light_grid.h"
 #include "shader_util.h"
 #include <stdio.h>
 
 #define array_length(a) (sizeof(a)/sizeof(a[0]))
+/* Local size of the lightmap wide compute passes */
+#define RADIOSITY_GROUP_SIZE 16
+/* Candidate groups merged into one by each workgroup of a shooter selection merge pass */
+#define RADIOSITY_MERGE_WIDTH (RADIOSITY_GROUP_SIZE * RADIOSITY_GROUP_SIZE)
+/* Number of residual energy readbacks that can be in flight */
+#define RESIDUAL_READBACK_RING 4
+/* Number of lightmap readbacks that can be in flight */
+#define LIGHTMAP_READBACK_RING 3
+/* Textures that make up a checkpoint, see state_texs */
+#define STATE_NUM_TEXTURES 5
+#define STATE_MAGIC "TRCK"
+#define STATE_VERSION 5
+/* Uniform buffer binding of the solver constants, see struct solver_params */
+#define SOLVER_PARAMS_BINDING 0
 
 static struct {
     unsigned int lm_width, lm_height;
@@ -16,17 +36,98 @@ static struct {
     GLuint attributes_shdr;
     GLuint max_pass_shdr;
     GLuint vis_pass_shdr;
+    GLuint vis_layered_shdr;
+    GLuint view_proj_shdr;
     GLuint radiosity_shdr;
-    GLuint texel_set_shdr;
+    GLuint texel_list_shdr;
     GLuint radiosity_tex;
     GLuint unshot_tex;
     GLuint position_tex;
     GLuint normal_tex;
     GLuint albedo_tex;
+    /* Texels covered by charts and the indirect dispatch over them, built after the attribute pass */
+    GLuint texel_list_buf;
+    /* Packed receiver attributes of the listed texels */
+    GLuint texel_record_buf;
     GLuint max_pass_buf;
+    /* Second candidate buffer, merge passes ping pong between the two */
+    GLuint max_merge_buf;
     GLuint shooter_info_buf;
+    GLuint view_proj_buf;
+    /* Constants of the compute passes, uploaded once per gi pass */
+    GLuint params_buf;
+    /* Ray cast visibility acceleration structure */
+    GLuint bvh_node_buf;
+    GLuint bvh_tri_buf;
+    /* Grid header and light list, and the per cell light indices, read by the attribute pass */
+    GLuint light_buf;
+    GLuint light_grid_buf;
+    struct radiosity_light* lights;
+    unsigned int num_lights;
+    /* World space area of a texel, the shooter patch area of the form factor */
+    float texel_area;
+    /* Uniforms that change per dispatch or per draw, resolved once the shaders are linked */
+    struct {
+        struct shader_uniform half_pixel_size;
+        struct shader_uniform pass, level, final_pass;
+        struct shader_uniform vis_model, face_index;
+        struct shader_uniform vis_layered_model, shooter_index;
+    } u;
+    int vis_mode;
+    int accum_fmt;
     struct hemicube_rndr hemi_rndr;
     int attrib_pass;
+    int gi_pass_active;
+    /* Number of shooters selected and shot per gi pass, the requested one limited to the hemicube atlas slots */
+    int batch_size;
+    int batch_request;
+    /* Shooters selected since the attribute pass, as of the last residual readback */
+    unsigned long iterations;
+    /* Gi passes since the attribute pass, seeds the stochastic rounding of the accumulation */
+    unsigned long passes;
+    /* Convergence tracking */
+    float initial_energy;
+    float residual_energy;
+    float threshold;
+    int converged;
+    int residual_known;
+    /* Unshot totals copied out of the shooter info and fetched once their fences signal */
+    struct {
+        GLuint buf;
+        GLsync fences[RESIDUAL_READBACK_RING];
+        unsigned int head, tail;
+    } residual_rb;
+    /* Gpu timer stages */
+    struct {
+        int attributes, next_shooter, view_proj, visibility, light_transfer;
+    } timers;
+    /* Checkpoint in flight, texture copies land in the pbos and get written once the fence signals */
+    struct {
+        GLuint pbos[STATE_NUM_TEXTURES];
+        GLsync fence;
+        char fpath[512];
+        /* Shooter counts as of the snapshot, copied along with the textures */
+        GLuint counts_buf;
+        unsigned long passes;
+        float initial_energy;
+        int residual_known;
+    } ckpt;
+    /* Scene and lights the saved states belong to, see radiosity_set_state_key */
+    unsigned long long state_key;
+    /* Lightmap copies queued into pbos, handed out in order once their fences signal */
+    struct {
+        GLuint pbos[LIGHTMAP_READBACK_RING];
+        /* Persistent mappings, null when buffer storage is not available */
+        void* ptrs[LIGHTMAP_READBACK_RING];
+        GLsync fences[LIGHTMAP_READBACK_RING];
+        /* Shooter counts copied along with each lightmap, one struct shooter_counts per slot */
+        GLuint counts_buf;
+        unsigned long iterations[LIGHTMAP_READBACK_RING];
+        unsigned int head, tail;
+        /* Tail slot is out with the caller until released */
+        int acquired;
+        const float* acquired_data;
+    } lm_rb;
 } st;
 
 struct shooter_info {
@@ -39,33 +140,188 @@ struct shooter_info {
     float unshot[4];
 };
 
+/* Formats the radiosity and unshot textures can be kept in, see enum radiosity_accum_format */
+static const struct accum_format {
+    const char* name;
+    GLint ifmt;
+    /* Image format layout qualifier of the compute passes */
+    const char* qualifier;
+    /* Mantissa bits per channel of formats that need stochastic rounding in the transfer pass */
+    const char* mantissa_bits;
+    /* Native pixel transfer format */
+    GLenum fmt;
+    GLenum type;
+    unsigned int texel_sz;
+} accum_formats[] = {
+    { "rgba16f",    GL_RGBA16F,        "rgba16f",        0,                      GL_RGBA, GL_HALF_FLOAT,                   8 },
+    { "r11g11b10f", GL_R11F_G11F_B10F, "r11f_g11f_b10f", "vec3(6.0, 6.0, 5.0)",  GL_RGB,  GL_UNSIGNED_INT_10F_11F_11F_REV, 4 },
+    { "rgba32f",    GL_RGBA32F,        "rgba32f",        0,                      GL_RGBA, GL_FLOAT,                       16 }
+};
+
+/* Per work group candidates of the shooter selection, see max.comp */
+struct max_pass_group {
+    int coords[RADIOSITY_MAX_BATCH][2];
+    float lum[RADIOSITY_MAX_BATCH];
+    float sum_lum;
+    float padding0;
+};
+
+/* Head of the texel list buffer, followed by one packed x | y << 16 coordinate per texel */
+struct texel_list {
+    GLuint num_groups_x;
+    GLuint num_groups_y;
+    GLuint num_groups_z;
+    GLuint num_texels;
+};
+
+/* Receiver attributes gathered from the attribute textures in list order, see texel_list.comp */
+struct texel_record {
+    float position[3];
+    GLuint normal;
+    GLuint albedo;
+    GLuint texel;
+    GLuint padding0[2];
+};
+
+/* Uniform block shared by the compute passes, std140 */
+struct solver_params {
+    GLint lightmap_size[2];
+    GLint batch_size;
+    GLint hemicube_size;
+    GLint raycast;
+    GLuint seed;
+    GLfloat texel_area;
+    GLint padding0;
+};
+
+/* Leading part of struct shooter_batch, what the residual readbacks and checkpoints copy out */
+struct shooter_counts {
+    float unshot_total;
+    int num_shooters;
+    /* Running total of the shooters selected by the final max pass */
+    GLuint total_shooters;
+    GLint padding0;
+};
+
+struct shooter_batch {
+    struct shooter_counts counts;
+    struct shooter_info shooters[RADIOSITY_MAX_BATCH];
+};
+
+/* Work groups covering the lightmap along one dimension */
+static unsigned int num_groups(unsigned int n)
+{
+    return (n + RADIOSITY_GROUP_SIZE - 1) / RADIOSITY_GROUP_SIZE;
+}
+
+/* Work groups over the texel list when every texel is covered */
+static unsigned int num_list_groups()
+{
+    const unsigned int group_texels = RADIOSITY_GROUP_SIZE * RADIOSITY_GROUP_SIZE;
+    return (st.lm_width * st.lm_height + group_texels - 1) / group_texels;
+}
+
+/* Creates the radiosity and unshot textures in the current format and attaches them to the bound framebuffer */
+static void accum_textures_create()
+{
+    const struct accum_format* af = &accum_formats[st.accum_fmt];
+    GLuint* ids[] = { &st.radiosity_tex, &st.unshot_tex };
+    for (size_t i = 0; i < array_length(ids); ++i) {
+        glGenTextures(1, ids[i]);
+        glBindTexture(GL_TEXTURE_2D, *ids[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, af->ifmt, st.lm_width, st.lm_height, 0, af->fmt, af->type, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, *ids[i], 0);
+    }
+}
+
+/* Passes that access the radiosity and unshot textures as images are built for the current format,
+ * together with any other deferred program loads */
+static void accum_shaders_load()
+{
+    const struct accum_format* af = &accum_formats[st.accum_fmt];
+    char defines[128];
+    int len = snprintf(defines, sizeof(defines), "#define ACCUM_FORMAT %s\n", af->qualifier);
+    if (af->mantissa_bits)
+        snprintf(defines + len, sizeof(defines) - len, "#define ACCUM_MANTISSA_BITS %s\n", af->mantissa_bits);
+    st.max_pass_shdr = shader_load_deferred(&(struct shader_files){
+        .cs_loc = "res/shaders/max.comp",
+        .defines = defines});
+    st.radiosity_shdr = shader_load_deferred(&(struct shader_files){
+        .cs_loc = "res/shaders/radiosity.comp",
+        .defines = defines});
+    shader_finish();
+    shader_reflect(st.max_pass_shdr, (struct shader_uniform_ref[]){
+        {"pass",       &st.u.pass},
+        {"level",      &st.u.level},
+        {"final_pass", &st.u.final_pass}}, 3, 0, 0);
+}
+
+static void solver_params_update()
+{
+    struct solver_params p = {
+        .lightmap_size = { st.lm_width, st.lm_height },
+        .batch_size    = st.batch_size,
+        .hemicube_size = 2 * st.hemi_rndr.sres,
+        .raycast       = st.vis_mode == RADIOSITY_VIS_RAYCAST,
+        .seed          = st.passes,
+        .texel_area    = st.texel_area
+    };
+    glBindBuffer(GL_UNIFORM_BUFFER, st.params_buf);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(p), &p);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
 void radiosity_init(int width, int height)
 {
     memset(&st, 0, sizeof(st));
     st.attrib_pass = 0;
+    st.threshold = RADIOSITY_DEFAULT_THRESHOLD;
+    st.batch_size = st.batch_request = 1;
+    st.texel_area = RADIOSITY_DEFAULT_TEXEL_AREA;
+    st.timers.attributes     = gpu_timer_stage("attributes");
+    st.timers.next_shooter   = gpu_timer_stage("next_shooter");
+    st.timers.view_proj      = gpu_timer_stage("view_proj");
+    st.timers.visibility     = gpu_timer_stage("visibility");
+    st.timers.light_transfer = gpu_timer_stage("light_transfer");
 
     /* Store dimensions */
     st.lm_width  = width;
     st.lm_height = height;
 
-    /* Load shaders */
-    st.attributes_shdr = shader_load(&(struct shader_files){
+    /* Load shaders, every compile is in flight before the first status query */
+    st.attributes_shdr = shader_load_deferred(&(struct shader_files){
         .vs_loc = "res/shaders/attributes.vert",
         .gs_loc = "res/shaders/attributes.geom",
         .fs_loc = "res/shaders/attributes.frag"});
 
-    st.max_pass_shdr = shader_load(&(struct shader_files){
-        .cs_loc = "res/shaders/max.comp"});
-
-    st.vis_pass_shdr = shader_load(&(struct shader_files){
+    st.vis_pass_shdr = shader_load_deferred(&(struct shader_files){
         .vs_loc = "res/shaders/visibility.vert",
         .fs_loc = "res/shaders/visibility.frag"});
 
-    st.radiosity_shdr = shader_load(&(struct shader_files){
-        .cs_loc = "res/shaders/radiosity.comp"});
+    st.vis_layered_shdr = shader_load_deferred(&(struct shader_files){
+        .vs_loc = "res/shaders/visibility_layered.vert",
+        .gs_loc = "res/shaders/visibility.geom",
+        .fs_loc = "res/shaders/visibility.frag"});
+
+    st.view_proj_shdr = shader_load_deferred(&(struct shader_files){
+        .cs_loc = "res/shaders/view_proj.comp"});
+
+    st.texel_list_shdr = shader_load_deferred(&(struct shader_files){
+        .cs_loc = "res/shaders/texel_list.comp"});
 
-    st.texel_set_shdr = shader_load(&(struct shader_files){
-        .cs_loc = "res/shaders/texel_set.comp"});
+    accum_shaders_load();
+    radiosity_set_lights(0, 0);
+
+    shader_reflect(st.attributes_shdr, (struct shader_uniform_ref[]){
+        {"half_pixel_size", &st.u.half_pixel_size}}, 1, 0, 0);
+    shader_reflect(st.vis_pass_shdr, (struct shader_uniform_ref[]){
+        {"model",      &st.u.vis_model},
+        {"face_index", &st.u.face_index}}, 2, 0, 0);
+    shader_reflect(st.vis_layered_shdr, (struct shader_uniform_ref[]){
+        {"model",         &st.u.vis_layered_model},
+        {"shooter_index", &st.u.shooter_index}}, 2, 0, 0);
 
     /* Create framebuffer */
     glGenFramebuffers(1, &st.fbo);
@@ -79,23 +335,9 @@ void radiosity_init(int width, int height)
         GLenum pix_dtype;
         GLenum attachment;
     } data_texs[] = {
-        {
-            &st.radiosity_tex,
-            GL_RGBA16F,
-            GL_RGBA,
-            GL_FLOAT,
-            GL_COLOR_ATTACHMENT0
-        },
-        {
-            &st.unshot_tex,
-            GL_RGBA16F,
-            GL_RGBA,
-            GL_FLOAT,
-            GL_COLOR_ATTACHMENT1
-        },
         {
             &st.position_tex,
-            GL_RGBA16F,
+            GL_RGBA32F,
             GL_RGBA,
             GL_FLOAT,
             GL_COLOR_ATTACHMENT2
@@ -128,21 +370,52 @@ void radiosity_init(int width, int height)
         glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
         glFramebufferTexture2D(GL_FRAMEBUFFER, data_texs[i].attachment, target, *(data_texs[i].id), 0);
     }
+    accum_textures_create();
     assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
 
+    /* Create shader buffer for the list of covered texels, sized for a fully covered lightmap */
+    glGenBuffers(1, &st.texel_list_buf);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, st.texel_list_buf);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(struct texel_list) + (size_t)width * height * sizeof(GLuint), 0, GL_DYNAMIC_COPY);
+    glGenBuffers(1, &st.texel_record_buf);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, st.texel_record_buf);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (size_t)width * height * sizeof(struct texel_record), 0, GL_DYNAMIC_COPY);
+
     /* Create shader buffer for shooter seletion pass */
-    const size_t num_work_groups = ceil(st.lm_width / 16) * ceil(st.lm_height / 16);
+    const size_t num_work_groups = num_list_groups();
     glGenBuffers(1, &st.max_pass_buf);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, st.max_pass_buf);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, num_work_groups * (2 * sizeof(int) + sizeof(float)), 0, GL_DYNAMIC_COPY);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, num_work_groups * sizeof(struct max_pass_group), 0, GL_DYNAMIC_COPY);
+    const size_t num_merge_groups = (num_work_groups + RADIOSITY_MERGE_WIDTH - 1) / RADIOSITY_MERGE_WIDTH;
+    glGenBuffers(1, &st.max_merge_buf);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, st.max_merge_buf);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, num_merge_groups * sizeof(struct max_pass_group), 0, GL_DYNAMIC_COPY);
 
     /* Create shader buffer for the shooter info */
     glGenBuffers(1, &st.shooter_info_buf);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, st.shooter_info_buf);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(struct shooter_info), 0, GL_DYNAMIC_COPY);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(struct shooter_batch), 0, GL_DYNAMIC_COPY);
+
+    /* Create shader buffer for the hemicube face view projection matrices of each shooter */
+    glGenBuffers(1, &st.view_proj_buf);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, st.view_proj_buf);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, 5 * RADIOSITY_MAX_BATCH * sizeof(mat4), 0, GL_DYNAMIC_COPY);
+
+    /* Create uniform buffer for the constants of the compute passes */
+    glGenBuffers(1, &st.params_buf);
+    glBindBuffer(GL_UNIFORM_BUFFER, st.params_buf);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(struct solver_params), 0, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
 
-    /* Initialize hemicube renderer instance */
-    hemicube_rndr_init(&st.hemi_rndr);
+    /* Create readback buffer for the unshot energy totals */
+    glGenBuffers(1, &st.residual_rb.buf);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, st.residual_rb.buf);
+    glBufferData(GL_COPY_WRITE_BUFFER, RESIDUAL_READBACK_RING * sizeof(struct shooter_counts), 0, GL_STREAM_READ);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    /* Initialize hemicube renderer instance, one atlas slot per batched shooter */
+    hemicube_rndr_init_slots(&st.hemi_rndr, RADIOSITY_MAX_BATCH);
+    hemicube_rndr_set_layered(&st.hemi_rndr, 1);
 
     /* Unbind stuff */
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
@@ -150,11 +423,66 @@ void radiosity_init(int width, int height)
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
+/* Restarts the running shooter total of the max pass from the given count */
+static void shooter_total_reset(unsigned long total)
+{
+    GLuint t = (GLuint)total;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, st.shooter_info_buf);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, offsetof(struct shooter_counts, total_shooters), sizeof(t), &t);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+static void residual_readback_reset()
+{
+    for (unsigned int i = 0; i < RESIDUAL_READBACK_RING; ++i) {
+        if (st.residual_rb.fences[i])
+            glDeleteSync(st.residual_rb.fences[i]);
+        st.residual_rb.fences[i] = 0;
+    }
+    st.residual_rb.head = st.residual_rb.tail = 0;
+}
+
+static void lightmap_readback_destroy()
+{
+    if (st.lm_rb.acquired)
+        radiosity_readback_release();
+    for (unsigned int i = 0; i < LIGHTMAP_READBACK_RING; ++i) {
+        if (st.lm_rb.fences[i])
+            glDeleteSync(st.lm_rb.fences[i]);
+        if (st.lm_rb.ptrs[i]) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, st.lm_rb.pbos[i]);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (st.lm_rb.pbos[0])
+        glDeleteBuffers(LIGHTMAP_READBACK_RING, st.lm_rb.pbos);
+    glDeleteBuffers(1, &st.lm_rb.counts_buf);
+    memset(&st.lm_rb, 0, sizeof(st.lm_rb));
+}
+
 void radiosity_destroy()
 {
+    lightmap_readback_destroy();
+    radiosity_checkpoint_poll(1);
+    if (st.ckpt.pbos[0])
+        glDeleteBuffers(STATE_NUM_TEXTURES, st.ckpt.pbos);
+    glDeleteBuffers(1, &st.ckpt.counts_buf);
+    residual_readback_reset();
     hemicube_rndr_destroy(&st.hemi_rndr);
+    glDeleteBuffers(1, &st.bvh_tri_buf);
+    glDeleteBuffers(1, &st.bvh_node_buf);
+    glDeleteBuffers(1, &st.light_grid_buf);
+    glDeleteBuffers(1, &st.light_buf);
+    free(st.lights);
+    glDeleteBuffers(1, &st.residual_rb.buf);
+    glDeleteBuffers(1, &st.params_buf);
+    glDeleteBuffers(1, &st.view_proj_buf);
     glDeleteBuffers(1, &st.shooter_info_buf);
+    glDeleteBuffers(1, &st.max_merge_buf);
     glDeleteBuffers(1, &st.max_pass_buf);
+    glDeleteBuffers(1, &st.texel_record_buf);
+    glDeleteBuffers(1, &st.texel_list_buf);
     GLuint textures[] = {
         st.radiosity_tex,
         st.unshot_tex,
@@ -164,13 +492,43 @@ void radiosity_destroy()
     };
     glDeleteTextures(array_length(textures), textures);
     glDeleteFramebuffers(1, &st.fbo);
-    glDeleteProgram(st.texel_set_shdr);
+    glDeleteProgram(st.texel_list_shdr);
+    glDeleteProgram(st.view_proj_shdr);
     glDeleteProgram(st.radiosity_shdr);
+    glDeleteProgram(st.vis_layered_shdr);
     glDeleteProgram(st.vis_pass_shdr);
     glDeleteProgram(st.max_pass_shdr);
     glDeleteProgram(st.attributes_shdr);
 }
 
+static void texel_list_build()
+{
+    /* Texels outside the charts never shoot nor receive, later passes only dispatch over the covered ones */
+    struct texel_list head = { 0, 1, 1, 0 };
+    solver_params_update();
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, st.texel_list_buf);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(head), &head);
+
+    GLuint shdr = st.texel_list_shdr;
+    glUseProgram(shdr);
+    GLuint data_tex[] = {
+        st.position_tex,
+        st.normal_tex,
+        st.albedo_tex
+    };
+    for (unsigned int i = 0; i < array_length(data_tex); ++i) {
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_2D, data_tex[i]);
+    }
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, st.texel_list_buf);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, st.texel_record_buf);
+    glBindBufferBase(GL_UNIFORM_BUFFER, SOLVER_PARAMS_BINDING, st.params_buf);
+    glDispatchCompute(num_groups(st.lm_width), num_groups(st.lm_height), 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glUseProgram(0);
+}
+
 static struct {
     GLuint prev_fbo;
     GLint prev_vp[4];
@@ -180,6 +538,7 @@ void radiosity_attrib_pass_begin()
 {
     if (st.attrib_pass)
         return;
+    gpu_timer_begin(st.timers.attributes);
 
     /* Store previous values */
     glGetIntegerv(GL_VIEWPORT, attrib_pass.prev_vp);
@@ -199,6 +558,8 @@ void radiosity_attrib_pass_begin()
     glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glUseProgram(st.attributes_shdr);
+    glUniform2f(st.u.half_pixel_size.loc, 1.0f / st.lm_width, 1.0f / st.lm_height);
+    radiosity_bind_lights();
 }
 
 void radiosity_attrib_pass_end()
@@ -211,10 +572,21 @@ void radiosity_attrib_pass_end()
     glViewport(vp[0], vp[1], vp[2], vp[3]);
     glBindFramebuffer(GL_FRAMEBUFFER, attrib_pass.prev_fbo);
     st.attrib_pass = 1;
+    texel_list_build();
+    gpu_timer_end(st.timers.attributes);
+
+    /* Fresh unshot values, initial energy is gathered on the next shooter selection */
+    residual_readback_reset();
+    shooter_total_reset(0);
+    st.iterations = st.passes = 0;
+    st.initial_energy = st.residual_energy = 0.0f;
+    st.residual_known = 0;
+    st.converged = 0;
 }
 
 void radiosity_next_shooter_pass()
 {
+    gpu_timer_begin(st.timers.next_shooter);
     GLuint shdr = st.max_pass_shdr;
     glUseProgram(shdr);
 
@@ -227,142 +599,814 @@ void radiosity_next_shooter_pass()
         glBindTexture(GL_TEXTURE_2D, data_tex[i]);
     }
 
-    glBindImageTexture(0, st.unshot_tex, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA16F);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, st.max_pass_buf);
+    glBindImageTexture(0, st.unshot_tex, 0, GL_FALSE, 0, GL_READ_WRITE, accum_formats[st.accum_fmt].ifmt);
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, st.shooter_info_buf);
-    glUniform1i(glGetUniformLocation(shdr, "pass"), 0);
-    glDispatchCompute(ceil(st.lm_width / 16), ceil(st.lm_height / 16), 1);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, st.texel_list_buf);
+    glBindBufferBase(GL_UNIFORM_BUFFER, SOLVER_PARAMS_BINDING, st.params_buf);
 
-    glMemoryBarrier(GL_ALL_BARRIER_BITS); /* TODO: Use proper barrier */
-    glUniform1i(glGetUniformLocation(shdr, "pass"), 1);
-    glDispatchCompute(1, 1, 1);
+    /* Top candidates of every group of covered texels */
+    GLuint bufs[2] = { st.max_pass_buf, st.max_merge_buf };
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, bufs[0]);
+    glUniform1i(st.u.pass.loc, 0);
+    glUniform1i(st.u.final_pass.loc, 0);
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, st.texel_list_buf);
+    glDispatchComputeIndirect(0);
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+
+    /* Merge candidate groups a workgroup at a time until a single one is left, which writes the shooters.
+     * The number of groups is only known to the gpu, so the levels are laid out for a fully covered lightmap */
+    glUniform1i(st.u.pass.loc, 1);
+    unsigned int num_inputs = num_list_groups();
+    for (unsigned int level = 0;; ++level) {
+        unsigned int num_outputs = (num_inputs + RADIOSITY_MERGE_WIDTH - 1) / RADIOSITY_MERGE_WIDTH;
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, bufs[level & 1]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, bufs[(level + 1) & 1]);
+        glUniform1i(st.u.level.loc, level);
+        glUniform1i(st.u.final_pass.loc, num_outputs == 1);
+        glDispatchCompute(num_outputs, 1, 1);
+        if (num_outputs == 1)
+            break;
+        num_inputs = num_outputs;
+    }
 
     glMemoryBarrier(GL_ALL_BARRIER_BITS); /* TODO: Use proper barrier */
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
     glUseProgram(0);
+    gpu_timer_end(st.timers.next_shooter);
+}
+
+void radiosity_view_proj_pass()
+{
+    /* Build the hemicube face matrices of the selected shooters without leaving the gpu */
+    gpu_timer_begin(st.timers.view_proj);
+    glUseProgram(st.view_proj_shdr);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, st.shooter_info_buf);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, st.view_proj_buf);
+    glDispatchCompute(1, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glUseProgram(0);
+    gpu_timer_end(st.timers.view_proj);
+}
+
+static void residual_update(float unshot_total)
+{
+    /* First selection after the attribute pass holds the emitted energy */
+    if (!st.residual_known) {
+        st.initial_energy = unshot_total;
+        st.residual_known = 1;
+    }
+    st.residual_energy = unshot_total;
+    float residual = st.initial_energy > 0.0f ? st.residual_energy / st.initial_energy : 0.0f;
+    st.converged = residual <= st.threshold;
+}
+
+static void residual_readback_poll()
+{
+    /* Consume every readback that already completed, never wait on the gpu */
+    while (st.residual_rb.fences[st.residual_rb.tail]) {
+        unsigned int slot = st.residual_rb.tail;
+        GLenum r = glClientWaitSync(st.residual_rb.fences[slot], 0, 0);
+        if (r != GL_ALREADY_SIGNALED && r != GL_CONDITION_SATISFIED)
+            break;
+        glDeleteSync(st.residual_rb.fences[slot]);
+        st.residual_rb.fences[slot] = 0;
+        st.residual_rb.tail = (slot + 1) % RESIDUAL_READBACK_RING;
+
+        struct shooter_counts c;
+        glBindBuffer(GL_COPY_READ_BUFFER, st.residual_rb.buf);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, slot * sizeof(c), sizeof(c), &c);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        residual_update(c.unshot_total);
+        st.iterations = c.total_shooters;
+    }
+}
+
+static void residual_readback_push()
+{
+    /* Skip this sample if the ring is full, a later pass will catch up */
+    unsigned int slot = st.residual_rb.head;
+    if (st.residual_rb.fences[slot])
+        return;
+    glBindBuffer(GL_COPY_READ_BUFFER, st.shooter_info_buf);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, st.residual_rb.buf);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, slot * sizeof(struct shooter_counts), sizeof(struct shooter_counts));
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    st.residual_rb.fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    st.residual_rb.head = (slot + 1) % RESIDUAL_READBACK_RING;
 }
 
 static struct {
     GLuint prev_fbo;
     GLint prev_vp[4];
     GLint cur_face;
-    mat4 view_proj[5];
+    GLint cur_shooter;
 } vis_pass;
 
-static struct shooter_info si;
+static void radiosity_visibility_shooter_begin(int shooter)
+{
+    /* Render shooter visibility texture, face matrices already live in the view_proj buffer */
+    hemicube_rndr_set_slot(&st.hemi_rndr, shooter);
+    hemicube_render_begin(&st.hemi_rndr, 0, 0);
+    vis_pass.cur_face = 0;
+}
 
 void radiosity_visibility_pass_begin()
 {
+    gpu_timer_begin(st.timers.visibility);
     /* Store previous values */
     glGetIntegerv(GL_VIEWPORT, vis_pass.prev_vp);
     glGetIntegerv(GL_FRAMEBUFFER_BINDING, (GLint*)&vis_pass.prev_fbo);
 
-    /* Gather next shooter info to construct view matrix */
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, st.shooter_info_buf);
-    GLvoid* p = glMapBuffer(GL_SHADER_STORAGE_BUFFER, GL_READ_WRITE);
-    memcpy(&si, p, sizeof(si));
-    glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
-    /*
-    printf("(%.2f %.2f %.2f), (%.2f %.2f %.2f)\n",
-            si.position[0], si.position[1], si.position[2],
-            si.normal[0], si.normal[1], si.normal[2]);
-     */
-
-    /* Render shooter visibility texture */
-    hemicube_rndr_clear(&st.hemi_rndr);
-
-    /* Push it up a notch ?? */
-    /*
-    vec3 nnm = vec3_normalize(*(vec3*)si.normal);
-    vec3 npos = vec3_add(*(vec3*)si.position, vec3_mul(nnm, 0.05));
-    hemicube_render_begin(&st.hemi_rndr, npos.xyz, nnm.xyz);
-     */
-    hemicube_render_begin(&st.hemi_rndr, si.position, si.normal);
-    glUseProgram(st.vis_pass_shdr);
-    vis_pass.cur_face = 0;
+    /* Clear the visibility textures of the whole batch at once */
+    hemicube_rndr_clear_slots(&st.hemi_rndr, st.batch_size);
+    GLuint shdr = st.hemi_rndr.layered ? st.vis_layered_shdr : st.vis_pass_shdr;
+    glUseProgram(shdr);
+    mat4 modl = mat4_id();
+    glUniformMatrix4fv(st.hemi_rndr.layered ? st.u.vis_layered_model.loc : st.u.vis_model.loc, 1, GL_FALSE, modl.m);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, st.view_proj_buf);
+    vis_pass.cur_shooter = 0;
+    radiosity_visibility_shooter_begin(0);
 }
 
 int radiosity_visibility_pass_next()
 {
-    mat4 modl = mat4_id();
-    mat4 sview, sproj;
-    int r = hemicube_render_next(&st.hemi_rndr, &sview, &sproj);
-    if (!r)
-        return 0;
-    GLuint shdr = st.vis_pass_shdr;
-    glUniformMatrix4fv(glGetUniformLocation(shdr, "proj"), 1, GL_FALSE, sproj.m);
-    glUniformMatrix4fv(glGetUniformLocation(shdr, "view"), 1, GL_FALSE, sview.m);
-    glUniformMatrix4fv(glGetUniformLocation(shdr, "model"), 1, GL_FALSE, modl.m);
-    vis_pass.view_proj[vis_pass.cur_face++] = mat4_mul_mat4(sproj, sview);
-    return r;
+    /* Advance through the faces of every shooter hemicube in the batch,
+     * the actual number of selected shooters is only known to the gpu */
+    for (;;) {
+        if (vis_pass.cur_shooter >= st.batch_size)
+            return 0;
+        if (hemicube_render_next(&st.hemi_rndr, 0, 0))
+            break;
+        hemicube_render_end(&st.hemi_rndr);
+        if (++vis_pass.cur_shooter < st.batch_size)
+            radiosity_visibility_shooter_begin(vis_pass.cur_shooter);
+    }
+    if (st.hemi_rndr.layered) {
+        glUniform1i(st.u.shooter_index.loc, vis_pass.cur_shooter);
+        return 1;
+    }
+    glUniform1i(st.u.face_index.loc, 5 * vis_pass.cur_shooter + vis_pass.cur_face++);
+    return 1;
 }
 
 void radiosity_visibility_pass_end()
 {
-    hemicube_render_end(&st.hemi_rndr);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
     glUseProgram(0);
 
     /* Restore previous values */
     GLint* vp = vis_pass.prev_vp;
     glViewport(vp[0], vp[1], vp[2], vp[3]);
     glBindFramebuffer(GL_FRAMEBUFFER, vis_pass.prev_fbo);
+    gpu_timer_end(st.timers.visibility);
 }
 
 void radiosity_light_transfer_pass()
 {
+    gpu_timer_begin(st.timers.light_transfer);
     GLuint shdr = st.radiosity_shdr;
     glUseProgram(shdr);
 
-    GLuint data_tex[] = {
-        st.position_tex,
-        st.normal_tex,
-        st.albedo_tex,
-        st.hemi_rndr.col_tex
-    };
-    for (unsigned int i = 0; i < array_length(data_tex); ++i) {
-        glActiveTexture(GL_TEXTURE0 + i);
-        glBindTexture(GL_TEXTURE_2D, data_tex[i]);
-    }
+    /* Receiver attributes come packed from the texel records, only the visibility atlas is sampled */
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D, st.hemi_rndr.col_tex);
 
-    glUniformMatrix4fv(glGetUniformLocation(shdr, "view_proj"), 5, GL_FALSE, (GLvoid*)vis_pass.view_proj);
-    glBindImageTexture(0, st.radiosity_tex, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA16F);
-    glBindImageTexture(1, st.unshot_tex, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA16F);
+    GLenum accum_ifmt = accum_formats[st.accum_fmt].ifmt;
+    glBindImageTexture(0, st.radiosity_tex, 0, GL_FALSE, 0, GL_READ_WRITE, accum_ifmt);
+    glBindImageTexture(1, st.unshot_tex, 0, GL_FALSE, 0, GL_READ_WRITE, accum_ifmt);
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, st.shooter_info_buf);
-    glDispatchCompute(ceil(st.lm_width / 16), ceil(st.lm_height / 16), 1);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, st.view_proj_buf);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, st.bvh_node_buf);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, st.bvh_tri_buf);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, st.texel_list_buf);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, st.texel_record_buf);
+    glBindBufferBase(GL_UNIFORM_BUFFER, SOLVER_PARAMS_BINDING, st.params_buf);
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, st.texel_list_buf);
+    glDispatchComputeIndirect(0);
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
     glUseProgram(0);
 
     /* TODO: Check what is necessary */
     glTextureBarrier();
     glMemoryBarrier(GL_ALL_BARRIER_BITS);
-
-    shdr = st.texel_set_shdr;
-    glUseProgram(shdr);
-    glUniform2iv(glGetUniformLocation(shdr, "coords"), 1, si.texel);
-    glUniform4fv(glGetUniformLocation(shdr, "val"), 1, (float[]){0.0, 0.0, 0.0, 0.0});
-    glBindImageTexture(0, st.unshot_tex, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA16F);
-    glDispatchCompute(1, 1, 1);
-    glUseProgram(0);
+    gpu_timer_end(st.timers.light_transfer);
 }
 
 void radiosity_gi_pass_begin()
 {
+    /* No more dispatches once the solution has converged */
+    st.gi_pass_active = !st.converged;
+    if (!st.gi_pass_active)
+        return;
+    solver_params_update();
     radiosity_next_shooter_pass();
-    radiosity_visibility_pass_begin();
+    /* Convergence is tracked from readbacks of earlier passes, so the cpu never stalls on the selection */
+    residual_readback_push();
+    residual_readback_poll();
+    if (st.vis_mode == RADIOSITY_VIS_HEMICUBE) {
+        radiosity_view_proj_pass();
+        radiosity_visibility_pass_begin();
+    }
 }
 
 int radiosity_gi_pass_next()
 {
+    /* Ray cast visibility needs no scene draws */
+    if (!st.gi_pass_active || st.vis_mode != RADIOSITY_VIS_HEMICUBE)
+        return 0;
     return radiosity_visibility_pass_next();
 }
 
 void radiosity_gi_pass_end()
 {
-    radiosity_visibility_pass_end();
+    if (!st.gi_pass_active)
+        return;
+    if (st.vis_mode == RADIOSITY_VIS_HEMICUBE)
+        radiosity_visibility_pass_end();
     radiosity_light_transfer_pass();
+    ++st.passes;
+    st.gi_pass_active = 0;
+}
+
+float radiosity_residual()
+{
+    residual_readback_poll();
+    if (!st.residual_known)
+        return 1.0f;
+    if (st.initial_energy <= 0.0f)
+        return 0.0f;
+    return st.residual_energy / st.initial_energy;
+}
+
+float radiosity_initial_energy()
+{
+    residual_readback_poll();
+    return st.residual_known ? st.initial_energy : 0.0f;
+}
+
+void radiosity_store_solution(int format, void* radiosity, void* unshot)
+{
+    const struct accum_format* af = &accum_formats[format];
+    glBindTexture(GL_TEXTURE_2D, st.radiosity_tex);
+    glGetTexImage(GL_TEXTURE_2D, 0, af->fmt, af->type, radiosity);
+    glBindTexture(GL_TEXTURE_2D, st.unshot_tex);
+    glGetTexImage(GL_TEXTURE_2D, 0, af->fmt, af->type, unshot);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void radiosity_restore_solution(int format, const void* radiosity, const void* unshot, float initial_energy)
+{
+    const struct accum_format* af = &accum_formats[format];
+    glBindTexture(GL_TEXTURE_2D, st.radiosity_tex);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, st.lm_width, st.lm_height, af->fmt, af->type, radiosity);
+    glBindTexture(GL_TEXTURE_2D, st.unshot_tex);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, st.lm_width, st.lm_height, af->fmt, af->type, unshot);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    /* Residual is measured against the originally emitted energy, convergence is re-evaluated on the next pass */
+    residual_readback_reset();
+    st.initial_energy = initial_energy;
+    st.residual_energy = initial_energy;
+    st.residual_known = initial_energy > 0.0f;
+    st.converged = 0;
+}
+
+/* Every texture needed to continue a solve, stored in their native formats */
+struct state_tex {
+    GLuint* id;
+    GLenum fmt;
+    GLenum type;
+    unsigned int texel_sz;
+};
+
+static void state_texs(struct state_tex out[STATE_NUM_TEXTURES])
+{
+    const struct accum_format* af = &accum_formats[st.accum_fmt];
+    struct state_tex texs[STATE_NUM_TEXTURES] = {
+        { &st.radiosity_tex, af->fmt, af->type, af->texel_sz },
+        { &st.unshot_tex,    af->fmt, af->type, af->texel_sz },
+        { &st.position_tex,  GL_RGBA, GL_FLOAT,        16 },
+        { &st.normal_tex,    GL_RGB,  GL_HALF_FLOAT,    6 },
+        { &st.albedo_tex,    GL_RGB,  GL_UNSIGNED_BYTE, 3 }
+    };
+    memcpy(out, texs, sizeof(texs));
+}
+
+struct state_header {
+    char magic[4];
+    uint32_t version;
+    uint32_t width, height;
+    uint64_t iterations;
+    float initial_energy;
+    int32_t residual_known;
+    int32_t accum_format;
+    int32_t padding0;
+    uint64_t key;
+    uint64_t passes;
+};
+
+static int state_write(const char* fpath, struct state_header* hdr, const void* data[STATE_NUM_TEXTURES])
+{
+    /* Write aside and swap in, so that a crash mid write keeps the previous checkpoint */
+    char tmp_path[sizeof(st.ckpt.fpath) + 4];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", fpath);
+    FILE* f = fopen(tmp_path, "wb");
+    if (!f)
+        return 0;
+    struct state_tex texs[STATE_NUM_TEXTURES];
+    state_texs(texs);
+    size_t num_texels = (size_t)st.lm_width * st.lm_height;
+    int ok = fwrite(hdr, sizeof(*hdr), 1, f) == 1;
+    for (int i = 0; ok && i < STATE_NUM_TEXTURES; ++i)
+        ok = fwrite(data[i], texs[i].texel_sz, num_texels, f) == num_texels;
+    ok = (fclose(f) == 0) && ok;
+    if (ok) {
+#ifdef _WIN32
+        remove(fpath);
+#endif
+        ok = rename(tmp_path, fpath) == 0;
+    }
+    if (!ok)
+        remove(tmp_path);
+    return ok;
+}
+
+static void state_header_fill(struct state_header* hdr, unsigned long iterations, unsigned long passes, float initial_energy, int residual_known)
+{
+    memset(hdr, 0, sizeof(*hdr));
+    memcpy(hdr->magic, STATE_MAGIC, 4);
+    hdr->version = STATE_VERSION;
+    hdr->width = st.lm_width;
+    hdr->height = st.lm_height;
+    hdr->iterations = iterations;
+    hdr->passes = passes;
+    hdr->initial_energy = initial_energy;
+    hdr->residual_known = residual_known;
+    hdr->accum_format = st.accum_fmt;
+    hdr->key = st.state_key;
+}
+
+int radiosity_save_state(const char* fpath)
+{
+    residual_readback_poll();
+    struct state_tex texs[STATE_NUM_TEXTURES];
+    state_texs(texs);
+    size_t num_texels = (size_t)st.lm_width * st.lm_height;
+    void* data[STATE_NUM_TEXTURES];
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    for (int i = 0; i < STATE_NUM_TEXTURES; ++i) {
+        data[i] = malloc(num_texels * texs[i].texel_sz);
+        glBindTexture(GL_TEXTURE_2D, *texs[i].id);
+        glGetTexImage(GL_TEXTURE_2D, 0, texs[i].fmt, texs[i].type, data[i]);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+    /* Exact shooter count of the saved textures, the readbacks may still be behind */
+    struct shooter_counts c;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, st.shooter_info_buf);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(c), &c);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    struct state_header hdr;
+    state_header_fill(&hdr, c.total_shooters, st.passes, st.initial_energy, st.residual_known);
+    int ok = state_write(fpath, &hdr, (const void**)data);
+    for (int i = 0; i < STATE_NUM_TEXTURES; ++i)
+        free(data[i]);
+    return ok;
+}
+
+void radiosity_set_state_key(unsigned long long key)
+{
+    st.state_key = key;
+}
+
+int radiosity_load_state(const char* fpath)
+{
+    FILE* f = fopen(fpath, "rb");
+    if (!f)
+        return 0;
+    struct state_header hdr;
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1
+     || memcmp(hdr.magic, STATE_MAGIC, 4) != 0
+     || hdr.version != STATE_VERSION
+     || hdr.width != st.lm_width
+     || hdr.height != st.lm_height
+     || hdr.accum_format != st.accum_fmt
+     || hdr.key != st.state_key) {
+        fclose(f);
+        return 0;
+    }
+
+    struct state_tex texs[STATE_NUM_TEXTURES];
+    state_texs(texs);
+    size_t num_texels = (size_t)st.lm_width * st.lm_height;
+    unsigned int max_texel_sz = 0;
+    for (int i = 0; i < STATE_NUM_TEXTURES; ++i)
+        max_texel_sz = texs[i].texel_sz > max_texel_sz ? texs[i].texel_sz : max_texel_sz;
+    void* data = malloc(num_texels * max_texel_sz);
+    int ok = 1;
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (int i = 0; ok && i < STATE_NUM_TEXTURES; ++i) {
+        ok = fread(data, texs[i].texel_sz, num_texels, f) == num_texels;
+        if (!ok)
+            break;
+        glBindTexture(GL_TEXTURE_2D, *texs[i].id);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, st.lm_width, st.lm_height, texs[i].fmt, texs[i].type, data);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    free(data);
+    fclose(f);
+    if (!ok)
+        return 0;
+
+    /* Attributes came with the state, so the attribute pass is skipped from now on */
+    st.attrib_pass = 1;
+    texel_list_build();
+    residual_readback_reset();
+    shooter_total_reset(hdr.iterations);
+    st.iterations = hdr.iterations;
+    st.passes = hdr.passes;
+    st.initial_energy = hdr.initial_energy;
+    st.residual_energy = hdr.initial_energy;
+    st.residual_known = hdr.residual_known;
+    st.converged = 0;
+    return 1;
+}
+
+void radiosity_checkpoint(const char* fpath)
+{
+    /* One checkpoint in flight at a time */
+    if (st.ckpt.fence)
+        return;
+    struct state_tex texs[STATE_NUM_TEXTURES];
+    state_texs(texs);
+    size_t num_texels = (size_t)st.lm_width * st.lm_height;
+    if (!st.ckpt.pbos[0]) {
+        glGenBuffers(STATE_NUM_TEXTURES, st.ckpt.pbos);
+        for (int i = 0; i < STATE_NUM_TEXTURES; ++i) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, st.ckpt.pbos[i]);
+            glBufferData(GL_PIXEL_PACK_BUFFER, num_texels * texs[i].texel_sz, 0, GL_STREAM_READ);
+        }
+    }
+
+    /* Texture copies into pbos are queued like any other command, nothing waits here */
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    for (int i = 0; i < STATE_NUM_TEXTURES; ++i) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, st.ckpt.pbos[i]);
+        glBindTexture(GL_TEXTURE_2D, *texs[i].id);
+        glGetTexImage(GL_TEXTURE_2D, 0, texs[i].fmt, texs[i].type, 0);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    if (!st.ckpt.counts_buf) {
+        glGenBuffers(1, &st.ckpt.counts_buf);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, st.ckpt.counts_buf);
+        glBufferData(GL_COPY_WRITE_BUFFER, sizeof(struct shooter_counts), 0, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, st.shooter_info_buf);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, st.ckpt.counts_buf);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(struct shooter_counts));
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    st.ckpt.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    /* Solver counters as of the snapshot */
+    residual_readback_poll();
+    snprintf(st.ckpt.fpath, sizeof(st.ckpt.fpath), "%s", fpath);
+    st.ckpt.passes = st.passes;
+    st.ckpt.initial_energy = st.initial_energy;
+    st.ckpt.residual_known = st.residual_known;
+}
+
+int radiosity_checkpoint_poll(int wait)
+{
+    if (!st.ckpt.fence)
+        return 0;
+    GLenum r = glClientWaitSync(st.ckpt.fence, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? GL_TIMEOUT_IGNORED : 0);
+    if (r != GL_ALREADY_SIGNALED && r != GL_CONDITION_SATISFIED)
+        return 0;
+    glDeleteSync(st.ckpt.fence);
+    st.ckpt.fence = 0;
+
+    const void* data[STATE_NUM_TEXTURES];
+    for (int i = 0; i < STATE_NUM_TEXTURES; ++i) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, st.ckpt.pbos[i]);
+        data[i] = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+    }
+    struct shooter_counts c;
+    glBindBuffer(GL_COPY_READ_BUFFER, st.ckpt.counts_buf);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(c), &c);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    struct state_header hdr;
+    state_header_fill(&hdr, c.total_shooters, st.ckpt.passes, st.ckpt.initial_energy, st.ckpt.residual_known);
+    int ok = state_write(st.ckpt.fpath, &hdr, data);
+    for (int i = 0; i < STATE_NUM_TEXTURES; ++i) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, st.ckpt.pbos[i]);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return ok ? 1 : -1;
+}
+
+int radiosity_readback_async()
+{
+    unsigned int slot = st.lm_rb.head;
+    if (st.lm_rb.fences[slot] || (st.lm_rb.acquired && slot == st.lm_rb.tail))
+        return 0;
+    size_t sz = (size_t)st.lm_width * st.lm_height * 3 * sizeof(float);
+    if (!st.lm_rb.pbos[0]) {
+        /* Persistently mapped where possible, so that handing out a landed copy costs nothing */
+        int persistent = HAS_OPENGL_EXTENSION(GL_ARB_buffer_storage);
+        GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT;
+        glGenBuffers(LIGHTMAP_READBACK_RING, st.lm_rb.pbos);
+        for (unsigned int i = 0; i < LIGHTMAP_READBACK_RING; ++i) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, st.lm_rb.pbos[i]);
+            if (persistent) {
+                glBufferStorage(GL_PIXEL_PACK_BUFFER, sz, 0, flags);
+                st.lm_rb.ptrs[i] = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, sz, flags);
+            } else {
+                glBufferData(GL_PIXEL_PACK_BUFFER, sz, 0, GL_STREAM_READ);
+            }
+        }
+        glGenBuffers(1, &st.lm_rb.counts_buf);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, st.lm_rb.counts_buf);
+        glBufferData(GL_COPY_WRITE_BUFFER, LIGHTMAP_READBACK_RING * sizeof(struct shooter_counts), 0, GL_STREAM_READ);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    /* The copy is queued behind the passes issued so far, the solver keeps going meanwhile */
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, st.lm_rb.pbos[slot]);
+    glBindTexture(GL_TEXTURE_2D, st.radiosity_tex);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_FLOAT, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glBindBuffer(GL_COPY_READ_BUFFER, st.shooter_info_buf);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, st.lm_rb.counts_buf);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, slot * sizeof(struct shooter_counts), sizeof(struct shooter_counts));
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    if (st.lm_rb.ptrs[slot])
+        glMemoryBarrier(GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT);
+    st.lm_rb.fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    st.lm_rb.head = (slot + 1) % LIGHTMAP_READBACK_RING;
+    return 1;
+}
+
+const float* radiosity_readback_poll(int wait, unsigned long* iterations)
+{
+    unsigned int slot = st.lm_rb.tail;
+    size_t sz = (size_t)st.lm_width * st.lm_height * 3 * sizeof(float);
+    if (!st.lm_rb.acquired) {
+        if (!st.lm_rb.fences[slot])
+            return 0;
+        GLenum r = glClientWaitSync(st.lm_rb.fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, wait ? GL_TIMEOUT_IGNORED : 0);
+        if (r != GL_ALREADY_SIGNALED && r != GL_CONDITION_SATISFIED)
+            return 0;
+        glDeleteSync(st.lm_rb.fences[slot]);
+        st.lm_rb.fences[slot] = 0;
+        st.lm_rb.acquired = 1;
+        st.lm_rb.acquired_data = st.lm_rb.ptrs[slot];
+        if (!st.lm_rb.acquired_data) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, st.lm_rb.pbos[slot]);
+            st.lm_rb.acquired_data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, sz, GL_MAP_READ_BIT);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+        struct shooter_counts c;
+        glBindBuffer(GL_COPY_READ_BUFFER, st.lm_rb.counts_buf);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, slot * sizeof(c), sizeof(c), &c);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        st.lm_rb.iterations[slot] = c.total_shooters;
+    }
+    if (iterations)
+        *iterations = st.lm_rb.iterations[slot];
+    return st.lm_rb.acquired_data;
+}
+
+void radiosity_readback_release()
+{
+    if (!st.lm_rb.acquired)
+        return;
+    unsigned int slot = st.lm_rb.tail;
+    if (!st.lm_rb.ptrs[slot]) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, st.lm_rb.pbos[slot]);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+    st.lm_rb.acquired = 0;
+    st.lm_rb.acquired_data = 0;
+    st.lm_rb.tail = (slot + 1) % LIGHTMAP_READBACK_RING;
+}
+
+unsigned long radiosity_iterations()
+{
+    residual_readback_poll();
+    return st.iterations;
+}
+
+static size_t buffer_size(GLuint buf)
+{
+    if (!buf)
+        return 0;
+    GLint sz = 0;
+    glBindBuffer(GL_COPY_READ_BUFFER, buf);
+    glGetBufferParameteriv(GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &sz);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    return sz;
+}
+
+size_t radiosity_gpu_memory()
+{
+    /* Nominal texel sizes, drivers may pad the three channel formats */
+    size_t num_texels = (size_t)st.lm_width * st.lm_height;
+    size_t total = num_texels * (2 * accum_formats[st.accum_fmt].texel_sz + 16 + 6 + 3);
+    /* Hemicube atlas color and depth */
+    size_t hemi_texels = (size_t)st.hemi_rndr.sres * 2 * st.hemi_rndr.slots * st.hemi_rndr.sres * 2;
+    total += hemi_texels * (8 + 4);
+    GLuint bufs[] = {
+        st.texel_list_buf,
+        st.texel_record_buf,
+        st.max_pass_buf,
+        st.max_merge_buf,
+        st.shooter_info_buf,
+        st.view_proj_buf,
+        st.bvh_node_buf,
+        st.bvh_tri_buf,
+        st.light_buf,
+        st.light_grid_buf,
+        st.residual_rb.buf
+    };
+    for (size_t i = 0; i < array_length(bufs); ++i)
+        total += buffer_size(bufs[i]);
+    for (size_t i = 0; i < STATE_NUM_TEXTURES; ++i)
+        total += buffer_size(st.ckpt.pbos[i]);
+    for (size_t i = 0; i < LIGHTMAP_READBACK_RING; ++i)
+        total += buffer_size(st.lm_rb.pbos[i]);
+    return total;
+}
+
+void radiosity_set_threshold(float threshold) { st.threshold = threshold; }
+
+void radiosity_set_batch_size(int batch_size)
+{
+    st.batch_request = batch_size < 1 ? 1 : (batch_size > RADIOSITY_MAX_BATCH ? RADIOSITY_MAX_BATCH : batch_size);
+    st.batch_size = st.batch_request > (int)st.hemi_rndr.slots ? (int)st.hemi_rndr.slots : st.batch_request;
+}
+
+int radiosity_batch_size() { return st.batch_size; }
+
+void radiosity_set_lightmap_area(float area)
+{
+    st.texel_area = area / ((float)st.lm_width * st.lm_height);
+}
+
+void radiosity_set_scene(const float* positions, unsigned int num_vertices, const unsigned int* indices, unsigned int num_indices)
+{
+    (void) num_vertices;
+    struct bvh b;
+    bvh_build(&b, positions, indices, num_indices);
+    if (!st.bvh_node_buf) {
+        glGenBuffers(1, &st.bvh_node_buf);
+        glGenBuffers(1, &st.bvh_tri_buf);
+    }
+    /* Flat node and triangle arrays, traversed by radiosity.comp */
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, st.bvh_node_buf);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, b.num_nodes * sizeof(struct bvh_node), b.nodes, GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, st.bvh_tri_buf);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, b.num_tris * sizeof(struct bvh_tri), b.tris, GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    bvh_free(&b);
+}
+
+void radiosity_set_lights(const struct radiosity_light* lights, unsigned int num_lights)
+{
+    free(st.lights);
+    st.lights = malloc((num_lights ? num_lights : 1) * sizeof(*st.lights));
+    if (num_lights)
+        memcpy(st.lights, lights, num_lights * sizeof(*st.lights));
+    st.num_lights = num_lights;
+
+    struct light_grid g;
+    light_grid_build(&g, st.lights, num_lights);
+    if (!st.light_buf) {
+        glGenBuffers(1, &st.light_buf);
+        glGenBuffers(1, &st.light_grid_buf);
+    }
+    /* Header and list share one buffer, see light_buf in attributes.frag */
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, st.light_buf);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(g.hdr) + num_lights * sizeof(*st.lights), 0, GL_STATIC_DRAW);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(g.hdr), &g.hdr);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, sizeof(g.hdr), num_lights * sizeof(*st.lights), st.lights);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, st.light_grid_buf);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, g.size * sizeof(unsigned int), g.data, GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    light_grid_free(&g);
+
+    /* Unshot energy was seeded from the previous lights, start over from the attribute pass */
+    st.attrib_pass = 0;
+}
+
+const struct radiosity_light* radiosity_lights(unsigned int* num_lights)
+{
+    *num_lights = st.num_lights;
+    return st.lights;
+}
+
+void radiosity_bind_lights()
+{
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, RADIOSITY_LIGHT_BINDING, st.light_buf);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, RADIOSITY_LIGHT_GRID_BINDING, st.light_grid_buf);
+}
+
+void radiosity_set_visibility_mode(int mode)
+{
+    /* Ray casting needs the scene set first */
+    st.vis_mode = mode == RADIOSITY_VIS_RAYCAST && st.bvh_node_buf ? RADIOSITY_VIS_RAYCAST : RADIOSITY_VIS_HEMICUBE;
+}
+
+void radiosity_set_layered(int layered) { hemicube_rndr_set_layered(&st.hemi_rndr, layered); }
+
+int radiosity_set_hemicube_resolution(unsigned int sres)
+{
+    /* Faces are split in halves around the center, so keep the resolution even */
+    sres = sres < 2 ? 2 : sres & ~1u;
+    if (sres == st.hemi_rndr.sres)
+        return 1;
+    unsigned int max_slots = hemicube_rndr_max_slots(sres);
+    if (max_slots == 0) {
+        fprintf(stderr, "Hemicube resolution %u exceeds the maximum texture size, keeping %u\n", sres, st.hemi_rndr.sres);
+        return 0;
+    }
+    if (max_slots < RADIOSITY_MAX_BATCH)
+        fprintf(stderr, "Hemicube resolution %u fits %u shooters per gi pass\n", sres, max_slots);
+    int layered = st.hemi_rndr.layered;
+    hemicube_rndr_destroy(&st.hemi_rndr);
+    hemicube_rndr_init_res(&st.hemi_rndr, RADIOSITY_MAX_BATCH, sres);
+    hemicube_rndr_set_layered(&st.hemi_rndr, layered);
+    radiosity_set_batch_size(st.batch_request);
+    return 1;
+}
+
+void radiosity_set_accum_format(int format)
+{
+    if (format < 0 || format >= (int)array_length(accum_formats) || format == st.accum_fmt)
+        return;
+    st.accum_fmt = format;
+
+    /* Checkpoint copies are sized for the previous format */
+    radiosity_checkpoint_poll(1);
+    if (st.ckpt.pbos[0])
+        glDeleteBuffers(STATE_NUM_TEXTURES, st.ckpt.pbos);
+    memset(st.ckpt.pbos, 0, sizeof(st.ckpt.pbos));
+
+    GLuint textures[] = { st.radiosity_tex, st.unshot_tex };
+    glDeleteTextures(array_length(textures), textures);
+    glBindFramebuffer(GL_FRAMEBUFFER, st.fbo);
+    accum_textures_create();
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    glDeleteProgram(st.radiosity_shdr);
+    glDeleteProgram(st.max_pass_shdr);
+    accum_shaders_load();
+
+    /* Previous solution is gone, start over from the attribute pass */
+    st.attrib_pass = 0;
 }
 
+int radiosity_accum_format() { return st.accum_fmt; }
+
+int radiosity_accum_format_from_name(const char* name)
+{
+    for (size_t i = 0; i < array_length(accum_formats); ++i)
+        if (strcmp(accum_formats[i].name, name) == 0)
+            return i;
+    return -1;
+}
+
+const char* radiosity_accum_format_name(int format)
+{
+    return format >= 0 && format < (int)array_length(accum_formats) ? accum_formats[format].name : 0;
+}
+
+unsigned int radiosity_accum_texel_size(int format)
+{
+    return format >= 0 && format < (int)array_length(accum_formats) ? accum_formats[format].texel_sz : 0;
+}
+
+int radiosity_converged() { return st.converged; }
+
 unsigned int radiosity_lightmap() { return st.radiosity_tex; }
 unsigned int radiosity_unshot() { return st.unshot_tex; }
 unsigned int radiosity_visibility() { return st.hemi_rndr.col_tex; }
+unsigned int radiosity_position() { return st.position_tex; }
+unsigned int radiosity_normal() { return st.normal_tex; }
+unsigned int radiosity_albedo() { return st.albedo_tex; }
@@ -31,6 +31,53 @@
 #ifndef _RADIOSITY_H_
 #define _RADIOSITY_H_
 
+#include <stddef.h>
+
+/* Default fraction of the initially emitted energy left unshot, where the solution is considered converged */
+#define RADIOSITY_DEFAULT_THRESHOLD 0.001f
+/* Shooter patch area until the scene sets its own, about that of the cornell box at 128x128 texels */
+#define RADIOSITY_DEFAULT_TEXEL_AREA 450.0f
+/* Maximum number of shooters that can be selected and shot in a single gi pass */
+#define RADIOSITY_MAX_BATCH 8
+
+/* How shooter to receiver visibility is resolved in the transfer pass */
+enum radiosity_visibility_mode {
+    RADIOSITY_VIS_HEMICUBE = 0, /* Lightmap uv ID buffer rendered per shooter */
+    RADIOSITY_VIS_RAYCAST       /* Shadow ray per receiver through a BVH of the scene */
+};
+
+/* Storage of the radiosity and unshot textures */
+enum radiosity_accum_format {
+    RADIOSITY_ACCUM_RGBA16F = 0, /* Half floats */
+    RADIOSITY_ACCUM_R11G11B10F,  /* Packed unsigned floats, half the bandwidth */
+    RADIOSITY_ACCUM_RGBA32F      /* Full precision for reference bakes */
+};
+
+/* Direct light evaluated by the attribute pass to seed the unshot energy */
+enum radiosity_light_type {
+    RADIOSITY_LIGHT_POINT = 0,  /* Intensity falls off with the squared distance */
+    RADIOSITY_LIGHT_SPOT,       /* Point light limited to a cone around its direction */
+    RADIOSITY_LIGHT_AREA        /* Triangle emitting to the side its winding faces, intensity is its radiance */
+};
+
+/* Light list entry, std430 layout shared with the attribute and standard shaders */
+struct radiosity_light {
+    float position[3];      /* First corner of area lights */
+    int type;
+    float direction[3];     /* Spot axis */
+    float range;            /* Influence radius around the position (centroid of area lights), 0 derives it from the intensity */
+    float color[3];
+    float intensity;
+    float corner1[3];
+    float cos_inner;        /* Spot cone, full intensity inside cos_inner and none outside cos_outer */
+    float corner2[3];
+    float cos_outer;
+};
+
+/* Shader storage bindings of the light list and of its grid, kept clear of the compute passes */
+#define RADIOSITY_LIGHT_BINDING 4
+#define RADIOSITY_LIGHT_GRID_BINDING 5
+
 void radiosity_init(int width, int height);
 void radiosity_destroy();
 
@@ -41,9 +88,73 @@ void radiosity_gi_pass_begin();
 int  radiosity_gi_pass_next();
 void radiosity_gi_pass_end();
 
+/* Unshot energy left as a fraction of the initially emitted energy */
+float radiosity_residual();
+/* Energy emitted by the attribute pass, zero until it is known */
+float radiosity_initial_energy();
+/* Radiosity and unshot textures in the pixel transfer format of the given accumulation format (RGBA half floats
+ * for RADIOSITY_ACCUM_RGBA16F), independent of the current one. Restoring must follow the attribute pass */
+void radiosity_store_solution(int format, void* radiosity, void* unshot);
+void radiosity_restore_solution(int format, const void* radiosity, const void* unshot, float initial_energy);
+
+/* Full solver state (solution, attributes and iteration count), loading skips the attribute pass */
+int  radiosity_save_state(const char* fpath);
+/* Loading fails for a state saved under another key than the one set here, pass a hash of the scene and lights
+ * only (not bake_cache_key, solver settings like the batch size may change between runs). Zero until set */
+void radiosity_set_state_key(unsigned long long key);
+int  radiosity_load_state(const char* fpath);
+/* Snapshots the state into pbos, written to fpath by a later poll once the copies have landed */
+void radiosity_checkpoint(const char* fpath);
+/* Writes a landed checkpoint, 1 when written, -1 on write failure, 0 when none is ready (or pending without wait) */
+int  radiosity_checkpoint_poll(int wait);
+/* Queues a copy of the lightmap as RGB floats that overlaps the following passes, zero when the ring is full */
+int  radiosity_readback_async();
+/* Oldest landed readback, valid until released and handed out again until then. Null when none has landed
+ * (or one is pending without wait), iterations receives the shooter count of the copy */
+const float* radiosity_readback_poll(int wait, unsigned long* iterations);
+void radiosity_readback_release();
+/* Shooters selected since the attribute pass, counting those of a loaded state. Follows the residual readbacks,
+ * so it trails the last few gi passes and only counts the texels that had energy left to shoot */
+unsigned long radiosity_iterations();
+/* Bytes of gpu memory held by the solver textures and buffers */
+size_t radiosity_gpu_memory();
+void radiosity_set_threshold(float threshold);
+/* Number of brightest texels shot together per gi pass, clamped to [1, RADIOSITY_MAX_BATCH] and the hemicube atlas slots */
+void radiosity_set_batch_size(int batch_size);
+int  radiosity_batch_size();
+/* World space area the unit lightmap square maps to, see scene_mesh.lm_area. Each texel shoots from its share */
+void radiosity_set_lightmap_area(float area);
+/* Replaces the light list, the next attribute pass seeds the unshot energy from it again */
+void radiosity_set_lights(const struct radiosity_light* lights, unsigned int num_lights);
+/* Light list as uploaded, ranges filled in */
+const struct radiosity_light* radiosity_lights(unsigned int* num_lights);
+/* Binds the light list and its grid for shaders outside the solver */
+void radiosity_bind_lights();
+/* Scene triangles for ray cast visibility, 3 floats per vertex */
+void radiosity_set_scene(const float* positions, unsigned int num_vertices, const unsigned int* indices, unsigned int num_indices);
+void radiosity_set_visibility_mode(int mode);
+/* Render the hemicube faces of a shooter with a single draw instead of one draw per face */
+void radiosity_set_layered(int layered);
+/* Hemicube face resolution, HEMICUBE_SRES by default. Fewer shooters are batched when the atlas would exceed
+ * the texture size limits, and a resolution that does not fit a single shooter is rejected with zero */
+int  radiosity_set_hemicube_resolution(unsigned int sres);
+/* Recreates the radiosity and unshot textures, RGBA16F by default. Must be followed by the attribute pass */
+void radiosity_set_accum_format(int format);
+int  radiosity_accum_format();
+/* Format by its name (rgba16f, r11g11b10f, rgba32f), -1 when unknown */
+int  radiosity_accum_format_from_name(const char* name);
+const char* radiosity_accum_format_name(int format);
+/* Bytes per texel of the pixel transfer format, zero when unknown */
+unsigned int radiosity_accum_texel_size(int format);
+int  radiosity_converged();
+
 unsigned int radiosity_lightmap();
 unsigned int radiosity_unshot();
 unsigned int radiosity_visibility();
+/* Attribute pass outputs */
+unsigned int radiosity_position();
+unsigned int radiosity_normal();
+unsigned int radiosity_albedo();
 
 #define radiosity_attrib_pass \
     for (int _break = (radiosity_attrib_pass_begin(), 1); \
@@ -0,0 +1,332 @@
+#include "radiosity_cpu.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include <glad/glad.h>
+#include "radiosity.h"
+#include "threadpool.h"
+#include "bvh.h"
+
+/* Ray end points are pushed off their surfaces along the normal, comparable to the hemicube near plane */
+#define RAY_OFFSET 0.1f
+/* Lightmap rows handed to a worker at a time */
+#define ROWS_PER_JOB 4
+#define RADIOSITY_CPU_PI 3.1415926535f
+
+struct shooter {
+    unsigned int texel;
+    float position[3];
+    float normal[3];
+    float unshot[3];
+};
+
+static struct {
+    unsigned int width, height;
+    /* Attributes in SoA layout for the receiver loop */
+    float* pos[3];
+    float* nrm[3];
+    float* alb[3];
+    float* acc[3];
+    float* ush[3];
+    /* Scene */
+    struct bvh bvh;
+    struct threadpool* pool;
+    /* Current batch */
+    struct shooter shooters[RADIOSITY_MAX_BATCH];
+    int num_shooters;
+    int batch_size;
+    /* Shooters shot since the attribute pass */
+    unsigned long iterations;
+    /* World space area of a texel, the shooter patch area as in radiosity.comp */
+    float texel_area;
+    /* Convergence tracking */
+    float initial_energy;
+    float residual_energy;
+    float threshold;
+    int residual_known;
+    int converged;
+} st;
+
+void radiosity_cpu_init(int width, int height, unsigned int num_threads)
+{
+    memset(&st, 0, sizeof(st));
+    st.width = width;
+    st.height = height;
+    st.batch_size = 1;
+    st.threshold = RADIOSITY_DEFAULT_THRESHOLD;
+    st.texel_area = RADIOSITY_DEFAULT_TEXEL_AREA;
+
+    size_t num_texels = (size_t)width * height;
+    float** channels[] = { st.pos, st.nrm, st.alb, st.acc, st.ush };
+    for (size_t i = 0; i < sizeof(channels) / sizeof(channels[0]); ++i)
+        for (int c = 0; c < 3; ++c)
+            channels[i][c] = calloc(num_texels, sizeof(float));
+
+    st.pool = threadpool_create(num_threads);
+}
+
+void radiosity_cpu_destroy()
+{
+    threadpool_destroy(st.pool);
+    float** channels[] = { st.pos, st.nrm, st.alb, st.acc, st.ush };
+    for (size_t i = 0; i < sizeof(channels) / sizeof(channels[0]); ++i)
+        for (int c = 0; c < 3; ++c)
+            free(channels[i][c]);
+    bvh_free(&st.bvh);
+    memset(&st, 0, sizeof(st));
+}
+
+void radiosity_cpu_set_scene(const float* positions, unsigned int num_vertices, const unsigned int* indices, unsigned int num_indices)
+{
+    (void) num_vertices;
+    bvh_free(&st.bvh);
+    bvh_build(&st.bvh, positions, indices, num_indices);
+}
+
+void radiosity_cpu_set_attributes(const float* position, const float* normal, const float* albedo, const float* unshot)
+{
+    size_t num_texels = (size_t)st.width * st.height;
+    for (size_t i = 0; i < num_texels; ++i) {
+        const float* n = normal + 3 * i;
+        float len = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        float inv_len = len > 0.0f ? 1.0f / len : 0.0f;
+        for (int c = 0; c < 3; ++c) {
+            st.pos[c][i] = position[3 * i + c];
+            st.nrm[c][i] = n[c] * inv_len;
+            st.alb[c][i] = albedo[3 * i + c];
+            st.acc[c][i] = 0.0f;
+            st.ush[c][i] = unshot[3 * i + c];
+        }
+    }
+    st.iterations = 0;
+    st.initial_energy = st.residual_energy = 0.0f;
+    st.residual_known = 0;
+    st.converged = 0;
+}
+
+void radiosity_cpu_fetch_attributes()
+{
+    size_t sz = (size_t)st.width * st.height * 3 * sizeof(float);
+    float* data[4];
+    unsigned int textures[4] = {
+        radiosity_position(),
+        radiosity_normal(),
+        radiosity_albedo(),
+        radiosity_unshot()
+    };
+    for (int i = 0; i < 4; ++i) {
+        data[i] = malloc(sz);
+        glBindTexture(GL_TEXTURE_2D, textures[i]);
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_FLOAT, data[i]);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    radiosity_cpu_set_attributes(data[0], data[1], data[2], data[3]);
+    for (int i = 0; i < 4; ++i)
+        free(data[i]);
+}
+
+static float luminance(unsigned int i)
+{
+    return st.ush[0][i] * 0.2125f + st.ush[1][i] * 0.7154f + st.ush[2][i] * 0.0721f;
+}
+
+/* Brightest unshot texels, same as max.comp */
+static void select_shooters()
+{
+    unsigned int best_idx[RADIOSITY_MAX_BATCH];
+    float best_lum[RADIOSITY_MAX_BATCH];
+    int num_best = 0;
+    float total = 0.0f;
+
+    size_t num_texels = (size_t)st.width * st.height;
+    for (size_t i = 0; i < num_texels; ++i) {
+        float lum = luminance(i);
+        total += lum;
+        if (lum <= 0.0f || (num_best == st.batch_size && lum <= best_lum[num_best - 1]))
+            continue;
+        /* Insertion into the sorted candidates */
+        int j = num_best < st.batch_size ? num_best++ : num_best - 1;
+        for (; j > 0 && best_lum[j - 1] < lum; --j) {
+            best_lum[j] = best_lum[j - 1];
+            best_idx[j] = best_idx[j - 1];
+        }
+        best_lum[j] = lum;
+        best_idx[j] = i;
+    }
+
+    st.num_shooters = num_best;
+    for (int j = 0; j < num_best; ++j) {
+        struct shooter* s = &st.shooters[j];
+        unsigned int i = best_idx[j];
+        s->texel = i;
+        for (int c = 0; c < 3; ++c) {
+            s->position[c] = st.pos[c][i];
+            s->normal[c] = st.nrm[c][i];
+            s->unshot[c] = st.ush[c][i];
+        }
+    }
+
+    /* First selection after the attributes are set holds the emitted energy */
+    if (!st.residual_known) {
+        st.initial_energy = total;
+        st.residual_known = 1;
+    }
+    st.residual_energy = total;
+    st.converged = radiosity_cpu_residual() <= st.threshold;
+}
+
+static int visible(unsigned int recv, const struct shooter* s)
+{
+    float o[3], d[3];
+    for (int c = 0; c < 3; ++c) {
+        o[c] = st.pos[c][recv] + st.nrm[c][recv] * RAY_OFFSET;
+        d[c] = s->position[c] + s->normal[c] * RAY_OFFSET - o[c];
+    }
+    return !bvh_segment_occluded(&st.bvh, o, d);
+}
+
+/*
+ * Disc approximation form factor times the shooter area for 4 receivers,
+ * the rest of form_factor_energy (shooter energy and receiver albedo) is applied per channel
+ */
+#ifdef __SSE2__
+static void form_factors4(float out[4], unsigned int i, const struct shooter* s)
+{
+    const __m128 zero = _mm_setzero_ps();
+    __m128 rx = _mm_sub_ps(_mm_set1_ps(s->position[0]), _mm_loadu_ps(st.pos[0] + i));
+    __m128 ry = _mm_sub_ps(_mm_set1_ps(s->position[1]), _mm_loadu_ps(st.pos[1] + i));
+    __m128 rz = _mm_sub_ps(_mm_set1_ps(s->position[2]), _mm_loadu_ps(st.pos[2] + i));
+    __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(rx, rx), _mm_mul_ps(ry, ry)), _mm_mul_ps(rz, rz));
+    __m128 inv_len = _mm_and_ps(_mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(d2)), _mm_cmpgt_ps(d2, zero));
+    __m128 cosi = _mm_add_ps(_mm_add_ps(
+        _mm_mul_ps(_mm_loadu_ps(st.nrm[0] + i), rx),
+        _mm_mul_ps(_mm_loadu_ps(st.nrm[1] + i), ry)),
+        _mm_mul_ps(_mm_loadu_ps(st.nrm[2] + i), rz));
+    __m128 cosj = _mm_add_ps(_mm_add_ps(
+        _mm_mul_ps(_mm_set1_ps(-s->normal[0]), rx),
+        _mm_mul_ps(_mm_set1_ps(-s->normal[1]), ry)),
+        _mm_mul_ps(_mm_set1_ps(-s->normal[2]), rz));
+    __m128 cc = _mm_mul_ps(_mm_mul_ps(cosi, cosj), _mm_mul_ps(inv_len, inv_len));
+    __m128 denom = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(RADIOSITY_CPU_PI), d2), _mm_set1_ps(st.texel_area));
+    __m128 f = _mm_div_ps(_mm_mul_ps(_mm_max_ps(cc, zero), _mm_set1_ps(st.texel_area)), denom);
+    _mm_storeu_ps(out, f);
+}
+#endif
+
+static float form_factor(unsigned int i, const struct shooter* s)
+{
+    float r[3], d2 = 0.0f, cosi = 0.0f, cosj = 0.0f;
+    for (int c = 0; c < 3; ++c) {
+        r[c] = s->position[c] - st.pos[c][i];
+        d2 += r[c] * r[c];
+    }
+    if (d2 <= 0.0f)
+        return 0.0f;
+    for (int c = 0; c < 3; ++c) {
+        cosi += st.nrm[c][i] * r[c];
+        cosj -= s->normal[c] * r[c];
+    }
+    float cc = cosi * cosj / d2;
+    return (cc > 0.0f ? cc : 0.0f) * st.texel_area / (RADIOSITY_CPU_PI * d2 + st.texel_area);
+}
+
+static void shoot_texel(unsigned int i, const float* ff)
+{
+    float gi[3] = { 0.0f, 0.0f, 0.0f };
+    int is_shooter = 0;
+    for (int j = 0; j < st.num_shooters; ++j) {
+        const struct shooter* s = &st.shooters[j];
+        /* A shooter has its unshot energy emptied and does not receive from itself */
+        if (s->texel == i) {
+            is_shooter = 1;
+            continue;
+        }
+        if (ff[j] <= 0.0f || !visible(i, s))
+            continue;
+        for (int c = 0; c < 3; ++c)
+            gi[c] += s->unshot[c] * st.alb[c][i] * ff[j];
+    }
+    for (int c = 0; c < 3; ++c) {
+        st.acc[c][i] += gi[c];
+        st.ush[c][i] = (is_shooter ? 0.0f : st.ush[c][i]) + gi[c];
+    }
+}
+
+static void shoot_rows(void* ud, unsigned int job)
+{
+    (void) ud;
+    unsigned int y0 = job * ROWS_PER_JOB;
+    unsigned int y1 = y0 + ROWS_PER_JOB < st.height ? y0 + ROWS_PER_JOB : st.height;
+    for (unsigned int y = y0; y < y1; ++y) {
+        unsigned int x = 0, row = y * st.width;
+#ifdef __SSE2__
+        for (; x + 4 <= st.width; x += 4) {
+            float ff[RADIOSITY_MAX_BATCH][4], lane_ff[RADIOSITY_MAX_BATCH];
+            for (int j = 0; j < st.num_shooters; ++j)
+                form_factors4(ff[j], row + x, &st.shooters[j]);
+            for (unsigned int l = 0; l < 4; ++l) {
+                for (int j = 0; j < st.num_shooters; ++j)
+                    lane_ff[j] = ff[j][l];
+                shoot_texel(row + x + l, lane_ff);
+            }
+        }
+#endif
+        for (; x < st.width; ++x) {
+            float ff[RADIOSITY_MAX_BATCH];
+            for (int j = 0; j < st.num_shooters; ++j)
+                ff[j] = form_factor(row + x, &st.shooters[j]);
+            shoot_texel(row + x, ff);
+        }
+    }
+}
+
+void radiosity_cpu_gi_pass()
+{
+    if (st.converged)
+        return;
+    select_shooters();
+    if (st.converged || st.num_shooters == 0)
+        return;
+    unsigned int num_jobs = (st.height + ROWS_PER_JOB - 1) / ROWS_PER_JOB;
+    threadpool_run(st.pool, shoot_rows, 0, num_jobs);
+    st.iterations += st.num_shooters;
+}
+
+unsigned long radiosity_cpu_iterations() { return st.iterations; }
+
+float radiosity_cpu_residual()
+{
+    if (!st.residual_known)
+        return 1.0f;
+    if (st.initial_energy <= 0.0f)
+        return 0.0f;
+    return st.residual_energy / st.initial_energy;
+}
+
+void radiosity_cpu_set_threshold(float threshold) { st.threshold = threshold; }
+
+void radiosity_cpu_set_lightmap_area(float area)
+{
+    st.texel_area = area / ((float)st.width * st.height);
+}
+
+void radiosity_cpu_set_batch_size(int batch_size)
+{
+    st.batch_size = batch_size < 1 ? 1 : (batch_size > RADIOSITY_MAX_BATCH ? RADIOSITY_MAX_BATCH : batch_size);
+}
+
+int radiosity_cpu_converged() { return st.converged; }
+
+static void interleave(float* rgb, float* const soa[3])
+{
+    size_t num_texels = (size_t)st.width * st.height;
+    for (size_t i = 0; i < num_texels; ++i)
+        for (int c = 0; c < 3; ++c)
+            rgb[3 * i + c] = soa[c][i];
+}
+
+void radiosity_cpu_lightmap(float* rgb) { interleave(rgb, st.acc); }
+void radiosity_cpu_unshot(float* rgb) { interleave(rgb, st.ush); }
@@ -0,0 +1,67 @@
+/*********************************************************************************************************************/
+/*                                                  /===-_---~~~~~~~~~------____                                     */
+/*                                                 |===-~___                _,-'                                     */
+/*                  -==\\                         `//~\\   ~~~~`---.___.-~~                                          */
+/*              ______-==|                         | |  \\           _-~`                                            */
+/*        __--~~~  ,-/-==\\                        | |   `\        ,'                                                */
+/*     _-~       /'    |  \\                      / /      \      /                                                  */
+/*   .'        /       |   \\                   /' /        \   /'                                                   */
+/*  /  ____  /         |    \`\.__/-~~ ~ \ _ _/'  /          \/'                                                     */
+/* /-'~    ~~~~~---__  |     ~-/~         ( )   /'        _--~`                                                      */
+/*                   \_|      /        _)   ;  ),   __--~~                                                           */
+/*                     '~~--_/      _-~/-  / \   '-~ \                                                               */
+/*                    {\__--_/}    / \\_>- )<__\      \                                                              */
+/*                    /'   (_/  _-~  | |__>--<__|      |                                                             */
+/*                   |0  0 _/) )-~     | |__>--<__|     |                                                            */
+/*                   / /~ ,_/       / /__>---<__/      |                                                             */
+/*                  o o _//        /-~_>---<__-~      /                                                              */
+/*                  (^(~          /~_>---<__-      _-~                                                               */
+/*                 ,/|           /__>--<__/     _-~                                                                  */
+/*              ,//('(          |__>--<__|     /                  .----_                                             */
+/*             ( ( '))          |__>--<__|    |                 /' _---_~\                                           */
+/*          `-)) )) (           |__>--<__|    |               /'  /     ~\`\                                         */
+/*         ,/,'//( (             \__>--<__\    \            /'  //        ||                                         */
+/*       ,( ( ((, ))              ~-__>--<_~-_  ~--____---~' _/'/        /'                                          */
+/*     `~/  )` ) ,/|                 ~-_~>--<_/-__       __-~ _/                                                     */
+/*   ._-~//( )/ )) `                    ~~-'_/_/ /~~~~~~~__--~                                                       */
+/*    ;'( ')/ ,)(                              ~~~~~~~~~~                                                            */
+/*   ' ') '( (/                                                                                                      */
+/*     '   '  `                                                                                                      */
+#ifndef _RADIOSITY_CPU_H_
+#define _RADIOSITY_CPU_H_
+
+/*
+ * Reference implementation of the progressive radiosity solver on the cpu.
+ * Mirrors radiosity.h: same shooter selection, same disc approximation form factor,
+ * but with ray cast visibility against the scene triangles instead of hemicubes.
+ * Attribute and lightmap arrays are RGB floats, row by row, bottom row first.
+ */
+
+/* Zero threads selects one per online cpu */
+void radiosity_cpu_init(int width, int height, unsigned int num_threads);
+void radiosity_cpu_destroy();
+
+/* Triangles tested for visibility between shooters and receivers, 3 floats per vertex */
+void radiosity_cpu_set_scene(const float* positions, unsigned int num_vertices, const unsigned int* indices, unsigned int num_indices);
+/* Attribute pass results, resets the solution */
+void radiosity_cpu_set_attributes(const float* position, const float* normal, const float* albedo, const float* unshot);
+/* Shares the attribute textures of the gpu solver's last attribute pass */
+void radiosity_cpu_fetch_attributes();
+
+void radiosity_cpu_gi_pass();
+/* Shooters shot since the attribute pass, fewer than requested once few texels have energy left */
+unsigned long radiosity_cpu_iterations();
+
+/* Unshot energy left as a fraction of the initially emitted energy */
+float radiosity_cpu_residual();
+void radiosity_cpu_set_threshold(float threshold);
+/* Number of brightest texels shot together per gi pass, clamped to [1, RADIOSITY_MAX_BATCH] */
+void radiosity_cpu_set_batch_size(int batch_size);
+/* World space area the unit lightmap square maps to, same as radiosity_set_lightmap_area */
+void radiosity_cpu_set_lightmap_area(float area);
+int  radiosity_cpu_converged();
+
+void radiosity_cpu_lightmap(float* rgb);
+void radiosity_cpu_unshot(float* rgb);
+
+#endif /* ! _RADIOSITY_CPU_H_ */
@@ -0,0 +1,560 @@
+#include "scene.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <glad/glad.h>
+#include <linalgb.h>
+#include "cornell_box.h"
+#include "uvmap.h"
+#include "mesh_import.h"
+#include "bake_cache.h"
+#include "baked_scene.h"
+#include "radiosity.h"
+
+struct cornell_box {
+    float* vertices;
+    size_t num_vertices;
+    float* colors;
+    size_t num_colors;
+    float* normals;
+    size_t num_normals;
+    float* lmuvs;
+    size_t num_lmuvs;
+    unsigned int* indices;
+    size_t num_indices;
+};
+
+static unsigned int pack_snorm10x3(const float* n)
+{
+    unsigned int p = 0;
+    for (int k = 0; k < 3; ++k) {
+        float c = n[k] < -1.0f ? -1.0f : (n[k] > 1.0f ? 1.0f : n[k]);
+        int v = (int)(c * 511.0f + (c < 0.0f ? -0.5f : 0.5f));
+        p |= ((unsigned int)v & 0x3FF) << (10 * k);
+    }
+    return p;
+}
+
+static unsigned char pack_unorm8(float v)
+{
+    v = v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+    return (unsigned char)(v * 255.0f + 0.5f);
+}
+
+static unsigned short pack_unorm16(float v)
+{
+    v = v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+    return (unsigned short)(v * 65535.0f + 0.5f);
+}
+
+/* Rounds to nearest even, out of range values become infinity */
+static unsigned short pack_half(float f)
+{
+    unsigned int u;
+    memcpy(&u, &f, sizeof(u));
+    unsigned int sign = (u >> 16) & 0x8000;
+    unsigned int mag = u & 0x7FFFFFFF;
+    if (mag >= 0x47800000)
+        return sign | (mag > 0x7F800000 ? 0x7E00 : 0x7C00);
+    if (mag < 0x38800000) {
+        /* Subnormal, scaled to units of the smallest half */
+        memcpy(&f, &mag, sizeof(f));
+        return sign | (unsigned short)lrintf(f * 16777216.0f);
+    }
+    /* Rebias the exponent and round off the low 13 mantissa bits */
+    mag += 0xC8000FFF + ((mag >> 13) & 1);
+    return sign | (mag >> 13);
+}
+
+/* World space area over lightmap uv area summed over all triangles, the charts share one scale
+ * so this is the area the whole unit lightmap square would cover */
+static float lightmap_area(const struct scene_vis_vertex* vertices, const unsigned int* indices, unsigned int num_indices)
+{
+    double world = 0.0, uv = 0.0;
+    for (unsigned int i = 0; i + 2 < num_indices; i += 3) {
+        const struct scene_vis_vertex* v[3] = { &vertices[indices[i]], &vertices[indices[i + 1]], &vertices[indices[i + 2]] };
+        double e1[3], e2[3];
+        for (int k = 0; k < 3; ++k) {
+            e1[k] = v[1]->position[k] - v[0]->position[k];
+            e2[k] = v[2]->position[k] - v[0]->position[k];
+        }
+        double n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+        world += 0.5 * sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        double u1 = ((double)v[1]->lm_uv[0] - v[0]->lm_uv[0]) / 65535.0, w1 = ((double)v[1]->lm_uv[1] - v[0]->lm_uv[1]) / 65535.0;
+        double u2 = ((double)v[2]->lm_uv[0] - v[0]->lm_uv[0]) / 65535.0, w2 = ((double)v[2]->lm_uv[1] - v[0]->lm_uv[1]) / 65535.0;
+        uv += 0.5 * fabs(u1 * w2 - u2 * w1);
+    }
+    return uv > 0.0 ? (float)(world / uv) : 0.0f;
+}
+
+/* Uploads both vertex streams and the indices, the element buffer is attached to both vertex arrays */
+static void upload_mesh(struct scene_mesh* m, const void* vertices, const void* vis_vertices, unsigned int num_vertices, const void* indices, unsigned int num_indices)
+{
+    memset(m, 0, sizeof(*m));
+    glGenBuffers(1, &m->ebo);
+    glGenBuffers(1, &m->vbo);
+    glGenBuffers(1, &m->vis_vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, m->vbo);
+    glBufferData(GL_ARRAY_BUFFER, (size_t)num_vertices * sizeof(struct scene_vertex), vertices, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, m->vis_vbo);
+    glBufferData(GL_ARRAY_BUFFER, (size_t)num_vertices * sizeof(struct scene_vis_vertex), vis_vertices, GL_STATIC_DRAW);
+
+    const GLuint pos_attrib = 0, nrm_attrib = 1, col_attrib = 2, lm_uvs_attrib = 3, ems_attrib = 4;
+    glGenVertexArrays(1, &m->vao);
+    glBindVertexArray(m->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, m->vbo);
+    GLsizei stride = sizeof(struct scene_vertex);
+    glEnableVertexAttribArray(pos_attrib);
+    glVertexAttribPointer(pos_attrib, 3, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(struct scene_vertex, position));
+    glEnableVertexAttribArray(nrm_attrib);
+    glVertexAttribPointer(nrm_attrib, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)offsetof(struct scene_vertex, normal));
+    glEnableVertexAttribArray(col_attrib);
+    glVertexAttribPointer(col_attrib, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void*)offsetof(struct scene_vertex, color));
+    glEnableVertexAttribArray(lm_uvs_attrib);
+    glVertexAttribPointer(lm_uvs_attrib, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)offsetof(struct scene_vertex, lm_uv));
+    glEnableVertexAttribArray(ems_attrib);
+    glVertexAttribPointer(ems_attrib, 4, GL_HALF_FLOAT, GL_FALSE, stride, (void*)offsetof(struct scene_vertex, emission));
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m->ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, (size_t)num_indices * sizeof(GLuint), indices, GL_STATIC_DRAW);
+
+    glGenVertexArrays(1, &m->vis_vao);
+    glBindVertexArray(m->vis_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, m->vis_vbo);
+    stride = sizeof(struct scene_vis_vertex);
+    glEnableVertexAttribArray(pos_attrib);
+    glVertexAttribPointer(pos_attrib, 3, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(struct scene_vis_vertex, position));
+    glEnableVertexAttribArray(lm_uvs_attrib);
+    glVertexAttribPointer(lm_uvs_attrib, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)offsetof(struct scene_vis_vertex, lm_uv));
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m->ebo);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    m->num_vertices = num_vertices;
+    m->num_indices = num_indices;
+    m->lm_area = lightmap_area(vis_vertices, indices, num_indices);
+}
+
+/* Packs per vertex float attributes (3 floats each, 2 for the uvs) into both streams and uploads them.
+ * Emissions are optional, null for a mesh that does not emit */
+static void load_mesh(struct scene_mesh* m, const float* positions, const float* normals, const float* colors, const float* emissions, const float* lm_uvs, size_t num_vertices, const unsigned int* indices, size_t num_indices)
+{
+    struct scene_vertex* vertices = malloc(num_vertices * sizeof(*vertices));
+    struct scene_vis_vertex* vis_vertices = malloc(num_vertices * sizeof(*vis_vertices));
+    for (size_t i = 0; i < num_vertices; ++i) {
+        struct scene_vertex* v = &vertices[i];
+        memcpy(v->position, positions + 3 * i, sizeof(v->position));
+        v->normal = pack_snorm10x3(normals + 3 * i);
+        for (int k = 0; k < 3; ++k)
+            v->color[k] = pack_unorm8(colors[3 * i + k]);
+        v->color[3] = 255;
+        v->lm_uv[0] = pack_unorm16(lm_uvs[2 * i + 0]);
+        v->lm_uv[1] = pack_unorm16(lm_uvs[2 * i + 1]);
+        for (int k = 0; k < 3; ++k)
+            v->emission[k] = emissions ? pack_half(emissions[3 * i + k]) : 0;
+        v->emission[3] = 0;
+        memcpy(vis_vertices[i].position, v->position, sizeof(v->position));
+        memcpy(vis_vertices[i].lm_uv, v->lm_uv, sizeof(v->lm_uv));
+    }
+    upload_mesh(m, vertices, vis_vertices, num_vertices, indices, num_indices);
+    free(vis_vertices);
+    free(vertices);
+}
+
+static void unpack_attrib(float* attrib_out, float* attrib_in, size_t attrib_sz, unsigned int* indices, size_t num_indices)
+{
+    for (size_t i = 0; i < num_indices; ++i) {
+        unsigned int ind = indices[i];
+        float* from = (float*)(((unsigned char*)attrib_in) + attrib_sz * ind);
+        float* to = (float*)(((unsigned char*)attrib_out) + attrib_sz * i);
+        memcpy(to, from, attrib_sz);
+    }
+}
+
+/* Must free output cornell box's data */
+static void unpack_cornell_box(struct cornell_box* cbout, struct cornell_box* cbin)
+{
+    cbout->num_indices  = cbin->num_indices;
+    cbout->num_vertices = cbin->num_indices * 3;
+    cbout->num_colors   = cbin->num_indices * 3;
+    cbout->num_normals  = cbin->num_indices * 3;
+    cbout->vertices     = malloc(cbout->num_vertices * sizeof(float) * 3);
+    cbout->colors       = malloc(cbout->num_colors   * sizeof(float) * 3);
+    cbout->normals      = malloc(cbout->num_normals  * sizeof(float) * 3);
+    cbout->indices      = malloc(cbout->num_indices  * sizeof(unsigned int));
+    unpack_attrib(cbout->vertices, cbin->vertices, sizeof(float) * 3, cbin->indices, cbin->num_indices);
+    unpack_attrib(cbout->colors,   cbin->colors,   sizeof(float) * 3, cbin->indices, cbin->num_indices);
+    unpack_attrib(cbout->normals,  cbin->normals,  sizeof(float) * 3, cbin->indices, cbin->num_indices);
+    for (size_t i = 0; i < cbin->num_indices; ++i)
+        cbout->indices[i] = i;
+}
+
+static void free_upacked_cornell_box(struct cornell_box* cbox)
+{
+    free(cbox->vertices);
+    free(cbox->colors);
+    free(cbox->normals);
+    free(cbox->indices);
+}
+
+/* Splits every triangle of an unpacked cornell box into four, replacing its data */
+static void subdivide_cornell_box(struct cornell_box* cbox)
+{
+    size_t num_tris = cbox->num_indices / 3;
+    struct cornell_box sub;
+    sub.num_indices  = cbox->num_indices * 4;
+    sub.num_vertices = sub.num_indices * 3;
+    sub.num_colors   = sub.num_indices * 3;
+    sub.num_normals  = sub.num_indices * 3;
+    sub.vertices     = malloc(sub.num_indices * sizeof(float) * 3);
+    sub.colors       = malloc(sub.num_indices * sizeof(float) * 3);
+    sub.normals      = malloc(sub.num_indices * sizeof(float) * 3);
+    sub.indices      = malloc(sub.num_indices * sizeof(unsigned int));
+
+    /* Corner and edge midpoint indices of the four new triangles, midpoints are 3 + edge */
+    static const unsigned int split[4][3] = { {0, 3, 5}, {3, 1, 4}, {5, 4, 2}, {3, 4, 5} };
+    for (size_t t = 0; t < num_tris; ++t) {
+        float p[6][3], c[6][3];
+        for (unsigned int j = 0; j < 3; ++j) {
+            memcpy(p[j], cbox->vertices + 9 * t + 3 * j, sizeof(p[j]));
+            memcpy(c[j], cbox->colors + 9 * t + 3 * j, sizeof(c[j]));
+        }
+        for (unsigned int e = 0; e < 3; ++e) {
+            for (unsigned int k = 0; k < 3; ++k) {
+                p[3 + e][k] = 0.5f * (p[e][k] + p[(e + 1) % 3][k]);
+                c[3 + e][k] = 0.5f * (c[e][k] + c[(e + 1) % 3][k]);
+            }
+        }
+        for (unsigned int n = 0; n < 4; ++n) {
+            for (unsigned int j = 0; j < 3; ++j) {
+                size_t v = 12 * t + 3 * n + j;
+                memcpy(sub.vertices + 3 * v, p[split[n][j]], sizeof(p[0]));
+                memcpy(sub.colors + 3 * v, c[split[n][j]], sizeof(c[0]));
+                memcpy(sub.normals + 3 * v, cbox->normals + 9 * t + 3 * j, 3 * sizeof(float));
+            }
+        }
+    }
+    for (size_t i = 0; i < sub.num_indices; ++i)
+        sub.indices[i] = i;
+
+    free_upacked_cornell_box(cbox);
+    *cbox = sub;
+}
+
+/* Replicates an unpacked cornell box on a square grid along the floor, replacing its data */
+static void instance_cornell_box(struct cornell_box* cbox, unsigned int instances)
+{
+    const float spacing = 600.0f;
+    unsigned int grid = 1;
+    while (grid * grid < instances)
+        ++grid;
+
+    struct cornell_box inst;
+    size_t n = cbox->num_indices;
+    inst.num_indices  = n * instances;
+    inst.num_vertices = inst.num_indices * 3;
+    inst.num_colors   = inst.num_indices * 3;
+    inst.num_normals  = inst.num_indices * 3;
+    inst.vertices     = malloc(inst.num_indices * sizeof(float) * 3);
+    inst.colors       = malloc(inst.num_indices * sizeof(float) * 3);
+    inst.normals      = malloc(inst.num_indices * sizeof(float) * 3);
+    inst.indices      = malloc(inst.num_indices * sizeof(unsigned int));
+    for (unsigned int i = 0; i < instances; ++i) {
+        float ox = spacing * (i % grid), oz = spacing * (i / grid);
+        for (size_t v = 0; v < n; ++v) {
+            float* to = inst.vertices + 3 * (i * n + v);
+            const float* from = cbox->vertices + 3 * v;
+            to[0] = from[0] + ox;
+            to[1] = from[1];
+            to[2] = from[2] + oz;
+        }
+        memcpy(inst.colors + 3 * i * n, cbox->colors, n * sizeof(float) * 3);
+        memcpy(inst.normals + 3 * i * n, cbox->normals, n * sizeof(float) * 3);
+    }
+    for (size_t i = 0; i < inst.num_indices; ++i)
+        inst.indices[i] = i;
+
+    free_upacked_cornell_box(cbox);
+    *cbox = inst;
+}
+
+static void cornell_box_load(struct scene_mesh* m, unsigned int lm_width, unsigned int lm_height, const float* lm_uvs, unsigned int subdiv_levels, unsigned int instances)
+{
+    /* Bundle cornell box data */
+    struct cornell_box cbox_packed;
+    cbox_packed.vertices     = (float*) cornell_box_vertices;
+    cbox_packed.num_vertices = (sizeof(cornell_box_vertices) / sizeof(cornell_box_vertices[0])) / 3;
+    cbox_packed.colors       = (float*) cornell_box_colors;
+    cbox_packed.num_colors   = (sizeof(cornell_box_colors) / sizeof(cornell_box_colors[0])) / 3;
+    cbox_packed.normals      = (float*) cornell_box_normals;
+    cbox_packed.num_normals  = (sizeof(cornell_box_normals) / sizeof(cornell_box_normals[0])) / 3;
+    cbox_packed.indices      = (unsigned int*) cornell_box_indices;
+    cbox_packed.num_indices  = sizeof(cornell_box_indices) / sizeof(cornell_box_indices[0]);
+
+    /* Unpack cbox */
+    struct cornell_box cbox_unpacked;
+    unpack_cornell_box(&cbox_unpacked, &cbox_packed);
+
+    /* Synthetic variants */
+    for (unsigned int i = 0; i < subdiv_levels; ++i)
+        subdivide_cornell_box(&cbox_unpacked);
+    if (instances > 1)
+        instance_cornell_box(&cbox_unpacked, instances);
+    struct cornell_box cbox = cbox_unpacked;
+
+    /* Generate lightmap uvs, unless given from an earlier load */
+    cbox.num_lmuvs = cbox.num_vertices;
+    cbox.lmuvs = calloc(cbox.num_lmuvs, sizeof(vec2));
+    if (lm_uvs) {
+        memcpy(cbox.lmuvs, lm_uvs, cbox.num_indices * sizeof(vec2));
+    } else {
+        uvmap_planar_project(
+            (vec2*) cbox.lmuvs,
+            (vec3*) cbox.vertices,
+            (vec3*) cbox.normals,
+            cbox.num_vertices,
+            cbox.indices,
+            cbox.num_indices,
+            lm_width, lm_height, SCENE_LM_PADDING);
+    }
+
+    /* Load model, unpacked so that there is a vertex per index */
+    load_mesh(m, cbox.vertices, cbox.normals, cbox.colors, 0, cbox.lmuvs, cbox.num_indices, cbox.indices, cbox.num_indices);
+    free(cbox.lmuvs);
+    free_upacked_cornell_box(&cbox_unpacked);
+}
+
+void scene_cornell_box_load(struct scene_mesh* m, unsigned int lm_width, unsigned int lm_height)
+{
+    cornell_box_load(m, lm_width, lm_height, 0, 0, 1);
+}
+
+void scene_cornell_box_load_variant(struct scene_mesh* m, unsigned int lm_width, unsigned int lm_height, unsigned int subdiv_levels, unsigned int instances)
+{
+    cornell_box_load(m, lm_width, lm_height, 0, subdiv_levels, instances);
+}
+
+void scene_cornell_box_load_uvs(struct scene_mesh* m, const float* lm_uvs)
+{
+    cornell_box_load(m, 0, 0, lm_uvs, 0, 1);
+}
+
+int scene_mesh_load_file(struct scene_mesh* m, const char* fpath, unsigned int lm_width, unsigned int lm_height, const float* lm_uvs)
+{
+    struct mesh_data md;
+    if (!mesh_import(&md, fpath))
+        return 0;
+
+    /* Charts split the welded vertices where they meet, gather attributes through the remap */
+    vec2* uvs;
+    unsigned int* remap;
+    size_t num_vertices = uvmap_chart_project(
+        &uvs, &remap,
+        (vec3*) md.positions,
+        md.num_vertices,
+        md.indices,
+        md.num_indices,
+        lm_width, lm_height, SCENE_LM_PADDING);
+    if (lm_uvs)
+        memcpy(uvs, lm_uvs, num_vertices * sizeof(vec2));
+
+    float* positions = malloc(num_vertices * sizeof(float) * 3);
+    float* normals   = malloc(num_vertices * sizeof(float) * 3);
+    float* colors    = malloc(num_vertices * sizeof(float) * 3);
+    float* emissions = malloc(num_vertices * sizeof(float) * 3);
+    unpack_attrib(positions, md.positions, sizeof(float) * 3, remap, num_vertices);
+    unpack_attrib(normals,   md.normals,   sizeof(float) * 3, remap, num_vertices);
+    unpack_attrib(colors,    md.colors,    sizeof(float) * 3, remap, num_vertices);
+    unpack_attrib(emissions, md.emissions, sizeof(float) * 3, remap, num_vertices);
+    load_mesh(m, positions, normals, colors, emissions, (float*) uvs, num_vertices, md.indices, md.num_indices);
+
+    free(emissions);
+    free(colors);
+    free(normals);
+    free(positions);
+    free(remap);
+    free(uvs);
+    mesh_data_free(&md);
+    return 1;
+}
+
+void scene_mesh_load_baked(struct scene_mesh* m, const struct baked_scene* bs)
+{
+    /* Both vertex sections are stored in the buffer layouts */
+    upload_mesh(m, bs->vertices.data, bs->vis_vertices.data, bs->vertices.count, bs->indices.data, bs->indices.count);
+}
+
+void scene_cornell_box_light(struct radiosity_light* l)
+{
+    memset(l, 0, sizeof(*l));
+    l->type = RADIOSITY_LIGHT_POINT;
+    memcpy(l->position, cornell_box_light_pos, sizeof(l->position));
+    l->color[0] = l->color[1] = l->color[2] = 1.0f;
+    l->intensity = cornell_box_light_intensity;
+}
+
+/* Parses one light list line into l, returns 0 for a malformed line */
+static int parse_light(struct radiosity_light* l, const char* line)
+{
+    char type[16];
+    int n;
+    if (sscanf(line, "%15s%n", type, &n) != 1)
+        return 0;
+    line += n;
+    memset(l, 0, sizeof(*l));
+    float* p = l->position, *d = l->direction, *c = l->color, *c1 = l->corner1, *c2 = l->corner2;
+    float inner, outer;
+    int got;
+    if (strcmp(type, "point") == 0) {
+        l->type = RADIOSITY_LIGHT_POINT;
+        got = sscanf(line, "%f %f %f %f %f %f %f %f", &p[0], &p[1], &p[2], &c[0], &c[1], &c[2], &l->intensity, &l->range);
+        return got >= 7;
+    } else if (strcmp(type, "spot") == 0) {
+        l->type = RADIOSITY_LIGHT_SPOT;
+        got = sscanf(line, "%f %f %f %f %f %f %f %f %f %f %f %f %f", &p[0], &p[1], &p[2], &d[0], &d[1], &d[2],
+                     &c[0], &c[1], &c[2], &l->intensity, &inner, &outer, &l->range);
+        if (got < 12)
+            return 0;
+        const float to_rad = 3.14159265f / 180.0f;
+        l->cos_inner = cosf(inner * to_rad);
+        l->cos_outer = cosf(outer * to_rad);
+        return 1;
+    } else if (strcmp(type, "area") == 0) {
+        l->type = RADIOSITY_LIGHT_AREA;
+        got = sscanf(line, "%f %f %f %f %f %f %f %f %f %f %f %f %f %f", &p[0], &p[1], &p[2], &c1[0], &c1[1], &c1[2],
+                     &c2[0], &c2[1], &c2[2], &c[0], &c[1], &c[2], &l->intensity, &l->range);
+        return got >= 13;
+    }
+    return 0;
+}
+
+int scene_lights_load(struct radiosity_light** lights, unsigned int* num_lights, const char* fpath)
+{
+    *lights = 0;
+    *num_lights = 0;
+    FILE* f = fopen(fpath, "r");
+    if (!f) {
+        fprintf(stderr, "Could not open %s\n", fpath);
+        return 0;
+    }
+    char line[512];
+    unsigned int cap = 0, line_no = 0;
+    int ok = 1;
+    while (ok && fgets(line, sizeof(line), f)) {
+        ++line_no;
+        char* comment = strchr(line, '#');
+        if (comment)
+            *comment = 0;
+        if (strspn(line, " \t\r\n") == strlen(line))
+            continue;
+        if (*num_lights == cap) {
+            cap = cap ? 2 * cap : 16;
+            *lights = realloc(*lights, cap * sizeof(**lights));
+        }
+        ok = parse_light(&(*lights)[*num_lights], line);
+        if (ok)
+            ++*num_lights;
+        else
+            fprintf(stderr, "Could not parse %s:%u\n", fpath, line_no);
+    }
+    fclose(f);
+    if (!ok) {
+        free(*lights);
+        *lights = 0;
+        *num_lights = 0;
+    }
+    return ok;
+}
+
+unsigned long long scene_cornell_box_hash(unsigned long long h)
+{
+    h = bake_cache_hash(h, cornell_box_vertices, sizeof(cornell_box_vertices));
+    h = bake_cache_hash(h, cornell_box_normals, sizeof(cornell_box_normals));
+    h = bake_cache_hash(h, cornell_box_colors, sizeof(cornell_box_colors));
+    h = bake_cache_hash(h, cornell_box_indices, sizeof(cornell_box_indices));
+    return h;
+}
+
+unsigned long long scene_file_hash(unsigned long long h, const char* fpath)
+{
+    /* Material libraries are not hashed, edits to a .mtl alone need the bake cache cleared */
+    return bake_cache_hash_file(h, fpath);
+}
+
+void scene_mesh_draw(struct scene_mesh* m)
+{
+    glBindVertexArray(m->vao);
+    glDrawElements(GL_TRIANGLES, m->num_indices, GL_UNSIGNED_INT, 0);
+    glBindVertexArray(0);
+}
+
+void scene_mesh_draw_visibility(struct scene_mesh* m)
+{
+    glBindVertexArray(m->vis_vao);
+    glDrawElements(GL_TRIANGLES, m->num_indices, GL_UNSIGNED_INT, 0);
+    glBindVertexArray(0);
+}
+
+void scene_mesh_free(struct scene_mesh* m)
+{
+    glDeleteBuffers(1, &m->ebo);
+    glDeleteBuffers(1, &m->vis_vbo);
+    glDeleteBuffers(1, &m->vbo);
+    glDeleteVertexArrays(1, &m->vis_vao);
+    glDeleteVertexArrays(1, &m->vao);
+    memset(m, 0, sizeof(*m));
+}
+
+static struct scene_vis_vertex* read_vis_vertices(struct scene_mesh* m)
+{
+    struct scene_vis_vertex* vis_vertices = malloc((size_t)m->num_vertices * sizeof(*vis_vertices));
+    glBindBuffer(GL_ARRAY_BUFFER, m->vis_vbo);
+    glGetBufferSubData(GL_ARRAY_BUFFER, 0, (size_t)m->num_vertices * sizeof(*vis_vertices), vis_vertices);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return vis_vertices;
+}
+
+void scene_mesh_read_geometry(struct scene_mesh* m, struct scene_geometry* g)
+{
+    g->num_vertices = m->num_vertices;
+    g->positions = malloc(g->num_vertices * 3 * sizeof(float));
+    struct scene_vis_vertex* vis_vertices = read_vis_vertices(m);
+    for (unsigned int i = 0; i < g->num_vertices; ++i)
+        memcpy(g->positions + 3 * i, vis_vertices[i].position, 3 * sizeof(float));
+    free(vis_vertices);
+
+    g->num_indices = m->num_indices;
+    g->indices = malloc(g->num_indices * sizeof(unsigned int));
+    glBindBuffer(GL_COPY_READ_BUFFER, m->ebo);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, g->num_indices * sizeof(unsigned int), g->indices);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+}
+
+void scene_mesh_read_vertices(struct scene_mesh* m, struct scene_vertex* vertices, struct scene_vis_vertex* vis_vertices)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, m->vbo);
+    glGetBufferSubData(GL_ARRAY_BUFFER, 0, (size_t)m->num_vertices * sizeof(*vertices), vertices);
+    glBindBuffer(GL_ARRAY_BUFFER, m->vis_vbo);
+    glGetBufferSubData(GL_ARRAY_BUFFER, 0, (size_t)m->num_vertices * sizeof(*vis_vertices), vis_vertices);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void scene_mesh_read_lm_uvs(struct scene_mesh* m, float* lm_uvs)
+{
+    /* Packing again gives back the same unorm16 values, so uvs handed to a later load stay exact */
+    struct scene_vis_vertex* vis_vertices = read_vis_vertices(m);
+    for (unsigned int i = 0; i < m->num_vertices; ++i) {
+        lm_uvs[2 * i + 0] = vis_vertices[i].lm_uv[0] / 65535.0f;
+        lm_uvs[2 * i + 1] = vis_vertices[i].lm_uv[1] / 65535.0f;
+    }
+    free(vis_vertices);
+}
+
+void scene_geometry_free(struct scene_geometry* g)
+{
+    free(g->indices);
+    free(g->positions);
+    memset(g, 0, sizeof(*g));
+}
@@ -0,0 +1,110 @@
+/*********************************************************************************************************************/
+/*                                                  /===-_---~~~~~~~~~------____                                     */
+/*                                                 |===-~___                _,-'                                     */
+/*                  -==\\                         `//~\\   ~~~~`---.___.-~~                                          */
+/*              ______-==|                         | |  \\           _-~`                                            */
+/*        __--~~~  ,-/-==\\                        | |   `\        ,'                                                */
+/*     _-~       /'    |  \\                      / /      \      /                                                  */
+/*   .'        /       |   \\                   /' /        \   /'                                                   */
+/*  /  ____  /         |    \`\.__/-~~ ~ \ _ _/'  /          \/'                                                     */
+/* /-'~    ~~~~~---__  |     ~-/~         ( )   /'        _--~`                                                      */
+/*                   \_|      /        _)   ;  ),   __--~~                                                           */
+/*                     '~~--_/      _-~/-  / \   '-~ \                                                               */
+/*                    {\__--_/}    / \\_>- )<__\      \                                                              */
+/*                    /'   (_/  _-~  | |__>--<__|      |                                                             */
+/*                   |0  0 _/) )-~     | |__>--<__|     |                                                            */
+/*                   / /~ ,_/       / /__>---<__/      |                                                             */
+/*                  o o _//        /-~_>---<__-~      /                                                              */
+/*                  (^(~          /~_>---<__-      _-~                                                               */
+/*                 ,/|           /__>--<__/     _-~                                                                  */
+/*              ,//('(          |__>--<__|     /                  .----_                                             */
+/*             ( ( '))          |__>--<__|    |                 /' _---_~\                                           */
+/*          `-)) )) (           |__>--<__|    |               /'  /     ~\`\                                         */
+/*         ,/,'//( (             \__>--<__\    \            /'  //        ||                                         */
+/*       ,( ( ((, ))              ~-__>--<_~-_  ~--____---~' _/'/        /'                                          */
+/*     `~/  )` ) ,/|                 ~-_~>--<_/-__       __-~ _/                                                     */
+/*   ._-~//( )/ )) `                    ~~-'_/_/ /~~~~~~~__--~                                                       */
+/*    ;'( ')/ ,)(                              ~~~~~~~~~~                                                            */
+/*   ' ') '( (/                                                                                                      */
+/*     '   '  `                                                                                                      */
+#ifndef _SCENE_H_
+#define _SCENE_H_
+
+/* Texels kept between charts of the generated lightmap uvs */
+#define SCENE_LM_PADDING 2
+
+struct baked_scene;
+struct radiosity_light;
+
+/* Interleaved vertex of the attribute pass and the camera views, 32 bytes */
+struct scene_vertex {
+    float position[3];
+    unsigned int normal;            /* GL_INT_2_10_10_10_REV, snorm xyz */
+    unsigned char color[4];         /* unorm8 rgb, alpha unused */
+    unsigned short lm_uv[2];        /* unorm16 */
+    unsigned short emission[4];     /* Half float rgb, zero for surfaces that do not emit */
+};
+
+/* Vertex of the visibility stream, only what the hemicube views read, 16 bytes */
+struct scene_vis_vertex {
+    float position[3];
+    unsigned short lm_uv[2];        /* unorm16 */
+};
+
+/* GPU resident scene mesh, vis_vbo duplicates position and uv so that the gi pass draws fetch 16 bytes per vertex */
+struct scene_mesh {
+    unsigned int vao, vbo;
+    unsigned int vis_vao, vis_vbo;
+    unsigned int ebo;
+    unsigned int num_indices;
+    unsigned int num_vertices;
+    /* World space area the unit lightmap uv square maps to, the solver divides it among the texels */
+    float lm_area;
+};
+
+/* CPU copy of the mesh positions, 3 floats per vertex */
+struct scene_geometry {
+    float* positions;
+    unsigned int num_vertices;
+    unsigned int* indices;
+    unsigned int num_indices;
+};
+
+/* Unpacks the builtin cornell box, generates its lightmap uvs for the given lightmap size and uploads it */
+void scene_cornell_box_load(struct scene_mesh* m, unsigned int lm_width, unsigned int lm_height);
+/* Same as above with the lightmap uvs of an earlier load (2 floats per vertex) instead of generating them */
+void scene_cornell_box_load_uvs(struct scene_mesh* m, const float* lm_uvs);
+/* Synthetic load scaling, every triangle split in four per subdivision level, then the box repeated on a grid */
+void scene_cornell_box_load_variant(struct scene_mesh* m, unsigned int lm_width, unsigned int lm_height, unsigned int subdiv_levels, unsigned int instances);
+/* Imports an OBJ or binary PLY mesh and uploads it indexed, returns 0 on failure.
+ * Lightmap uvs are generated per chart for the given lightmap size, unless given from an earlier load */
+int scene_mesh_load_file(struct scene_mesh* m, const char* fpath, unsigned int lm_width, unsigned int lm_height, const float* lm_uvs);
+/* Uploads the mesh of a baked scene container as is, the sections go straight to the buffers */
+void scene_mesh_load_baked(struct scene_mesh* m, const struct baked_scene* bs);
+/* Point light the builtin cornell box is lit by, also the default for imported meshes */
+void scene_cornell_box_light(struct radiosity_light* l);
+/* Reads a light list from a text file, returns 0 on failure. Free the lights with free. One light per line,
+ * # starts a comment, cone angles are in degrees and the range is optional:
+ *   point x y z  r g b  intensity [range]
+ *   spot  x y z  dx dy dz  r g b  intensity inner outer [range]
+ *   area  x0 y0 z0  x1 y1 z1  x2 y2 z2  r g b  radiance [range] */
+int scene_lights_load(struct radiosity_light** lights, unsigned int* num_lights, const char* fpath);
+/* Folds the builtin cornell box geometry and colors into the given hash */
+unsigned long long scene_cornell_box_hash(unsigned long long h);
+/* Folds the contents of a mesh file into the given hash */
+unsigned long long scene_file_hash(unsigned long long h, const char* fpath);
+/* Issues a single indexed draw call for the whole mesh */
+void scene_mesh_draw(struct scene_mesh* m);
+/* Same as above from the position and uv stream, for the draws of the radiosity gi pass */
+void scene_mesh_draw_visibility(struct scene_mesh* m);
+/* Releases the GPU resources of the mesh */
+void scene_mesh_free(struct scene_mesh* m);
+/* Reads the positions and indices of the mesh back from its GPU buffers, free with scene_geometry_free */
+void scene_mesh_read_geometry(struct scene_mesh* m, struct scene_geometry* g);
+/* Reads both vertex streams back from the GPU buffers as stored, num_vertices entries each */
+void scene_mesh_read_vertices(struct scene_mesh* m, struct scene_vertex* vertices, struct scene_vis_vertex* vis_vertices);
+/* Reads the lightmap uvs of the mesh back from its GPU buffer, 2 floats per vertex */
+void scene_mesh_read_lm_uvs(struct scene_mesh* m, float* lm_uvs);
+void scene_geometry_free(struct scene_geometry* g);
+
+#endif /* ! _SCENE_H_ */
@@ -1,7 +1,35 @@
 #include "shader_util.h"
 #include <stdlib.h>
 #include <stdio.h>
-#include <glad/glad.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+#include "opengl.h"
+
+#define array_length(a) (sizeof(a)/sizeof(a[0]))
+/* Programs that can be compiling at once before their status is queried */
+#define SHADER_MAX_PENDING 32
+#define PROGRAM_BINARY_MAGIC "TRPB"
+#define PROGRAM_BINARY_VERSION 1
+
+static struct {
+    /* Program binaries are kept here, caching is off when empty */
+    char cache_dir[512];
+    /* Binaries only load on the exact driver they came from */
+    unsigned long long driver_hash;
+    int driver_hashed;
+    /* Programs handed out before their compile and link were checked */
+    struct {
+        GLuint prog;
+        unsigned long long key;
+        /* Built from source, its binary goes to the cache once linked */
+        int store;
+    } pending[SHADER_MAX_PENDING];
+    unsigned int num_pending;
+} st;
 
 /*---------------------------------------------------------------------------
  * Parsing Utils
@@ -36,16 +64,257 @@ static void* read_file_to_mem_buf(const char* fpath, size_t* buf_sz)
     return data_buf;
 }
 
-static const char* shader_load_fsrc(const char* fpath)
+/* Splices given lines in right after the #version line, which has to stay first */
+static char* insert_defines(char* src, const char* defines)
+{
+    if (!src || !defines)
+        return src;
+    char* eol = strchr(src, '\n');
+    if (!eol)
+        return src;
+    size_t head = eol - src + 1, src_len = strlen(src), def_len = strlen(defines);
+    char* out = malloc(src_len + def_len + 1);
+    memcpy(out, src, head);
+    memcpy(out + head, defines, def_len);
+    memcpy(out + head + def_len, src + head, src_len - head + 1);
+    free(src);
+    return out;
+}
+
+static const char* shader_load_fsrc(const char* fpath, const char* defines)
 {
     if (!fpath)
         return 0;
-    return read_file_to_mem_buf(fpath, 0);
+    return insert_defines(read_file_to_mem_buf(fpath, 0), defines);
 }
 
-unsigned int shader_build(struct shader_attachment* attachments, size_t num_attachments)
+/*---------------------------------------------------------------------------
+ * Program Binary Cache
+ *---------------------------------------------------------------------------*/
+struct program_binary_header {
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint32_t format;
+    uint32_t length;
+    /* Of the binary that follows, guards against torn writes of concurrent launches */
+    uint64_t checksum;
+};
+
+static unsigned long long hash_bytes(unsigned long long h, const void* data, size_t sz)
 {
+    const unsigned char* p = data;
+    for (size_t i = 0; i < sz; ++i) {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static int program_binary_supported()
+{
+    if (!st.cache_dir[0])
+        return 0;
+    if (!HAS_OPENGL_EXTENSION(GL_ARB_get_program_binary)
+     && !(GL_VERSION_MAJ > 4 || (GL_VERSION_MAJ == 4 && GL_VERSION_MIN >= 1)))
+        return 0;
+    GLint num_formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+    return num_formats > 0;
+}
+
+static unsigned long long program_key(struct shader_attachment* attachments, size_t num_attachments)
+{
+    if (!st.driver_hashed) {
+        GLenum strs[] = { GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION };
+        unsigned long long h = 14695981039346656037ULL;
+        for (size_t i = 0; i < array_length(strs); ++i) {
+            const char* v = (const char*)glGetString(strs[i]);
+            h = hash_bytes(h, v ? v : "", v ? strlen(v) + 1 : 1);
+        }
+        st.driver_hash = h;
+        st.driver_hashed = 1;
+    }
+    unsigned long long h = st.driver_hash;
+    for (size_t i = 0; i < num_attachments; ++i) {
+        struct shader_attachment* sa = &attachments[i];
+        if (!sa->src)
+            continue;
+        h = hash_bytes(h, &sa->type, sizeof(sa->type));
+        h = hash_bytes(h, sa->src, strlen(sa->src) + 1);
+    }
+    return h;
+}
+
+static void program_binary_path(char* buf, size_t buf_sz, unsigned long long key)
+{
+    snprintf(buf, buf_sz, "%s/%016llx.bin", st.cache_dir, key);
+}
+
+/* Links the program from a cached binary, fails on a miss or when the driver rejects it */
+static int program_binary_load(GLuint prog, unsigned long long key)
+{
+    char fpath[600];
+    program_binary_path(fpath, sizeof(fpath), key);
+    FILE* f = fopen(fpath, "rb");
+    if (!f)
+        return 0;
+
+    struct program_binary_header hdr;
+    void* data = 0;
+    int ok = fread(&hdr, sizeof(hdr), 1, f) == 1
+          && memcmp(hdr.magic, PROGRAM_BINARY_MAGIC, 4) == 0
+          && hdr.version == PROGRAM_BINARY_VERSION
+          && hdr.key == key
+          && (data = malloc(hdr.length)) != 0
+          && fread(data, 1, hdr.length, f) == hdr.length
+          && hash_bytes(14695981039346656037ULL, data, hdr.length) == hdr.checksum;
+    fclose(f);
+    if (ok) {
+        glProgramBinary(prog, hdr.format, data, hdr.length);
+        GLint status = GL_FALSE;
+        glGetProgramiv(prog, GL_LINK_STATUS, &status);
+        ok = status == GL_TRUE;
+    }
+    free(data);
+    return ok;
+}
+
+static void program_binary_store(GLuint prog, unsigned long long key)
+{
+    GLint length = 0;
+    glGetProgramiv(prog, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+    void* data = malloc(length);
+    GLenum format;
+    glGetProgramBinary(prog, length, 0, &format, data);
+
+    struct program_binary_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, PROGRAM_BINARY_MAGIC, 4);
+    hdr.version = PROGRAM_BINARY_VERSION;
+    hdr.key = key;
+    hdr.format = format;
+    hdr.length = length;
+    hdr.checksum = hash_bytes(14695981039346656037ULL, data, length);
+
+    /* Write aside and swap in, readers never see a partial file */
+    char fpath[600], tmp_path[610];
+    program_binary_path(fpath, sizeof(fpath), key);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", fpath);
+    FILE* f = fopen(tmp_path, "wb");
+    if (f) {
+        int ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1
+              && fwrite(data, 1, length, f) == (size_t)length;
+        ok = (fclose(f) == 0) && ok;
+        if (ok) {
+#ifdef _WIN32
+            remove(fpath);
+#endif
+            ok = rename(tmp_path, fpath) == 0;
+        }
+        if (!ok)
+            remove(tmp_path);
+    }
+    free(data);
+}
+
+void shader_cache_init(const char* dir)
+{
+    st.cache_dir[0] = '\0';
+    if (!dir || !dir[0] || strlen(dir) >= sizeof(st.cache_dir))
+        return;
+#ifdef _WIN32
+    _mkdir(dir);
+#else
+    mkdir(dir, 0755);
+#endif
+    strcpy(st.cache_dir, dir);
+}
+
+/*---------------------------------------------------------------------------
+ * Building
+ *---------------------------------------------------------------------------*/
+/* Appends the info log of a shader, or of the program when is_prog is set */
+static char* append_info_log(char* buf, GLuint id, int is_prog)
+{
+    GLint log_length = 0;
+    if (is_prog)
+        glGetProgramiv(id, GL_INFO_LOG_LENGTH, &log_length);
+    else
+        glGetShaderiv(id, GL_INFO_LOG_LENGTH, &log_length);
+    if (log_length <= 0)
+        return buf;
+    size_t len = strlen(buf);
+    buf = realloc(buf, len + log_length + 1);
+    if (is_prog)
+        glGetProgramInfoLog(id, log_length, 0, buf + len);
+    else
+        glGetShaderInfoLog(id, log_length, 0, buf + len);
+    return buf;
+}
+
+/* Gathers the logs of a program that failed to link, compile errors are only visible on its shaders */
+static char* program_error_log(GLuint prog)
+{
+    char* buf = calloc(1, 1);
+    GLuint shaders[8];
+    GLsizei num_shaders = 0;
+    glGetAttachedShaders(prog, array_length(shaders), &num_shaders, shaders);
+    for (GLsizei i = 0; i < num_shaders; ++i) {
+        GLint status = GL_FALSE;
+        glGetShaderiv(shaders[i], GL_COMPILE_STATUS, &status);
+        if (status == GL_FALSE)
+            buf = append_info_log(buf, shaders[i], 0);
+    }
+    return append_info_log(buf, prog, 1);
+}
+
+static void program_finish(GLuint prog, unsigned long long key, int store)
+{
+    /* First status query, this is where a parallel compile gets waited on */
+    GLint status = GL_FALSE;
+    glGetProgramiv(prog, GL_LINK_STATUS, &status);
+    if (status == GL_FALSE) {
+        char* log = program_error_log(prog);
+        const char* header = "PANIC!\nShader program failed to build:\n";
+        char* msg = malloc(strlen(header) + strlen(log) + 1);
+        strcpy(msg, header);
+        strcat(msg, log);
+        opengl_report_error(msg);
+        free(msg);
+        free(log);
+    } else if (store) {
+        program_binary_store(prog, key);
+    }
+
+    /* Shaders were only kept attached for their logs */
+    GLuint shaders[8];
+    GLsizei num_shaders = 0;
+    glGetAttachedShaders(prog, array_length(shaders), &num_shaders, shaders);
+    for (GLsizei i = 0; i < num_shaders; ++i)
+        glDetachShader(prog, shaders[i]);
+}
+
+static unsigned int shader_build_deferred(struct shader_attachment* attachments, size_t num_attachments)
+{
+    /* Let the driver compile on as many threads as it likes, compiles then return before they are done */
+    static int max_threads_set = 0;
+    if (!max_threads_set) {
+        if (HAS_OPENGL_EXTENSION(GL_KHR_parallel_shader_compile))
+            glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+        else if (HAS_OPENGL_EXTENSION(GL_ARB_parallel_shader_compile))
+            glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+        max_threads_set = 1;
+    }
+
     GLuint prog = glCreateProgram();
+    int cached = program_binary_supported();
+    unsigned long long key = cached ? program_key(attachments, num_attachments) : 0;
+    if (cached && program_binary_load(prog, key))
+        return prog;
+
     for (size_t i = 0; i < num_attachments; ++i) {
         struct shader_attachment* sa = &attachments[i];
         if (sa->src) {
@@ -56,17 +325,43 @@ unsigned int shader_build(struct shader_attachment* attachments, size_t num_atta
             glDeleteShader(s);
         }
     }
+    if (cached)
+        glProgramParameteri(prog, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glLinkProgram(prog);
+
+    /* Checked on the next shader_finish, unless there is no room to wait for it */
+    if (st.num_pending == SHADER_MAX_PENDING) {
+        program_finish(prog, key, cached);
+        return prog;
+    }
+    st.pending[st.num_pending].prog = prog;
+    st.pending[st.num_pending].key = key;
+    st.pending[st.num_pending].store = cached;
+    ++st.num_pending;
     return prog;
 }
 
-unsigned int shader_load(struct shader_files* sf)
+void shader_finish()
 {
-    const char* vs_src = shader_load_fsrc(sf->vs_loc);
-    const char* gs_src = shader_load_fsrc(sf->gs_loc);
-    const char* fs_src = shader_load_fsrc(sf->fs_loc);
-    const char* cs_src = shader_load_fsrc(sf->cs_loc);
-    unsigned int shdr = shader_build((struct shader_attachment[]){
+    for (unsigned int i = 0; i < st.num_pending; ++i)
+        program_finish(st.pending[i].prog, st.pending[i].key, st.pending[i].store);
+    st.num_pending = 0;
+}
+
+unsigned int shader_build(struct shader_attachment* attachments, size_t num_attachments)
+{
+    unsigned int prog = shader_build_deferred(attachments, num_attachments);
+    shader_finish();
+    return prog;
+}
+
+unsigned int shader_load_deferred(struct shader_files* sf)
+{
+    const char* vs_src = shader_load_fsrc(sf->vs_loc, sf->defines);
+    const char* gs_src = shader_load_fsrc(sf->gs_loc, sf->defines);
+    const char* fs_src = shader_load_fsrc(sf->fs_loc, sf->defines);
+    const char* cs_src = shader_load_fsrc(sf->cs_loc, sf->defines);
+    unsigned int shdr = shader_build_deferred((struct shader_attachment[]){
         {GL_VERTEX_SHADER,   vs_src},
         {GL_GEOMETRY_SHADER, gs_src},
         {GL_FRAGMENT_SHADER, fs_src},
@@ -77,3 +372,48 @@ unsigned int shader_load(struct shader_files* sf)
     free((void*)cs_src);
     return shdr;
 }
+
+unsigned int shader_load(struct shader_files* sf)
+{
+    unsigned int shdr = shader_load_deferred(sf);
+    shader_finish();
+    return shdr;
+}
+
+void shader_reflect(unsigned int prog, struct shader_uniform_ref* uniforms, size_t num_uniforms, struct shader_block* blocks, size_t num_blocks)
+{
+    for (size_t i = 0; i < num_uniforms; ++i) {
+        uniforms[i].u->loc = -1;
+        uniforms[i].u->type = 0;
+    }
+
+    /* Walk the active uniforms once, array uniforms are reported with a [0] suffix */
+    GLint num_active = 0, max_name_len = 0;
+    glGetProgramiv(prog, GL_ACTIVE_UNIFORMS, &num_active);
+    glGetProgramiv(prog, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_name_len);
+    char* name = calloc(1, max_name_len + 1);
+    for (GLint a = 0; a < num_active; ++a) {
+        GLint size;
+        GLenum type;
+        glGetActiveUniform(prog, a, max_name_len + 1, 0, &size, &type, name);
+        char* bracket = strchr(name, '[');
+        if (bracket)
+            *bracket = '\0';
+        for (size_t i = 0; i < num_uniforms; ++i) {
+            if (strcmp(uniforms[i].name, name) == 0) {
+                uniforms[i].u->loc = glGetUniformLocation(prog, uniforms[i].name);
+                uniforms[i].u->type = type;
+            }
+        }
+    }
+    free(name);
+
+    for (size_t i = 0; i < num_blocks; ++i) {
+        blocks[i].size = 0;
+        GLuint idx = glGetUniformBlockIndex(prog, blocks[i].name);
+        if (idx == GL_INVALID_INDEX)
+            continue;
+        glUniformBlockBinding(prog, idx, blocks[i].binding);
+        glGetActiveUniformBlockiv(prog, idx, GL_UNIFORM_BLOCK_DATA_SIZE, &blocks[i].size);
+    }
+}
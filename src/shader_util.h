@@ -46,9 +46,43 @@ struct shader_files {
     const char* gs_loc;
     const char* fs_loc;
     const char* cs_loc;
+    /* Newline terminated preprocessor lines inserted after the version directive of every stage, optional */
+    const char* defines;
 };
 
+/* Uniform of a linked program, resolved once by shader_reflect instead of by name on every update.
+ * Uniforms the program does not use stay at location -1, which updates silently ignore */
+struct shader_uniform {
+    int loc;
+    /* GL_INT, GL_FLOAT_VEC3, ..., zero when inactive */
+    unsigned int type;
+};
+
+/* Name of a uniform to resolve and the handle that receives it */
+struct shader_uniform_ref {
+    const char* name;
+    struct shader_uniform* u;
+};
+
+/* Uniform block of a linked program, assigned its binding point by shader_reflect */
+struct shader_block {
+    const char* name;
+    unsigned int binding;
+    /* Buffer size the block needs, zero when inactive */
+    int size;
+};
+
+/* Keeps linked program binaries in the given directory, keyed by their sources and the driver.
+ * Caching is off until called and after a call with null */
+void shader_cache_init(const char* dir);
 unsigned int shader_build(struct shader_attachment* attachments, size_t num_attachments);
 unsigned int shader_load(struct shader_files* sf);
+/* Kicks off the compile and link without waiting for them, so that the driver can build several
+ * programs in parallel. The program must not be used before the next shader_finish */
+unsigned int shader_load_deferred(struct shader_files* sf);
+/* Waits for every deferred program, reports their errors and caches their binaries */
+void shader_finish();
+/* Resolves the given uniforms and binds the given blocks of a linked program */
+void shader_reflect(unsigned int prog, struct shader_uniform_ref* uniforms, size_t num_uniforms, struct shader_block* blocks, size_t num_blocks);
 
 #endif /* ! _SHADER_UTIL_H_ */
@@ -0,0 +1,161 @@
+#include "threadpool.h"
+#include <stdlib.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+typedef HANDLE thread_t;
+typedef CRITICAL_SECTION mutex_t;
+typedef CONDITION_VARIABLE cond_t;
+#define mutex_init(m)     InitializeCriticalSection(m)
+#define mutex_destroy(m)  DeleteCriticalSection(m)
+#define mutex_lock(m)     EnterCriticalSection(m)
+#define mutex_unlock(m)   LeaveCriticalSection(m)
+#define cond_init(c)      InitializeConditionVariable(c)
+#define cond_destroy(c)   ((void)(c))
+#define cond_wait(c, m)   SleepConditionVariableCS(c, m, INFINITE)
+#define cond_broadcast(c) WakeAllConditionVariable(c)
+#else
+#include <pthread.h>
+#include <unistd.h>
+typedef pthread_t thread_t;
+typedef pthread_mutex_t mutex_t;
+typedef pthread_cond_t cond_t;
+#define mutex_init(m)     pthread_mutex_init(m, 0)
+#define mutex_destroy(m)  pthread_mutex_destroy(m)
+#define mutex_lock(m)     pthread_mutex_lock(m)
+#define mutex_unlock(m)   pthread_mutex_unlock(m)
+#define cond_init(c)      pthread_cond_init(c, 0)
+#define cond_destroy(c)   pthread_cond_destroy(c)
+#define cond_wait(c, m)   pthread_cond_wait(c, m)
+#define cond_broadcast(c) pthread_cond_broadcast(c)
+#endif
+
+struct threadpool {
+    thread_t* workers;
+    unsigned int num_workers;
+    mutex_t lock;
+    /* Signaled when a new batch of jobs is posted or on shutdown */
+    cond_t work_cv;
+    /* Signaled when the last job of a batch finishes */
+    cond_t done_cv;
+    /* Current batch */
+    threadpool_job_fn fn;
+    void* ud;
+    unsigned int num_jobs;
+    unsigned int next_job;
+    unsigned int jobs_done;
+    unsigned long generation;
+    int shutdown;
+};
+
+/* Runs jobs of the current batch until none are left, called with the lock held */
+static void run_jobs(struct threadpool* tp)
+{
+    while (tp->next_job < tp->num_jobs) {
+        unsigned int job = tp->next_job++;
+        mutex_unlock(&tp->lock);
+        tp->fn(tp->ud, job);
+        mutex_lock(&tp->lock);
+        if (++tp->jobs_done == tp->num_jobs)
+            cond_broadcast(&tp->done_cv);
+    }
+}
+
+#ifdef _WIN32
+static DWORD WINAPI worker_main(LPVOID arg)
+#else
+static void* worker_main(void* arg)
+#endif
+{
+    struct threadpool* tp = arg;
+    unsigned long seen = 0;
+    mutex_lock(&tp->lock);
+    for (;;) {
+        while (!tp->shutdown && tp->generation == seen)
+            cond_wait(&tp->work_cv, &tp->lock);
+        if (tp->shutdown)
+            break;
+        seen = tp->generation;
+        run_jobs(tp);
+    }
+    mutex_unlock(&tp->lock);
+    return 0;
+}
+
+static unsigned int online_cpus()
+{
+#ifdef _WIN32
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    return si.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? n : 1;
+#endif
+}
+
+struct threadpool* threadpool_create(unsigned int num_threads)
+{
+    if (num_threads == 0)
+        num_threads = online_cpus();
+    struct threadpool* tp = calloc(1, sizeof(*tp));
+    mutex_init(&tp->lock);
+    cond_init(&tp->work_cv);
+    cond_init(&tp->done_cv);
+
+    /* The calling thread takes part in every run, so one less worker is needed */
+    tp->num_workers = num_threads - 1;
+    tp->workers = calloc(tp->num_workers + 1, sizeof(thread_t));
+    for (unsigned int i = 0; i < tp->num_workers; ++i) {
+#ifdef _WIN32
+        tp->workers[i] = CreateThread(0, 0, worker_main, tp, 0, 0);
+#else
+        pthread_create(&tp->workers[i], 0, worker_main, tp);
+#endif
+    }
+    return tp;
+}
+
+void threadpool_destroy(struct threadpool* tp)
+{
+    mutex_lock(&tp->lock);
+    tp->shutdown = 1;
+    cond_broadcast(&tp->work_cv);
+    mutex_unlock(&tp->lock);
+    for (unsigned int i = 0; i < tp->num_workers; ++i) {
+#ifdef _WIN32
+        WaitForSingleObject(tp->workers[i], INFINITE);
+        CloseHandle(tp->workers[i]);
+#else
+        pthread_join(tp->workers[i], 0);
+#endif
+    }
+    cond_destroy(&tp->done_cv);
+    cond_destroy(&tp->work_cv);
+    mutex_destroy(&tp->lock);
+    free(tp->workers);
+    free(tp);
+}
+
+unsigned int threadpool_size(struct threadpool* tp)
+{
+    return tp->num_workers + 1;
+}
+
+void threadpool_run(struct threadpool* tp, threadpool_job_fn fn, void* ud, unsigned int num_jobs)
+{
+    if (num_jobs == 0)
+        return;
+    mutex_lock(&tp->lock);
+    tp->fn = fn;
+    tp->ud = ud;
+    tp->num_jobs = num_jobs;
+    tp->next_job = 0;
+    tp->jobs_done = 0;
+    ++tp->generation;
+    cond_broadcast(&tp->work_cv);
+    run_jobs(tp);
+    while (tp->jobs_done < tp->num_jobs)
+        cond_wait(&tp->done_cv, &tp->lock);
+    mutex_unlock(&tp->lock);
+}
@@ -1,5 +1,6 @@
 #include "uvmap.h"
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 
 struct quadrilateral {
@@ -13,23 +14,21 @@ struct node {
     int occupied;
 };
 
-static struct node* node_insert(struct node* n, struct quadrilateral* q, vec2 padding)
+/* Finds room for a rectangle of the given size, the rectangle goes at the returned node's origin */
+static struct node* node_insert(struct node* n, vec2 size)
 {
     /* If the node has no children, try to recursively insert into them */
     if (n->childs[0] && n->childs[1]) {
-        struct node* c = node_insert(n->childs[0], q, padding);
-        return c ? c : node_insert(n->childs[1], q, padding);
+        struct node* c = node_insert(n->childs[0], size);
+        return c ? c : node_insert(n->childs[1], size);
     } else {
         /* Can this rectangle be packed into this node? */
-        if (n->occupied || q->size.x > n->rect.width || q->size.y > n->rect.height) {
+        if (n->occupied || size.x > n->rect.width || size.y > n->rect.height) {
             return 0;
         }
         /* Does this rectangle have exactly the same size as this node? */
-        if (q->size.x == n->rect.width && q->size.y == n->rect.height) {
+        if (size.x == n->rect.width && size.y == n->rect.height) {
             n->occupied = 1;
-            vec2 offset = vec2_new(n->rect.x + padding.x / 2, n->rect.y + padding.y / 2);
-            for (unsigned int i = 0; i < 3; ++i)
-                *(q->tp[i]) = vec2_add(*(q->tp[i]), offset);
             return n;
         }
 
@@ -37,20 +36,20 @@ static struct node* node_insert(struct node* n, struct quadrilateral* q, vec2 pa
         n->childs[1] = calloc(1, sizeof(struct node));
 
         /* Decide which way to split */
-        float dw = n->rect.width - q->size.x;
-        float dh = n->rect.height - q->size.y;
+        float dw = n->rect.width - size.x;
+        float dh = n->rect.height - size.y;
 
         if (dw > dh) {
             /* Vertical partition */
-            n->childs[0]->rect = (struct nrect){n->rect.x, n->rect.y, q->size.x, n->rect.height};
-            n->childs[1]->rect = (struct nrect){n->rect.x + q->size.x, n->rect.y, n->rect.width - q->size.x, n->rect.height};
+            n->childs[0]->rect = (struct nrect){n->rect.x, n->rect.y, size.x, n->rect.height};
+            n->childs[1]->rect = (struct nrect){n->rect.x + size.x, n->rect.y, n->rect.width - size.x, n->rect.height};
         } else {
             /* Horizontal partition */
-            n->childs[0]->rect = (struct nrect){n->rect.x, n->rect.y, n->rect.width, q->size.y};
-            n->childs[1]->rect = (struct nrect){n->rect.x, n->rect.y + q->size.y, n->rect.width, n->rect.height - q->size.y};
+            n->childs[0]->rect = (struct nrect){n->rect.x, n->rect.y, n->rect.width, size.y};
+            n->childs[1]->rect = (struct nrect){n->rect.x, n->rect.y + size.y, n->rect.width, n->rect.height - size.y};
         }
 
-        return node_insert(n->childs[0], q, padding);
+        return node_insert(n->childs[0], size);
     }
 }
 
@@ -155,11 +154,221 @@ void uvmap_planar_project(vec2* uv, vec3* vertices, vec3* normals, size_t num_ve
     root->rect = (struct nrect){ pad.x / 2.0, pad.y / 2.0, 1.0 - pad.x / 2.0, 1.0 - pad.y / 2.0 };
     for (size_t i = 0; i < num_quads; ++i) {
         struct quadrilateral* q = &quads[i];
-        if (!node_insert(root, q, pad)) {
+        struct node* n = node_insert(root, q->size);
+        if (!n) {
             printf("Error! UV Map problem: [%lu](%f, %f)\n", i, q->size.x, q->size.y);
+            continue;
         }
+        vec2 offset = vec2_new(n->rect.x + pad.x / 2, n->rect.y + pad.y / 2);
+        for (unsigned int j = 0; j < 3; ++j)
+            *(q->tp[j]) = vec2_add(*(q->tp[j]), offset);
     }
 
     node_free(root);
     free(quads);
 }
+
+/* Times the chart packing is retried at a smaller scale before giving up */
+#define UVMAP_MAX_PACK_ATTEMPTS 32
+
+struct chart {
+    vec2 size;
+    unsigned int id;
+};
+
+static int chart_cmp(const void* a, const void* b)
+{
+    const struct chart* c1 = a;
+    const struct chart* c2 = b;
+    float a1 = c1->size.x * c1->size.y;
+    float a2 = c2->size.x * c2->size.y;
+    if (a1 < a2)
+        return 1;
+    if (a1 > a2)
+        return -1;
+    /* Stable order for equal areas, so that the packing does not depend on the qsort implementation */
+    return c1->id < c2->id ? -1 : (c1->id > c2->id);
+}
+
+static unsigned int uf_find(unsigned int* parent, unsigned int x)
+{
+    while (parent[x] != x) {
+        parent[x] = parent[parent[x]];
+        x = parent[x];
+    }
+    return x;
+}
+
+/* Projection axis of a triangle, the dominant component of its face normal and its sign */
+static unsigned int face_axis(const vec3* v0, const vec3* v1, const vec3* v2)
+{
+    vec3 e1 = vec3_sub(*v1, *v0), e2 = vec3_sub(*v2, *v0);
+    float n[3] = {
+        e1.y * e2.z - e1.z * e2.y,
+        e1.z * e2.x - e1.x * e2.z,
+        e1.x * e2.y - e1.y * e2.x
+    };
+    unsigned int k = 0;
+    for (unsigned int j = 1; j < 3; ++j)
+        if (fabsf(n[j]) > fabsf(n[k]))
+            k = j;
+    return 2 * k + (n[k] < 0.0f);
+}
+
+/* Numbers the distinct positions, vertices that only differ in other attributes share an id */
+static unsigned int* position_ids(const vec3* vertices, size_t num_vertices)
+{
+    size_t table_size = 1024;
+    while (table_size < 2 * num_vertices)
+        table_size *= 2;
+    unsigned int* table = malloc(table_size * sizeof(*table));
+    memset(table, 0xFF, table_size * sizeof(*table));
+    unsigned int* ids = malloc(num_vertices * sizeof(*ids));
+    for (size_t v = 0; v < num_vertices; ++v) {
+        unsigned int bits[3];
+        memcpy(bits, &vertices[v], sizeof(bits));
+        unsigned int h = (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+        size_t s = (h ^ (h >> 16)) & (table_size - 1);
+        while (table[s] != 0xFFFFFFFF && memcmp(&vertices[table[s]], &vertices[v], sizeof(bits)) != 0)
+            s = (s + 1) & (table_size - 1);
+        if (table[s] == 0xFFFFFFFF)
+            table[s] = v;
+        ids[v] = table[s];
+    }
+    free(table);
+    return ids;
+}
+
+size_t uvmap_chart_project(vec2** uv_out, unsigned int** remap_out, vec3* vertices, size_t num_vertices, unsigned int* indices, size_t num_indices, unsigned int width, unsigned int height, unsigned int padding)
+{
+    size_t num_tris = num_indices / 3;
+
+    /* Triangles that share a position and face the same axis end up in one chart */
+    unsigned int* pos_id = position_ids(vertices, num_vertices);
+    unsigned int* axis = malloc(num_tris * sizeof(*axis));
+    unsigned int* parent = malloc(num_tris * sizeof(*parent));
+    unsigned int* vertex_tri = malloc(num_vertices * 6 * sizeof(*vertex_tri));
+    memset(vertex_tri, 0xFF, num_vertices * 6 * sizeof(*vertex_tri));
+    for (size_t t = 0; t < num_tris; ++t) {
+        const unsigned int* tri = indices + 3 * t;
+        axis[t] = face_axis(&vertices[tri[0]], &vertices[tri[1]], &vertices[tri[2]]);
+        parent[t] = t;
+        for (unsigned int j = 0; j < 3; ++j) {
+            unsigned int* first = &vertex_tri[6 * pos_id[tri[j]] + axis[t]];
+            if (*first == 0xFFFFFFFF) {
+                *first = t;
+            } else {
+                unsigned int a = uf_find(parent, *first), b = uf_find(parent, t);
+                parent[a > b ? a : b] = a < b ? a : b;
+            }
+        }
+    }
+
+    /* Number the charts in order of their first triangle */
+    unsigned int* chart_of = malloc(num_tris * sizeof(*chart_of));
+    unsigned int num_charts = 0;
+    for (size_t t = 0; t < num_tris; ++t) {
+        unsigned int r = uf_find(parent, t);
+        chart_of[t] = r == t ? num_charts++ : chart_of[r];
+    }
+
+    /* A vertex belongs to one chart per axis at most, split it once for each.
+     * vertex_tri is reused as the output vertex of every vertex and axis */
+    memset(vertex_tri, 0xFF, num_vertices * 6 * sizeof(*vertex_tri));
+    size_t num_out = 0, cap_out = num_vertices;
+    unsigned int* remap = malloc(cap_out * sizeof(*remap));
+    unsigned int* out_chart = malloc(cap_out * sizeof(*out_chart));
+    unsigned int* out_axis = malloc(cap_out * sizeof(*out_axis));
+    for (size_t i = 0; i < num_indices; ++i) {
+        size_t t = i / 3;
+        unsigned int* out = &vertex_tri[6 * indices[i] + axis[t]];
+        if (*out == 0xFFFFFFFF) {
+            if (num_out == cap_out) {
+                cap_out *= 2;
+                remap = realloc(remap, cap_out * sizeof(*remap));
+                out_chart = realloc(out_chart, cap_out * sizeof(*out_chart));
+                out_axis = realloc(out_axis, cap_out * sizeof(*out_axis));
+            }
+            remap[num_out] = indices[i];
+            out_chart[num_out] = chart_of[t];
+            out_axis[num_out] = axis[t];
+            *out = num_out++;
+        }
+        indices[i] = *out;
+    }
+    free(vertex_tri);
+    free(pos_id);
+    free(chart_of);
+    free(parent);
+    free(axis);
+
+    /* Project every vertex onto the plane of its chart, same planes as uvmap_planar_project */
+    vec2* uv = malloc(num_out * sizeof(*uv));
+    struct chart* charts = malloc(num_charts * sizeof(*charts));
+    vec2* cmin = malloc(num_charts * sizeof(*cmin));
+    for (unsigned int c = 0; c < num_charts; ++c) {
+        charts[c].id = c;
+        cmin[c] = vec2_new(INFINITY, INFINITY);
+        charts[c].size = vec2_new(-INFINITY, -INFINITY);
+    }
+    for (size_t v = 0; v < num_out; ++v) {
+        const vec3* p = &vertices[remap[v]];
+        switch (out_axis[v] / 2) {
+            case 0:  uv[v] = vec2_new(p->y, p->z); break;
+            case 1:  uv[v] = vec2_new(p->x, p->z); break;
+            default: uv[v] = vec2_new(p->y, p->x); break;
+        }
+        struct chart* c = &charts[out_chart[v]];
+        cmin[c->id].x = min(cmin[c->id].x, uv[v].x);
+        cmin[c->id].y = min(cmin[c->id].y, uv[v].y);
+        c->size.x = max(c->size.x, uv[v].x);
+        c->size.y = max(c->size.y, uv[v].y);
+    }
+    float scale = 0.0f;
+    for (unsigned int c = 0; c < num_charts; ++c) {
+        charts[c].size = vec2_sub(charts[c].size, cmin[c]);
+        scale += charts[c].size.x * charts[c].size.y;
+    }
+    scale = sqrt(scale) * 1.35;
+    qsort(charts, num_charts, sizeof(*charts), chart_cmp);
+
+    /* Pack the chart bounds with padding in between. Few large charts leave more
+     * room unused than many small ones, shrink them until everything fits */
+    vec2 pad = vec2_new((float)padding / width, (float)padding / height);
+    vec2* offset = malloc(num_charts * sizeof(*offset));
+    for (unsigned int attempt = 0;; ++attempt, scale *= 1.1f) {
+        struct node* root = calloc(1, sizeof(struct node));
+        root->rect = (struct nrect){ pad.x / 2.0, pad.y / 2.0, 1.0 - pad.x / 2.0, 1.0 - pad.y / 2.0 };
+        unsigned int i = 0;
+        for (; i < num_charts; ++i) {
+            struct chart* c = &charts[i];
+            struct node* n = node_insert(root, vec2_add(vec2_div(c->size, scale), pad));
+            if (!n)
+                break;
+            offset[c->id] = vec2_new(n->rect.x + pad.x / 2, n->rect.y + pad.y / 2);
+        }
+        node_free(root);
+        if (i == num_charts)
+            break;
+        if (attempt == UVMAP_MAX_PACK_ATTEMPTS) {
+            printf("Error! UV Map problem: [%u](%f, %f)\n", i, charts[i].size.x / scale, charts[i].size.y / scale);
+            for (; i < num_charts; ++i)
+                offset[charts[i].id] = vec2_new(0.0f, 0.0f);
+            break;
+        }
+    }
+
+    for (size_t v = 0; v < num_out; ++v) {
+        unsigned int c = out_chart[v];
+        uv[v] = vec2_add(vec2_div(vec2_sub(uv[v], cmin[c]), scale), offset[c]);
+    }
+
+    free(offset);
+    free(cmin);
+    free(charts);
+    free(out_axis);
+    free(out_chart);
+    *uv_out = uv;
+    *remap_out = remap;
+    return num_out;
+}
@@ -35,5 +35,9 @@
 #include <linalgb.h>
 
 void uvmap_planar_project(vec2* uv, vec3* vertices, vec3* normals, size_t num_vertices, unsigned int* indices, size_t num_indices, unsigned int width, unsigned int height, unsigned int padding);
+/* Lightmap uvs of an indexed mesh. Triangles that touch and face the same axis form a chart that is projected
+ * onto that axis plane, vertices shared between charts are split. Indices are rewritten to the split vertices,
+ * uv_out and remap_out receive the uv and source vertex of each, free both. Returns the split vertex count */
+size_t uvmap_chart_project(vec2** uv_out, unsigned int** remap_out, vec3* vertices, size_t num_vertices, unsigned int* indices, size_t num_indices, unsigned int width, unsigned int height, unsigned int padding);
 
 #endif /* ! _UVMAP_H_ */